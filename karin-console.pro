@@ -2,3 +2,7 @@ TEMPLATE = subdirs
 SUBDIRS = lib src_meegotouch graphicsview_src
 CONFIG += ordered
 
+# the tests are optional, build them with "qmake CONFIG+=tests"
+tests {
+    SUBDIRS += tests
+}
@@ -49,7 +49,7 @@ BlockArray::BlockArray()
 {
     // lastmap_index = index = current = size_t(-1);
     if (blocksize == 0)
-        blocksize = ((sizeof(Block) / getpagesize()) + 1) * getpagesize();
+        blocksize = ((sizeof(Block) + getpagesize() - 1) / getpagesize()) * getpagesize();
 
 }
 
@@ -69,7 +69,7 @@ size_t BlockArray::append(Block *block)
 
     int rc;
     rc = lseek(ion, current * blocksize, SEEK_SET); if (rc < 0) { perror("HistoryBuffer::add.seek"); setHistorySize(0); return size_t(-1); }
-    rc = write(ion, block, blocksize); if (rc < 0) { perror("HistoryBuffer::add.write"); setHistorySize(0); return size_t(-1); }
+    rc = write(ion, block, sizeof(Block)); if (rc < 0) { perror("HistoryBuffer::add.write"); setHistorySize(0); return size_t(-1); }
 
     length++;
     if (length > size) length = size;
@@ -125,7 +125,8 @@ const Block* BlockArray::at(size_t i)
 //         return 0;
 //     }
 
-    size_t j = i; // (current - (index - i) + (index/size+1)*size) % size ;
+    // blocks are written round-robin, so block i lives at position i % size
+    size_t j = i % size;
 
     assert(j < size);
     unmap();
@@ -170,6 +171,8 @@ bool BlockArray::setHistorySize(size_t newsize)
         if (ion >= 0) close(ion);
         ion = -1;
         current = size_t(-1);
+        size = 0;
+        length = 0;
         return true;
     }
 
@@ -27,6 +27,8 @@
 
 // Qt
 #include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
 
 // Local
 #include "CharacterColor.h"
@@ -34,6 +36,8 @@
 namespace Konsole
 {
 
+class Screen;
+
 typedef unsigned char LineProperty;
 
 static const int LINE_DEFAULT		= 0;
@@ -54,6 +58,15 @@ static const int LINE_DOUBLEHEIGHT	= (1 << 2);
  * A single character in the terminal which consists of a unicode character
  * value, foreground and background colors and a set of rendition attributes
  * which specify how it should be drawn.
+ *
+ * The character value is a full unicode code point, including those outside
+ * of the basic multilingual plane.
+ *
+ * Characters are stored in 8 bytes without padding, so that they can be 
+ * copied and compared as plain memory.  The character value and the 
+ * rendition share 32 bits, and the colors are packed into 16 bits each 
+ * (see CharacterColor::pack()) and are accessed through foregroundColor() 
+ * and backgroundColor().
  */
 class Character
 {
@@ -66,33 +79,78 @@ public:
    * @param _b The color used to draw the character's background.
    * @param _r A set of rendition flags which specify how this character is to be drawn.
    */
-  inline Character(quint16 _c = ' ',
+  inline Character(quint32 _c = ' ',
             CharacterColor  _f = CharacterColor(COLOR_SPACE_DEFAULT,DEFAULT_FORE_COLOR),
             CharacterColor  _b = CharacterColor(COLOR_SPACE_DEFAULT,DEFAULT_BACK_COLOR),
             quint8  _r = DEFAULT_RENDITION)
-       : character(_c), rendition(_r), foregroundColor(_f), backgroundColor(_b) {}
-
-  union
+       : character(_c), rendition(_r)
   {
-    /** The unicode character value for this character. */
-    quint16 character;
-    /** 
-     * Experimental addition which allows a single Character instance to contain more than
-     * one unicode character.
-     *
-     * charSequence is a hash code which can be used to look up the unicode
-     * character sequence in the ExtendedCharTable used to create the sequence.
-     */
-    quint16 charSequence; 
-  };
+      setForegroundColor(_f);
+      setBackgroundColor(_b);
+  }
+
+  /** 
+   * The unicode code point of this character.
+   *
+   * If the RE_EXTENDED_CHAR rendition flag is set, this is instead a key 
+   * which can be used to look up a sequence of unicode characters, such as
+   * a base character followed by combining marks, in 
+   * ExtendedCharTable::instance.
+   */
+  quint32 character : 24;
 
   /** A combination of RENDITION flags which specify options for drawing the character. */
-  quint8  rendition;
+  quint32 rendition : 8;
+
+  /** Returns the foreground color used to draw this character. */
+  CharacterColor foregroundColor() const 
+  { return CharacterColor::unpack(_foreground); }
+  /** Returns the color used to draw this character's background. */
+  CharacterColor backgroundColor() const
+  { return CharacterColor::unpack(_background); }
 
-  /** The foreground color used to draw this character. */
-  CharacterColor  foregroundColor; 
-  /** The color used to draw this character's background. */
-  CharacterColor  backgroundColor;
+  /** Sets the foreground color used to draw this character. */
+  void setForegroundColor(const CharacterColor& color)
+  { _foreground = color.pack(); }
+  /** Sets the color used to draw this character's background. */
+  void setBackgroundColor(const CharacterColor& color)
+  { _background = color.pack(); }
+
+  /** Exchanges the foreground and background colors of this character. */
+  void swapColors()
+  { qSwap(_foreground,_background); }
+
+  /** Returns true if this character has the same colors as @p other. */
+  bool hasSameColors(const Character& other) const
+  { 
+      return _foreground == other._foreground && 
+             _background == other._background;
+  }
+
+  /** 
+   * Returns true if either of the colors of this character is an RGB color,
+   * which is stored as an index into TrueColorTable::instance.
+   */
+  bool hasTrueColor() const
+  { 
+      return CharacterColor::isPackedTrueColor(_foreground) || 
+             CharacterColor::isPackedTrueColor(_background); 
+  }
+  /**
+   * Replaces the TrueColorTable index of each RGB color of this character 
+   * with the result of calling @p map with the index.
+   *
+   * This is used to translate the indexes when characters are stored for
+   * longer than the lifetime of the color table.
+   */
+  template <typename Map>
+  void remapTrueColors(Map& map)
+  {
+      if (CharacterColor::isPackedTrueColor(_foreground))
+          _foreground = CharacterColor::packTrueColor(map(CharacterColor::trueColorIndex(_foreground)));
+      if (CharacterColor::isPackedTrueColor(_background))
+          _background = CharacterColor::packTrueColor(map(CharacterColor::trueColorIndex(_background)));
+  }
 
   /** 
    * Returns true if this character has a transparent background when
@@ -116,48 +174,66 @@ public:
    * renditions or colors.
    */
   friend bool operator != (const Character& a, const Character& b);
+
+private:
+  // the colors, packed by CharacterColor::pack()
+  quint16 _foreground;
+  quint16 _background;
 };
 
+// fails to compile if Character is not packed into 8 bytes
+typedef char CharacterSizeCheck[sizeof(Character) == 8 ? 1 : -1];
+
 inline bool operator == (const Character& a, const Character& b)
 { 
   return a.character == b.character && 
          a.rendition == b.rendition && 
-         a.foregroundColor == b.foregroundColor && 
-         a.backgroundColor == b.backgroundColor;
+         a.hasSameColors(b);
 }
 
 inline bool operator != (const Character& a, const Character& b)
 {
-  return    a.character != b.character || 
-            a.rendition != b.rendition || 
-            a.foregroundColor != b.foregroundColor || 
-            a.backgroundColor != b.backgroundColor;
+  return !operator==(a,b);
 }
 
 inline bool Character::isTransparent(const ColorEntry* base) const
 {
-  return ((backgroundColor._colorSpace == COLOR_SPACE_DEFAULT) && 
-          base[backgroundColor._u+0+(backgroundColor._v?BASE_COLORS:0)].transparent)
-      || ((backgroundColor._colorSpace == COLOR_SPACE_SYSTEM) && 
-          base[backgroundColor._u+2+(backgroundColor._v?BASE_COLORS:0)].transparent);
+  const CharacterColor color = CharacterColor::unpack(_background);
+  const int index = color._u + (color._v ? BASE_COLORS : 0);
+
+  return ((color._colorSpace == COLOR_SPACE_DEFAULT) && base[index+0].transparent)
+      || ((color._colorSpace == COLOR_SPACE_SYSTEM) && base[index+2].transparent);
 }
 
 inline bool Character::isBold(const ColorEntry* base) const
 {
-  return ((backgroundColor._colorSpace == COLOR_SPACE_DEFAULT) &&
-            base[backgroundColor._u+0+(backgroundColor._v?BASE_COLORS:0)].bold)
-      || ((backgroundColor._colorSpace == COLOR_SPACE_SYSTEM) &&
-            base[backgroundColor._u+2+(backgroundColor._v?BASE_COLORS:0)].bold);
+  const CharacterColor color = CharacterColor::unpack(_background);
+  const int index = color._u + (color._v ? BASE_COLORS : 0);
+
+  return ((color._colorSpace == COLOR_SPACE_DEFAULT) && base[index+0].bold)
+      || ((color._colorSpace == COLOR_SPACE_SYSTEM) && base[index+2].bold);
 }
 
 extern unsigned short vt100_graphics[32];
 
 
 /**
- * A table which stores sequences of unicode characters, referenced
- * by hash keys.  The hash key itself is the same size as a unicode
- * character ( ushort ) so that it can occupy the same space in
- * a structure.
+ * A table which stores sequences of unicode characters, such as a base
+ * character followed by combining marks, referenced by keys which fit into 
+ * Character::character.
+ *
+ * The sequences are interned: adding a sequence which is already in the 
+ * table returns the key of the existing entry.  The characters of all
+ * sequences are kept in a single buffer and looking up a key is a 
+ * constant time index into the table.
+ *
+ * Sequences which are no longer used are discarded when the table grows,
+ * by collecting the sequences still referred to by the screens which have
+ * been registered with addScreen().  Each key includes a generation 
+ * number of its slot in the table, so that keys of discarded sequences
+ * which are still held elsewhere (for example by a terminal display which
+ * has not been updated yet) do not look up the sequence which reuses the 
+ * slot, and cells which refer to the two sequences never compare equal.
  */
 class ExtendedCharTable
 {
@@ -166,42 +242,99 @@ public:
     ExtendedCharTable();
     ~ExtendedCharTable();
 
+    /** The maximum length of a sequence in the table. */
+    static const int MAX_SEQUENCE_LENGTH = 16;
+
     /**
      * Adds a sequences of unicode characters to the table and returns
-     * a hash code which can be used later to look up the sequence
+     * a key which can be used later to look up the sequence
      * using lookupExtendedChar()
      *
-     * If the same sequence already exists in the table, the hash
+     * If the same sequence already exists in the table, the key
      * of the existing sequence will be returned.
      *
+     * Returns 0 if the table is full.
+     *
      * @param unicodePoints An array of unicode character points
-     * @param length Length of @p unicodePoints
+     * @param length Length of @p unicodePoints, at most MAX_SEQUENCE_LENGTH
      */
-    ushort createExtendedChar(ushort* unicodePoints , ushort length);
+    quint32 createExtendedChar(const uint* unicodePoints , ushort length);
     /**
      * Looks up and returns a pointer to a sequence of unicode characters
      * which was added to the table using createExtendedChar().
      *
-     * @param hash The hash key returned by createExtendedChar()
+     * The returned pointer is only valid until the next call to 
+     * createExtendedChar().
+     *
+     * @param key The key returned by createExtendedChar()
      * @param length This variable is set to the length of the 
      * character sequence.
      *
-     * @return A unicode character sequence of size @p length.
+     * @return A unicode character sequence of size @p length, or 0 if
+     * the sequence has been discarded.
+     */
+    const uint* lookupExtendedChar(quint32 key , ushort& length) const;
+
+    /** 
+     * Registers a screen which is asked to mark the sequences used by its
+     * cells and its history when the table is collected, see 
+     * Screen::markExtendedChars()
+     */
+    void addScreen(Screen* screen);
+    /** Unregisters a screen added with addScreen(). */
+    void removeScreen(Screen* screen);
+
+    /**
+     * Marks the sequences referred to by @p count @p cells as used.
+     * Called by the screens while the table is being collected.
      */
-    ushort* lookupExtendedChar(ushort hash , ushort& length) const;
+    void markUsed(const Character* cells , int count);
+    /** Marks the sequence referred to by @p key as used. */
+    void markUsed(quint32 key);
 
     /** The global ExtendedCharTable instance. */
     static ExtendedCharTable instance;
 private:
+    // keys consist of the index of the slot of the sequence and the 
+    // generation of the slot, which changes whenever it is reused.  
+    // generations start at 1, so that 0 is never a valid key.  keys 
+    // must fit into the 24 bits of Character::character
+    static const int SLOT_BITS = 16;
+    static const quint32 SLOT_MASK = (1 << SLOT_BITS) - 1;
+    static const int MAX_GENERATION = 0xFF;
+
+    // the table is not collected before it holds this many sequences
+    static const int MIN_COLLECT_THRESHOLD = 1024;
+
+    struct Entry
+    {
+        int offset;         // position of the sequence in _points
+        ushort length;      // 0 if the slot is free
+        ushort generation;
+        uint hash;
+        int next;           // next slot with the same hash or -1
+        quint32 mark;       // _markStamp of the last collection which found it used
+    };
+
     // calculates the hash key of a sequence of unicode points of size 'length'
-    ushort extendedCharHash(ushort* unicodePoints , ushort length) const;
-    // tests whether the entry in the table specified by 'hash' matches the 
+    uint extendedCharHash(const uint* unicodePoints , ushort length) const;
+    // tests whether the entry in the table specified by 'slot' matches the 
     // character sequence 'unicodePoints' of size 'length'
-    bool extendedCharMatch(ushort hash , ushort* unicodePoints , ushort length) const;
-    // internal, maps hash keys to character sequence buffers.  The first ushort
-    // in each value is the length of the buffer, followed by the ushorts in the buffer
-    // themselves.
-    QHash<ushort,ushort*> extendedCharTable;
+    bool extendedCharMatch(int slot , const uint* unicodePoints , ushort length) const;
+    // returns the slot of the entry referred to by 'key' or -1 if the
+    // key belongs to a discarded sequence
+    int slotOf(quint32 key) const;
+    // discards all sequences which are not used by any of the screens
+    void collectGarbage();
+
+    QVector<Entry> _entries;
+    QVector<uint> _points;           // the characters of all sequences
+    QHash<uint,int> _buckets;        // hash -> first slot with that hash
+    QVector<int> _freeSlots;
+    int _usedSlots;
+    int _collectThreshold;
+    quint32 _markStamp;
+    QSet<Screen*> _screens;
 };
 
 }
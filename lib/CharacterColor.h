@@ -26,11 +26,17 @@
 #define CHARACTERCOLOR_H
 
 // Qt
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
 #include <QtGui/QColor>
 
 namespace Konsole
 {
 
+class Character;
+class Screen;
+
 /** 
  * An entry in a terminal display's color palette. 
  *
@@ -144,6 +150,119 @@ static const ColorEntry base_color_table[TABLE_COLORS] =
 #define COLOR_SPACE_256         3
 #define COLOR_SPACE_RGB         4
 
+/**
+ * A table of the RGB colors used by the characters in the terminal.
+ *
+ * Characters only have room for a 16-bit color value, so colors in the
+ * COLOR_SPACE_RGB color space are stored as a 15-bit index into this table.
+ *
+ * When the table is full, the colors which are no longer used by any of the
+ * screens registered with addScreen() are discarded and their indexes are
+ * reused for new colors.  generation() changes whenever that happens, so
+ * that copies of cells made before, such as a terminal display's image, 
+ * can be discarded.
+ */
+class TrueColorTable
+{
+public:
+  /** Constructs a new color table. */
+  TrueColorTable();
+
+  /** 
+   * Returns the index of @p rgb in the table, adding it if necessary.
+   * Returns -1 if the color is not in the table and the table is full.
+   */
+  int indexOf(QRgb rgb)
+  {
+      QHash<QRgb,quint16>::const_iterator iter = _indexes.constFind(rgb);
+      if (iter != _indexes.constEnd())
+          return iter.value();
+
+      if (_freeIndexes.isEmpty() && _colors.count() > MAX_COLORS && 
+          _addedColors >= MIN_COLLECT_INTERVAL)
+          collectGarbage();
+
+      quint16 index;
+      if (!_freeIndexes.isEmpty())
+      {
+          index = _freeIndexes.last();
+          _freeIndexes.pop_back();
+          _colors[index] = rgb;
+      }
+      else if (_colors.count() <= MAX_COLORS)
+      {
+          index = _colors.count();
+          _colors.append(rgb);
+          _marks.append(_markStamp);
+      }
+      else
+      {
+          return -1;
+      }
+
+      _indexes.insert(rgb,index);
+      _addedColors++;
+      return index;
+  }
+  /** Returns the color with the specified @p index, see indexOf() */
+  QRgb color(quint16 index) const { return index < _colors.count() ? _colors[index] : 0; }
+
+  /** 
+   * Returns a number which changes whenever the indexes of discarded colors 
+   * may have been reused for other colors.
+   */
+  int generation() const { return _generation; }
+
+  /** 
+   * Registers a screen which is asked to mark the colors used by its cells
+   * and its history when the table is collected, see Screen::markTrueColors()
+   */
+  void addScreen(Screen* screen) { _screens.insert(screen); }
+  /** Unregisters a screen added with addScreen(). */
+  void removeScreen(Screen* screen) { _screens.remove(screen); }
+
+  /**
+   * Marks the RGB colors of @p count @p cells as used.
+   * Called by the screens while the table is being collected.
+   */
+  void markUsed(const Character* cells, int count);
+  /** Marks the color with the specified @p index as used. */
+  void markUsed(quint16 index) 
+  { 
+      if (index < _marks.count())
+          _marks[index] = _markStamp; 
+  }
+
+  /** The global TrueColorTable instance. */
+  static TrueColorTable instance;
+
+private:
+  static const int MAX_COLORS = 0x7FFF;
+  // the table is not collected again before this many colors were added
+  static const int MIN_COLLECT_INTERVAL = 1024;
+
+  // discards all colors which are not used by any of the screens
+  void collectGarbage();
+
+  // marks the colors passed to Character::remapTrueColors() as used and 
+  // leaves them unchanged
+  struct MarkColor
+  {
+    TrueColorTable* table;
+    quint16 operator()(quint16 index) { table->markUsed(index); return index; }
+  };
+
+  QVector<QRgb> _colors;
+  QVector<quint32> _marks;      // _markStamp of the last collection which found 
+                                // the color used
+  QHash<QRgb,quint16> _indexes;
+  QVector<quint16> _freeIndexes;
+  int _addedColors;             // colors added since the last collection
+  int _generation;
+  quint32 _markStamp;
+  QSet<Screen*> _screens;
+};
+
 /**
  * Describes the color of a single character in the terminal.
  */
@@ -222,6 +341,27 @@ public:
    * it is ignored.
    */
   QColor color(const ColorEntry* palette) const;
+
+  /**
+   * Returns the value of this color packed into 16 bits, including the
+   * color space, as stored in a Character.
+   *
+   * RGB colors are packed as an index into TrueColorTable::instance with the
+   * top bit set.  If that table is full they are approximated by a color of 
+   * the 256 color space.  Colors of the other color spaces are packed as the
+   * color space in bits 12-14, the @c v byte in bits 8-11 and the @c u byte 
+   * in the low 8 bits.
+   */
+  quint16 pack() const;
+  /** Returns the color described by a value returned by pack() */
+  static CharacterColor unpack(quint16 value);
+
+  /** Returns true if @p value, returned by pack(), is an RGB color. */
+  static bool isPackedTrueColor(quint16 value) { return value & 0x8000; }
+  /** Returns the TrueColorTable index of a packed RGB color @p value. */
+  static quint16 trueColorIndex(quint16 value) { return value & 0x7FFF; }
+  /** Returns the packed value of the RGB color at @p index in TrueColorTable::instance. */
+  static quint16 packTrueColor(quint16 index) { return 0x8000 | index; }
  
   /** 
    * Compares two colors and returns true if they represent the same color value and
@@ -287,6 +427,57 @@ inline QColor CharacterColor::color(const ColorEntry* base) const
   return QColor();
 }
 
+inline quint16 CharacterColor::pack() const
+{
+  switch (_colorSpace)
+  {
+    case COLOR_SPACE_DEFAULT: 
+    case COLOR_SPACE_SYSTEM: return (_colorSpace << 12) | ((_v & 0x0F) << 8) | _u;
+    case COLOR_SPACE_256: return (COLOR_SPACE_256 << 12) | _u;
+    case COLOR_SPACE_RGB:
+    {
+      const int index = TrueColorTable::instance.indexOf(qRgb(_u,_v,_w));
+      if (index >= 0)
+        return packTrueColor(index);
+
+      // use the nearest color of the 6x6x6 color cube instead
+      return (COLOR_SPACE_256 << 12) | 
+             (16 + 36*((_u*5+127)/255) + 6*((_v*5+127)/255) + ((_w*5+127)/255));
+    }
+  }
+  return COLOR_SPACE_UNDEFINED << 12;
+}
+
+inline CharacterColor CharacterColor::unpack(quint16 value)
+{
+  CharacterColor color;
+  if (isPackedTrueColor(value))
+  {
+    const QRgb rgb = TrueColorTable::instance.color(trueColorIndex(value));
+    color._colorSpace = COLOR_SPACE_RGB;
+    color._u = qRed(rgb);
+    color._v = qGreen(rgb);
+    color._w = qBlue(rgb);
+    return color;
+  }
+
+  color._colorSpace = value >> 12;
+  switch (color._colorSpace)
+  {
+    case COLOR_SPACE_DEFAULT:
+    case COLOR_SPACE_SYSTEM: 
+      color._u = value & 0xFF;
+      color._v = (value >> 8) & 0x0F;
+      break;
+    case COLOR_SPACE_256:
+      color._u = value & 0xFF;
+      break;
+    default:
+      color._colorSpace = COLOR_SPACE_UNDEFINED;
+  }
+  return color;
+}
+
 inline void CharacterColor::toggleIntensive()
 {
   if (_colorSpace == COLOR_SPACE_SYSTEM || _colorSpace == COLOR_SPACE_DEFAULT)
@@ -30,6 +30,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 // Qt
@@ -51,6 +52,26 @@
 
 using namespace Konsole;
 
+// the interval between frames, about one frame of a 60Hz display
+#define FRAME_INTERVAL 16
+// the interval between frames while a flood of output is being received
+#define FLOOD_FRAME_INTERVAL 100
+// the rate of output above which it is treated as a flood
+#define FLOOD_BYTES_PER_SECOND (512*1024)
+// output which arrives this many milliseconds after a key press is
+// treated as its echo
+#define ECHO_TIMEOUT 250
+// the number of decoded characters which are passed to receiveChars() at once
+#define DECODE_BLOCK_SIZE 4096
+// the number of characters of pasted text which are encoded and sent at once
+#define PASTE_CHUNK_SIZE 4096
+// the number of bytes of pasted text which may be waiting to be written
+// to the terminal process
+#define PASTE_MAX_IN_FLIGHT (64*1024)
+// the longest time in milliseconds spent sending pasted text before
+// returning to the event loop
+#define PASTE_TIME_BUDGET 8
+
 /* ------------------------------------------------------------------------- */
 /*                                                                           */
 /*                               Emulation                                  */
@@ -67,7 +88,15 @@ Emulation::Emulation() :
   _codec(0),
   _decoder(0),
   _keyTranslator(0),
-  _usesMouse(false)
+  _usesMouse(false),
+  _utf8CodePoint(0),
+  _utf8Remaining(0),
+  _utf8Minimum(0),
+  _frameBytes(0),
+  _flooding(false),
+  _pastePosition(0),
+  _pasting(false),
+  _pasteBytesInFlight(0)
 {
 
   // create screens with a default size
@@ -75,8 +104,11 @@ Emulation::Emulation() :
   _screen[1] = new Screen(40,80);
   _currentScreen = _screen[0];
 
-  QObject::connect(&_bulkTimer1, SIGNAL(timeout()), this, SLOT(showBulk()) );
-  QObject::connect(&_bulkTimer2, SIGNAL(timeout()), this, SLOT(showBulk()) );
+  _frameTimer.setSingleShot(true);
+  QObject::connect(&_frameTimer, SIGNAL(timeout()), this, SLOT(showBulk()) );
+
+  _pasteTimer.setSingleShot(true);
+  QObject::connect(&_pasteTimer, SIGNAL(timeout()), this, SLOT(sendPasteChunks()) );
    
   // listen for mouse status changes
   connect( this , SIGNAL(programUsesMouseChanged(bool)) , 
@@ -167,6 +199,7 @@ void Emulation::setCodec(const QTextCodec * qtc)
   _codec = qtc;
   delete _decoder;
   _decoder = _codec->makeDecoder();
+  _utf8Remaining = 0;
 
   emit useUtf8Request(utf8());
 }
@@ -219,6 +252,12 @@ void Emulation::receiveChar(int c)
   };
 }
 
+void Emulation::receiveChars(const uint* chars, int count)
+{
+  for (int i = 0; i < count; i++)
+    receiveChar(chars[i]);
+}
+
 /* ------------------------------------------------------------------------- */
 /*                                                                           */
 /*                             Keyboard Handling                             */
@@ -238,6 +277,7 @@ void Emulation::sendKeyEvent( QKeyEvent* ev )
     // We should do a conversion here, but since this
     // routine will never be used, we simply emit plain ascii.
     //emit sendBlock(ev->text().toAscii(),ev->text().length());
+    keyPressed();
     emit sendData(ev->text().toUtf8(),ev->text().length());
   }
 }
@@ -263,27 +303,183 @@ void Emulation::receiveData(const char* text, int length)
 {
 	emit stateSet(NOTIFYACTIVITY);
 
+	_frameBytes += length;
+	_frameStatistics.bytes += length;
 	bufferedUpdate();
     	
+	//decode the text and send the characters to the terminal emulator.
+	//UTF-8 is decoded here, other encodings by the text codec
+	const bool zmodem = utf8() ? decodeUtf8(text,length) : decodeText(text,length);
+
+	//show the echo of a key press straight away, unless the output is
+	//part of a flood
+	if (!_keyPressTime.isNull())
+	{
+		if (!_flooding && _keyPressTime.elapsed() < ECHO_TIMEOUT)
+		{
+			_frameStatistics.echoFrames++;
+			showBulk();
+		}
+		_keyPressTime = QTime();
+	}
+
+	if (zmodem)
+		emit zmodemDetected();
+}
+
+// returns whether the text following the ZModem start character at 
+// text[i] is the rest of the signature which starts a ZModem transfer
+static inline bool isZModemSignature(const char* text, int length, int i)
+{
+	return (length-i-1 > 3) && (strncmp(text+i+1, "B00", 3) == 0);
+}
+
+bool Emulation::decodeUtf8(const char* text, int length)
+{
+	const uchar* bytes = reinterpret_cast<const uchar*>(text);
+
+	uint chars[DECODE_BLOCK_SIZE];
+	int count = 0;
+	bool zmodem = false;
+
+	int i = 0;
+	while (i < length)
+	{
+		// each byte adds at most two characters
+		if (count > DECODE_BLOCK_SIZE - 2)
+		{
+			receiveChars(chars,count);
+			count = 0;
+		}
+
+		// printable ASCII characters are copied eight at a time.  A word
+		// contains only bytes from 0x20 to 0x7f if subtracting 0x20 from 
+		// each byte neither borrows nor leaves a high bit set
+		if (_utf8Remaining == 0)
+		{
+			while (i + 8 <= length && count <= DECODE_BLOCK_SIZE - 8)
+			{
+				quint64 word;
+				memcpy(&word,bytes+i,8);
+				if ( ((word - Q_UINT64_C(0x2020202020202020)) | word) & Q_UINT64_C(0x8080808080808080) )
+					break;
+
+				for (int j = 0; j < 8; j++)
+					chars[count++] = bytes[i+j];
+				i += 8;
+			}
+
+			if (i == length)
+				break;
+			if (count > DECODE_BLOCK_SIZE - 2)
+				continue;
+		}
+
+		const uchar c = bytes[i];
+
+		if (_utf8Remaining > 0)
+		{
+			if ((c & 0xc0) == 0x80)
+			{
+				_utf8CodePoint = (_utf8CodePoint << 6) | (c & 0x3f);
+				i++;
+
+				if (--_utf8Remaining == 0)
+				{
+					// reject overlong sequences, surrogates and code points
+					// outside of Unicode
+					if (_utf8CodePoint < _utf8Minimum || _utf8CodePoint > 0x10ffff ||
+						(_utf8CodePoint >= 0xd800 && _utf8CodePoint <= 0xdfff))
+						chars[count++] = QChar::ReplacementCharacter;
+					else
+						chars[count++] = _utf8CodePoint;
+				}
+				continue;
+			}
+
+			// the sequence was cut short, the byte starts the next one
+			chars[count++] = QChar::ReplacementCharacter;
+			_utf8Remaining = 0;
+		}
+
+		if (c < 0x80)
+		{
+			if (c == '\030' && isZModemSignature(text,length,i))
+				zmodem = true;
+			chars[count++] = c;
+		}
+		else if ((c & 0xe0) == 0xc0)
+		{
+			_utf8CodePoint = c & 0x1f;
+			_utf8Remaining = 1;
+			_utf8Minimum = 0x80;
+		}
+		else if ((c & 0xf0) == 0xe0)
+		{
+			_utf8CodePoint = c & 0x0f;
+			_utf8Remaining = 2;
+			_utf8Minimum = 0x800;
+		}
+		else if ((c & 0xf8) == 0xf0)
+		{
+			_utf8CodePoint = c & 0x07;
+			_utf8Remaining = 3;
+			_utf8Minimum = 0x10000;
+		}
+		else
+		{
+			chars[count++] = QChar::ReplacementCharacter;
+		}
+		i++;
+	}
+
+	if (count > 0)
+		receiveChars(chars,count);
+
+	return zmodem;
+}
+
+bool Emulation::decodeText(const char* text, int length)
+{
     QString unicodeText = _decoder->toUnicode(text,length);
 
-	//send characters to terminal emulator
-	for (int i=0;i<unicodeText.length();i++)
+	//combine surrogate pairs into the code points of characters outside
+	//of the basic multilingual plane
+	const ushort* utf16 = unicodeText.utf16();
+	const int utf16Length = unicodeText.length();
+	uint chars[DECODE_BLOCK_SIZE];
+	int count = 0;
+	for (int i = 0; i < utf16Length; i++)
 	{
-		receiveChar(unicodeText[i].unicode());
+		if (count == DECODE_BLOCK_SIZE)
+		{
+			receiveChars(chars,count);
+			count = 0;
+		}
+
+		if ( QChar(utf16[i]).isHighSurrogate() && i+1 < utf16Length &&
+			 QChar(utf16[i+1]).isLowSurrogate() )
+		{
+			chars[count++] = QChar::surrogateToUcs4(utf16[i],utf16[i+1]);
+			i++;
+		}
+		else
+			chars[count++] = utf16[i];
 	}
 
+	//send characters to terminal emulator
+	if (count > 0)
+		receiveChars(chars,count);
+
 	//look for z-modem indicator
-	//-- someone who understands more about z-modems that I do may be able to move
-	//this check into the above for loop?
-	for (int i=0;i<length;i++)
+	const char* found = text;
+	while ((found = static_cast<const char*>(memchr(found,'\030',text+length-found))))
 	{
-		if (text[i] == '\030')
-    		{
-      			if ((length-i-1 > 3) && (strncmp(text+i+1, "B00", 3) == 0))
-      				emit zmodemDetected();
-    		}
+		if (isZModemSignature(text,length,found-text))
+			return true;
+		found++;
 	}
+	return false;
 }
 
 //OLDER VERSION
@@ -391,15 +587,29 @@ int Emulation::lineCount()
 
 // Refreshing -------------------------------------------------------------- --
 
-#define BULK_TIMEOUT1 10
-#define BULK_TIMEOUT2 40
-
 /*!
 */
 void Emulation::showBulk()
 {
-    _bulkTimer1.stop();
-    _bulkTimer2.stop();
+    _frameTimer.stop();
+
+    // decide from the rate at which output arrived since the last frame 
+    // whether a flood is in progress, which slows down the following frames
+    const int elapsed = _lastFrameTime.isNull() ? FRAME_INTERVAL : qMax(1,_lastFrameTime.elapsed());
+    _flooding = _frameBytes * 1000 / elapsed > FLOOD_BYTES_PER_SECOND;
+    _frameBytes = 0;
+    _lastFrameTime.start();
+
+    _frameStatistics.frames++;
+    if (_flooding)
+        _frameStatistics.floodFrames++;
+    if (!_firstOutputTime.isNull())
+    {
+        const int latency = _firstOutputTime.elapsed();
+        _frameStatistics.totalLatency += latency;
+        _frameStatistics.maxLatency = qMax(_frameStatistics.maxLatency,latency);
+        _firstOutputTime = QTime();
+    }
 
     emit outputChanged();
 
@@ -409,13 +619,147 @@ void Emulation::showBulk()
 
 void Emulation::bufferedUpdate()
 {
-   _bulkTimer1.setSingleShot(true);
-   _bulkTimer1.start(BULK_TIMEOUT1);
-   if (!_bulkTimer2.isActive())
-   {
-      _bulkTimer2.setSingleShot(true);
-      _bulkTimer2.start(BULK_TIMEOUT2);
-   }
+   if (_firstOutputTime.isNull())
+       _firstOutputTime.start();
+
+   if (_frameTimer.isActive())
+       return;
+
+   // the next frame is sent one frame interval after the previous one, 
+   // so that all the output which arrives in between is coalesced into it
+   const int interval = _flooding ? FLOOD_FRAME_INTERVAL : FRAME_INTERVAL;
+   const int elapsed = _lastFrameTime.isNull() ? interval : _lastFrameTime.elapsed();
+   _frameTimer.start(qBound(0,interval - elapsed,interval));
+}
+
+void Emulation::keyPressed()
+{
+    _keyPressTime.start();
+}
+
+const FrameStatistics& Emulation::frameStatistics() const
+{
+    return _frameStatistics;
+}
+
+void Emulation::resetFrameStatistics()
+{
+    _frameStatistics = FrameStatistics();
+}
+
+bool Emulation::pasteInProgress() const
+{
+    return _pasting;
+}
+
+QByteArray Emulation::pasteDelimiter(bool) const
+{
+    return QByteArray();
+}
+
+void Emulation::paste(const QString& text)
+{
+    if (text.isEmpty())
+        return;
+
+    _pasteQueue.append(text);
+
+    if (!_pasting)
+    {
+        startPaste();
+        sendPasteChunks();
+    }
+}
+
+void Emulation::startPaste()
+{
+    _pasteText = _pasteQueue.takeFirst();
+    _pastePosition = 0;
+    _pasteEnd = pasteDelimiter(false);
+    _pasting = true;
+
+    const QByteArray start = pasteDelimiter(true);
+    if (!start.isEmpty())
+    {
+        _pasteBytesInFlight += start.length();
+        emit sendData(start.constData(),start.length());
+    }
+}
+
+void Emulation::cancelPaste()
+{
+    if (!_pasting)
+        return;
+
+    _pasteQueue.clear();
+    _pasteTimer.stop();
+    _pastePosition = _pasteText.length();
+    sendPasteChunks();
+}
+
+void Emulation::sendBufferEmpty()
+{
+    _pasteBytesInFlight = 0;
+
+    // continue from the event loop, since the buffer may have become 
+    // empty while sendPasteChunks() was sending data
+    if (_pasting && !_pasteTimer.isActive())
+        _pasteTimer.start(0);
+}
+
+void Emulation::sendPasteChunks()
+{
+    QTime time;
+    time.start();
+
+    while (_pasting)
+    {
+        if (_pastePosition == _pasteText.length())
+        {
+            _pasting = false;
+            _pasteText = QString();
+
+            if (!_pasteEnd.isEmpty())
+            {
+                const QByteArray end = _pasteEnd;
+                _pasteEnd = QByteArray();
+                _pasteBytesInFlight += end.length();
+                emit sendData(end.constData(),end.length());
+            }
+
+            if (!_pasteQueue.isEmpty())
+                startPaste();
+            continue;
+        }
+
+        // wait for sendBufferEmpty() once enough text is on its way to the 
+        // terminal process, or let the event loop run if sending takes long
+        if (_pasteBytesInFlight >= PASTE_MAX_IN_FLIGHT)
+            return;
+        if (time.elapsed() >= PASTE_TIME_BUDGET)
+        {
+            _pasteTimer.start(0);
+            return;
+        }
+
+        int length = qMin(PASTE_CHUNK_SIZE,_pasteText.length() - _pastePosition);
+        // do not split a surrogate pair
+        if (_pastePosition + length < _pasteText.length() && 
+            _pasteText.at(_pastePosition + length - 1).isHighSurrogate())
+            length++;
+
+        QString chunk = _pasteText.mid(_pastePosition,length);
+        chunk.replace('\n','\r');
+        // the pasted text could otherwise end a bracketed paste with its 
+        // own end delimiter and have the rest run as commands
+        if (!_pasteEnd.isEmpty())
+            chunk.remove(QChar(0x1b));
+        _pastePosition += length;
+
+        const QByteArray data = _codec->fromUnicode(chunk);
+        _pasteBytesInFlight += data.length();
+        emit sendData(data.constData(),data.length());
+    }
 }
 
 char Emulation::getErase() const
@@ -442,77 +786,117 @@ QSize Emulation::imageSize()
   return QSize(_currentScreen->getColumns(), _currentScreen->getLines());
 }
 
-ushort ExtendedCharTable::extendedCharHash(ushort* unicodePoints , ushort length) const
+uint ExtendedCharTable::extendedCharHash(const uint* unicodePoints , ushort length) const
 {
-    ushort hash = 0;
+    uint hash = 0;
     for ( ushort i = 0 ; i < length ; i++ )
     {
         hash = 31*hash + unicodePoints[i];
     }
     return hash;
 }
-bool ExtendedCharTable::extendedCharMatch(ushort hash , ushort* unicodePoints , ushort length) const
+bool ExtendedCharTable::extendedCharMatch(int slot , const uint* unicodePoints , ushort length) const
 {
-    ushort* entry = extendedCharTable[hash];
+    const Entry& entry = _entries[slot];
 
-    // compare given length with stored sequence length ( given as the first ushort in the 
-    // stored buffer ) 
-    if ( entry == 0 || entry[0] != length ) 
+    if ( entry.length != length ) 
        return false;
-    // if the lengths match, each character must be checked.  the stored buffer starts at
-    // entry[1]
+
+    const uint* points = _points.constData() + entry.offset;
     for ( int i = 0 ; i < length ; i++ )
     {
-        if ( entry[i+1] != unicodePoints[i] )
+        if ( points[i] != unicodePoints[i] )
            return false; 
     } 
     return true;
 }
-ushort ExtendedCharTable::createExtendedChar(ushort* unicodePoints , ushort length)
+int ExtendedCharTable::slotOf(quint32 key) const
+{
+    const int slot = key & SLOT_MASK;
+
+    if ( slot >= _entries.count() )
+        return -1;
+
+    const Entry& entry = _entries[slot];
+    if ( entry.length == 0 || entry.generation != (key >> SLOT_BITS) )
+        return -1;
+
+    return slot;
+}
+quint32 ExtendedCharTable::createExtendedChar(const uint* unicodePoints , ushort length)
 {
-    // look for this sequence of points in the table
-    ushort hash = extendedCharHash(unicodePoints,length);
+    Q_ASSERT( length > 0 && length <= MAX_SEQUENCE_LENGTH );
+
+    const uint hash = extendedCharHash(unicodePoints,length);
 
-    // check existing entry for match
-    while ( extendedCharTable.contains(hash) )
+    // look for an existing entry with this sequence of points
+    QHash<uint,int>::const_iterator bucket = _buckets.constFind(hash);
+    if ( bucket != _buckets.constEnd() )
     {
-        if ( extendedCharMatch(hash,unicodePoints,length) )
-        {
-            // this sequence already has an entry in the table, 
-            // return its hash
-            return hash;
-        }
-        else
+        for ( int slot = bucket.value() ; slot != -1 ; slot = _entries[slot].next )
         {
-            // if hash is already used by another, different sequence of unicode character
-            // points then try next hash
-            hash++;
+            if ( extendedCharMatch(slot,unicodePoints,length) )
+                return ((quint32)_entries[slot].generation << SLOT_BITS) | slot;
         }
-    }    
+    }
+
+    if ( _usedSlots >= _collectThreshold )
+        collectGarbage();
+
+    // add the new sequence to the table, reusing a discarded slot if there is one
+    int slot;
+    if ( !_freeSlots.isEmpty() )
+    {
+        slot = _freeSlots.last();
+        _freeSlots.pop_back();
+    }
+    else if ( _entries.count() <= (int)SLOT_MASK )
+    {
+        slot = _entries.count();
+        Entry entry;
+        entry.generation = 1;
+        _entries.append(entry);
+    }
+    else
+    {
+        return 0;
+    }
 
-    
-     // add the new sequence to the table and
-     // return that index
-    ushort* buffer = new ushort[length+1];
-    buffer[0] = length;
+    Entry& entry = _entries[slot];
+    entry.offset = _points.count();
+    entry.length = length;
+    entry.hash = hash;
+    entry.mark = _markStamp;
     for ( int i = 0 ; i < length ; i++ )
-       buffer[i+1] = unicodePoints[i]; 
-    
-    extendedCharTable.insert(hash,buffer);
+        _points.append(unicodePoints[i]);
 
-    return hash;
+    QHash<uint,int>::iterator first = _buckets.find(hash);
+    if ( first == _buckets.end() )
+    {
+        entry.next = -1;
+        _buckets.insert(hash,slot);
+    }
+    else
+    {
+        entry.next = first.value();
+        first.value() = slot;
+    }
+
+    _usedSlots++;
+
+    return ((quint32)entry.generation << SLOT_BITS) | slot;
 }
 
-ushort* ExtendedCharTable::lookupExtendedChar(ushort hash , ushort& length) const
+const uint* ExtendedCharTable::lookupExtendedChar(quint32 key , ushort& length) const
 {
     // lookup index in table and if found, set the length
     // argument and return a pointer to the character sequence
 
-    ushort* buffer = extendedCharTable[hash];
-    if ( buffer )
+    const int slot = slotOf(key);
+    if ( slot != -1 )
     {
-        length = buffer[0];
-        return buffer+1;
+        length = _entries[slot].length;
+        return _points.constData() + _entries[slot].offset;
     }
     else
     {
@@ -521,22 +905,145 @@ ushort* ExtendedCharTable::lookupExtendedChar(ushort hash , ushort& length) cons
     }
 }
 
+void ExtendedCharTable::addScreen(Screen* screen)
+{
+    _screens.insert(screen);
+}
+
+void ExtendedCharTable::removeScreen(Screen* screen)
+{
+    _screens.remove(screen);
+}
+
+void ExtendedCharTable::markUsed(const Character* cells , int count)
+{
+    for ( int i = 0 ; i < count ; i++ )
+    {
+        if ( cells[i].rendition & RE_EXTENDED_CHAR )
+            markUsed(cells[i].character);
+    }
+}
+
+void ExtendedCharTable::markUsed(quint32 key)
+{
+    const int slot = slotOf(key);
+    if ( slot != -1 )
+        _entries[slot].mark = _markStamp;
+}
+
+void ExtendedCharTable::collectGarbage()
+{
+    _markStamp++;
+
+    QSetIterator<Screen*> iter(_screens);
+    while ( iter.hasNext() )
+        iter.next()->markExtendedChars(*this);
+
+    // keep the sequences which are still used, packed at the start of a
+    // new buffer, and bump the generation of the other slots so that 
+    // their keys become invalid
+    QVector<uint> points;
+    points.reserve(_points.count());
+    _buckets.clear();
+    _freeSlots.clear();
+    _usedSlots = 0;
+
+    for ( int slot = _entries.count()-1 ; slot >= 0 ; slot-- )
+    {
+        Entry& entry = _entries[slot];
+
+        if ( entry.length != 0 && entry.mark == _markStamp )
+        {
+            const int offset = points.count();
+            for ( int i = 0 ; i < entry.length ; i++ )
+                points.append(_points[entry.offset + i]);
+            entry.offset = offset;
+
+            QHash<uint,int>::iterator first = _buckets.find(entry.hash);
+            if ( first == _buckets.end() )
+            {
+                entry.next = -1;
+                _buckets.insert(entry.hash,slot);
+            }
+            else
+            {
+                entry.next = first.value();
+                first.value() = slot;
+            }
+            _usedSlots++;
+        }
+        else
+        {
+            if ( entry.length != 0 )
+            {
+                entry.length = 0;
+                entry.generation = entry.generation % MAX_GENERATION + 1;
+            }
+            _freeSlots.append(slot);
+        }
+    }
+
+    _points = points;
+    _collectThreshold = qMax((int)MIN_COLLECT_THRESHOLD,2*_usedSlots);
+}
+
 ExtendedCharTable::ExtendedCharTable()
+    : _usedSlots(0)
+    , _collectThreshold(MIN_COLLECT_THRESHOLD)
+    , _markStamp(0)
 {
 }
 ExtendedCharTable::~ExtendedCharTable()
 {
-    // free all allocated character buffers
-    QHashIterator<ushort,ushort*> iter(extendedCharTable);
+}
+
+// global instance
+ExtendedCharTable ExtendedCharTable::instance;
+
+TrueColorTable::TrueColorTable()
+    : _addedColors(0)
+    , _generation(0)
+    , _markStamp(0)
+{
+}
+
+void TrueColorTable::markUsed(const Character* cells, int count)
+{
+    MarkColor mark = { this };
+    for ( int i = 0 ; i < count ; i++ )
+    {
+        if ( cells[i].hasTrueColor() )
+        {
+            Character cell = cells[i];
+            cell.remapTrueColors(mark);
+        }
+    }
+}
+
+void TrueColorTable::collectGarbage()
+{
+    _markStamp++;
+
+    QSetIterator<Screen*> iter(_screens);
     while ( iter.hasNext() )
+        iter.next()->markTrueColors(*this);
+
+    for ( int index = _colors.count()-1 ; index >= 0 ; index-- )
     {
-        iter.next();
-        delete[] iter.value();
+        if ( _marks[index] != _markStamp )
+        {
+            _indexes.remove(_colors[index]);
+            _freeIndexes.append(index);
+        }
     }
+
+    if ( !_freeIndexes.isEmpty() )
+        _generation++;
+    _addedColors = 0;
 }
 
 // global instance
-ExtendedCharTable ExtendedCharTable::instance;
+TrueColorTable TrueColorTable::instance;
 
 
 //#include "moc_Emulation.cpp"
@@ -31,8 +31,10 @@
 // Qt 
 #include <QtGui/QKeyEvent>
 //#include <QPointer>
+#include <QtCore/QStringList>
 #include <QtCore/QTextCodec>
 #include <QtCore/QTextStream>
+#include <QtCore/QTime>
 #include <QtCore/QTimer>
 
 
@@ -70,6 +72,34 @@ enum
     NOTIFYSILENCE=3 
 };
 
+/**
+ * Statistics about the frames in which an emulation has sent its output
+ * to its views.  See Emulation::frameStatistics()
+ */
+struct FrameStatistics
+{
+    FrameStatistics()
+        : frames(0), echoFrames(0), floodFrames(0), bytes(0), 
+          totalLatency(0), maxLatency(0)
+    {}
+
+    /** The number of frames. */
+    int frames;
+    /** The number of frames sent immediately to echo a key press. */
+    int echoFrames;
+    /** The number of frames sent at the reduced rate used during floods of output. */
+    int floodFrames;
+    /** The number of bytes of output received. */
+    qint64 bytes;
+    /** 
+     * The sum of the delays in milliseconds between the arrival of the first 
+     * output of each frame and the frame. 
+     */
+    qint64 totalLatency;
+    /** The longest of these delays in milliseconds. */
+    int maxLatency;
+};
+
 /**
  * Base class for terminal emulation back-ends.
  *
@@ -217,6 +247,18 @@ public:
    */
   bool programUsesMouse() const;
 
+  /** 
+   * Returns statistics about the frames in which the output has been sent
+   * to the views since the emulation was created or since 
+   * resetFrameStatistics() was called.
+   */
+  const FrameStatistics& frameStatistics() const;
+  /** Resets the statistics returned by frameStatistics() */
+  void resetFrameStatistics();
+
+  /** Returns true while text passed to paste() is still being sent. */
+  bool pasteInProgress() const;
+
 public slots: 
 
   /** Change the size of the emulation's image */
@@ -249,10 +291,40 @@ public slots:
    */
   virtual void sendString(const char* string, int length = -1) = 0;
 
+  /**
+   * Sends pasted text to the terminal process.  Line feeds in @p text 
+   * are sent as carriage returns.  If the terminal program has enabled
+   * bracketed paste mode, the text is enclosed in the delimiters returned
+   * by pasteDelimiter() and escape characters are removed from it, so that
+   * the text can not end the bracketed paste early.
+   *
+   * The text is encoded and sent in small pieces, from the event loop, 
+   * so that a large paste neither needs a copy of all of its encoded text 
+   * nor blocks user input while it is sent.  Once a limited amount of text 
+   * has been sent, the rest waits until sendBufferEmpty() is called. 
+   *
+   * If a paste is still in progress, @p text is sent once it has finished.
+   */
+  void paste(const QString& text);
+
+  /** 
+   * Stops sending the text passed to paste(), including text waiting for
+   * an earlier paste to finish.  The end delimiter of a bracketed paste is
+   * still sent.
+   */
+  void cancelPaste();
+
+  /**
+   * Notifies the emulation that all of the data which it has emitted
+   * with sendData() has been written to the terminal process, so that 
+   * the sending of pasted text can continue.
+   */
+  void sendBufferEmpty();
+
   /** 
    * Processes an incoming stream of characters.  receiveData() decodes the incoming
-   * character buffer using the current codec(), and then calls receiveChar() for
-   * each unicode character in the resulting buffer.  
+   * character buffer using the current codec(), and then passes the resulting
+   * unicode characters to receiveChars().  
    *
    * receiveData() also starts a timer which causes the outputChanged() signal
    * to be emitted when it expires.  The timer allows multiple updates in quick
@@ -401,6 +473,17 @@ protected:
    */
   virtual void receiveChar(int ch);
 
+ /**
+   * Processes a buffer of incoming characters.  See receiveData()
+   *
+   * The default implementation calls receiveChar() for each character.
+   * Emulations can reimplement this to handle runs of plain text in one go.
+   *
+   * @p chars A buffer of unicode code points.
+   * @p count The number of characters in @p chars
+   */
+  virtual void receiveChars(const uint* chars, int count);
+
   /** 
    * Sets the active screen.  The terminal has two screens, primary and alternate.
    * The primary screen is used by default.  When certain interactive programs such
@@ -417,6 +500,21 @@ protected:
   };
   void setCodec(EmulationCodec codec); // codec number, 0 = locale, 1=utf8
 
+  /** 
+   * Notes that the user has pressed a key, so that the output which 
+   * echoes it is sent to the views without waiting for the next frame.
+   * Called by the emulations when they send key presses to the terminal.
+   */
+  void keyPressed();
+
+  /**
+   * Returns the delimiter which is sent before (if @p start is true) or
+   * after pasted text, or an empty array if the text is not delimited.  
+   * Called by paste() when it starts to send text.  
+   *
+   * The default implementation returns an empty array.
+   */
+  virtual QByteArray pasteDelimiter(bool start) const;
 
   QList<ScreenWindow*> _windows;
   
@@ -441,6 +539,9 @@ protected slots:
    * Schedules an update of attached views.
    * Repeated calls to bufferedUpdate() in close succession will result in only a single update,
    * much like the Qt buffered update of widgets. 
+   *
+   * Updates are sent at most once per frame interval, or less often while
+   * a flood of output is being received.
    */
   void bufferedUpdate();
 
@@ -450,14 +551,47 @@ private slots:
   // view
   void showBulk(); 
 
+  // sends the next pieces of the text passed to paste()
+  void sendPasteChunks();
+
   void usesMouseChanged(bool usesMouse);
 
 private:
 
+  // decodes UTF-8 text and passes the characters to receiveChars(),
+  // returns whether the text contains the signature of a ZModem transfer
+  bool decodeUtf8(const char* text, int length);
+  // decodes text with the text codec and passes the characters to 
+  // receiveChars(), returns whether the text contains the signature of 
+  // a ZModem transfer
+  bool decodeText(const char* text, int length);
+  // starts sending the next text in _pasteQueue
+  void startPaste();
+
   bool _usesMouse;
-  QTimer _bulkTimer1;
-  QTimer _bulkTimer2;
-  
+
+  uint _utf8CodePoint;      // the bits of the UTF-8 sequence decoded so far
+  int _utf8Remaining;       // the number of bytes still missing from the sequence
+  uint _utf8Minimum;        // the smallest code point which the sequence may encode,
+                            // anything smaller is an overlong encoding
+
+  QTimer _frameTimer;       // sends the next frame
+  QTime _lastFrameTime;     // when the last frame was sent
+  QTime _firstOutputTime;   // when the first output since the last frame arrived,
+                            // null if there has been none
+  QTime _keyPressTime;      // when a key press which has not been echoed yet was sent,
+                            // null if there is none
+  qint64 _frameBytes;       // bytes of output received since the last frame
+  bool _flooding;           // output is arriving faster than FLOOD_BYTES_PER_SECOND
+  FrameStatistics _frameStatistics;
+
+  QString _pasteText;           // the text passed to paste()
+  QStringList _pasteQueue;      // text pasted while a paste was in progress
+  int _pastePosition;           // the number of characters of _pasteText already sent
+  QByteArray _pasteEnd;         // the delimiter to send after _pasteText
+  bool _pasting;
+  int _pasteBytesInFlight;      // bytes sent since the send buffer was last empty
+  QTimer _pasteTimer;           // sends the next pieces from the event loop
 };
 
 }
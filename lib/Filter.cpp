@@ -119,72 +119,160 @@ QList<Filter::HotSpot*> FilterChain::hotSpots() const
 //QList<Filter::HotSpot*> FilterChain::hotSpotsAtLine(int line) const;
 
 TerminalImageFilterChain::TerminalImageFilterChain()
-: _buffer(0)
-, _linePositions(0)
+: _columns(0)
 {
 }
 
 TerminalImageFilterChain::~TerminalImageFilterChain()
 {
-    delete _buffer;
-    delete _linePositions;
+}
+
+void TerminalImageFilterChain::decodeParagraphs(const Character* image, int columns,
+                                                const QVector<LineProperty>& lineProperties,
+                                                const QVector<bool>* changed,
+                                                QString& buffer, QList<int>& linePositions) const
+{
+    PlainTextDecoder decoder;
+    decoder.setTrailingWhitespace(false);
+
+    buffer.clear();
+    linePositions.clear();
+
+    QTextStream lineStream(&buffer);
+    decoder.begin(&lineStream);
+
+    for (int i = 0 ; i < _paragraphs.count() ; i++)
+    {
+        const Paragraph& paragraph = _paragraphs[i];
+        const bool decode = !changed || changed->at(i);
+
+        for (int line = paragraph.firstLine ; line < paragraph.firstLine + paragraph.lineCount ; line++)
+        {
+            linePositions.append(buffer.length());
+
+            if (!decode)
+                continue;
+
+            decoder.decodeLine(image + line*columns,columns,LINE_DEFAULT);
+
+            // pretend that each line which is not wrapped ends with a newline character.
+            // this prevents a link that occurs at the end of one line
+            // being treated as part of a link that occurs at the start of the next line
+            if ( !(lineProperties.value(line,LINE_DEFAULT) & LINE_WRAPPED) )
+                lineStream << QChar('\n');
+        }
+    }
+    decoder.end();
 }
 
 void TerminalImageFilterChain::setImage(const Character* const image , int lines , int columns, const QVector<LineProperty>& lineProperties)
 {
-//qDebug("%s %d", __FILE__, __LINE__);
     if (empty())
         return;
-//qDebug("%s %d", __FILE__, __LINE__);
 
-    // reset all filters and hotspots
-    reset();
-//qDebug("%s %d", __FILE__, __LINE__);
+    // the text of each cell is compared with the previous image to find the 
+    // paragraphs which have changed.  extended characters are told apart from 
+    // ordinary ones by the bit above the character
+    QVector<quint64> cellText(lines*columns);
+    for (int i = 0 ; i < lines*columns ; i++)
+    {
+        cellText[i] = (quint64(image[i].rendition & RE_EXTENDED_CHAR) << 32) |
+                      image[i].character;
+    }
 
-    PlainTextDecoder decoder;
-    decoder.setTrailingWhitespace(false);
-    
-//qDebug("%s %d", __FILE__, __LINE__);
-    // setup new shared buffers for the filters to process on
-    QString* newBuffer = new QString();
-    QList<int>* newLinePositions = new QList<int>();
-    setBuffer( newBuffer , newLinePositions );
+    QVector<Paragraph> paragraphs;
+    for (int line = 0 ; line < lines ; )
+    {
+        Paragraph paragraph;
+        paragraph.firstLine = line;
+        paragraph.lineCount = 1;
+        while ( line + paragraph.lineCount < lines &&
+                (lineProperties.value(line + paragraph.lineCount - 1,LINE_DEFAULT) & LINE_WRAPPED) )
+            paragraph.lineCount++;
+
+        uint hash = 0;
+        const quint64* text = cellText.constData() + line*columns;
+        for (int i = 0 ; i < paragraph.lineCount*columns ; i++)
+            hash = 31*hash + uint(text[i] ^ (text[i] >> 32));
+        paragraph.hash = hash;
+
+        paragraphs << paragraph;
+        line += paragraph.lineCount;
+    }
 
-    // free the old buffers
-    delete _buffer;
-    delete _linePositions;
+    // find the paragraphs of the previous image which occur again, possibly 
+    // on other lines if the image has scrolled
+    QVector<bool> changed(paragraphs.count(),true);
+    QVector<int> newLines(_columns == columns ? _cellText.count() / qMax(columns,1) : 0,-1);
 
-    _buffer = newBuffer;
-    _linePositions = newLinePositions;
+    if (!newLines.isEmpty())
+    {
+        QMultiHash<uint,int> previousParagraphs;
+        for (int i = 0 ; i < _paragraphs.count() ; i++)
+            previousParagraphs.insert(_paragraphs[i].hash,i);
 
-    QTextStream lineStream(_buffer);
-    decoder.begin(&lineStream);
+        QVector<bool> reused(_paragraphs.count(),false);
+
+        for (int i = 0 ; i < paragraphs.count() ; i++)
+        {
+            const Paragraph& paragraph = paragraphs[i];
+            const int length = paragraph.lineCount*columns;
 
-    for (int i=0 ; i < lines ; i++)
+            QMultiHash<uint,int>::const_iterator iter = previousParagraphs.constFind(paragraph.hash);
+            for ( ; iter != previousParagraphs.constEnd() && iter.key() == paragraph.hash ; ++iter)
+            {
+                const Paragraph& previous = _paragraphs[iter.value()];
+
+                if ( reused[iter.value()] || previous.lineCount != paragraph.lineCount ||
+                     !qEqual(cellText.constData() + paragraph.firstLine*columns,
+                             cellText.constData() + paragraph.firstLine*columns + length,
+                             _cellText.constData() + previous.firstLine*columns) )
+                    continue;
+
+                reused[iter.value()] = true;
+                changed[i] = false;
+                for (int line = 0 ; line < paragraph.lineCount ; line++)
+                    newLines[previous.firstLine + line] = paragraph.firstLine + line;
+                break;
+            }
+        }
+    }
+
+    _columns = columns;
+    _cellText = cellText;
+    _paragraphs = paragraphs;
+
+    decodeParagraphs(image,columns,lineProperties,&changed,_buffer,_linePositions);
+
+    bool fullBufferDecoded = false;
+    QListIterator<Filter*> iter(*this);
+    while (iter.hasNext())
     {
-        _linePositions->append(_buffer->length());
-        decoder.decodeLine(image + i*columns,columns,LINE_DEFAULT);
-
-        // pretend that each line ends with a newline character.
-        // this prevents a link that occurs at the end of one line
-        // being treated as part of a link that occurs at the start of the next line
-        //
-        // the downside is that links which are spread over more than one line are not
-        // highlighted.  
-        //
-        // TODO - Use the "line wrapped" attribute associated with lines in a
-        // terminal image to avoid adding this imaginary character for wrapped
-        // lines
-        if ( !(lineProperties.value(i,LINE_DEFAULT) & LINE_WRAPPED) )
-        	lineStream << QChar('\n');
+        Filter* filter = iter.next();
+
+        if ( filter->isInvalidated() || newLines.isEmpty() )
+        {
+            // the filter has to process the whole image
+            if (!fullBufferDecoded)
+            {
+                decodeParagraphs(image,columns,lineProperties,0,_fullBuffer,_fullLinePositions);
+                fullBufferDecoded = true;
+            }
+            filter->reset();
+            filter->setBuffer(&_fullBuffer,&_fullLinePositions);
+        }
+        else
+        {
+            filter->moveHotSpots(newLines);
+            filter->setBuffer(&_buffer,&_linePositions);
+        }
     }
-    decoder.end();
-//    qDebug("%s %d", __FILE__, __LINE__);
 }
 
 Filter::Filter() :
 _linePositions(0),
-_buffer(0)
+_buffer(0),
+_invalidated(true)
 {
 }
 
@@ -198,14 +286,54 @@ Filter::~Filter()
 }
 void Filter::reset()
 {
+    qDeleteAll(_hotspotList);
     _hotspots.clear();
     _hotspotList.clear();
+    _invalidated = true;
+}
+
+void Filter::moveHotSpots(const QVector<int>& newLines)
+{
+    _hotspots.clear();
+
+    QMutableListIterator<HotSpot*> iter(_hotspotList);
+    while (iter.hasNext())
+    {
+        HotSpot* spot = iter.next();
+
+        const int startLine = newLines.value(spot->_startLine,-1);
+        const int endLine = newLines.value(spot->_endLine,-1);
+
+        if ( startLine == -1 || endLine - startLine != spot->_endLine - spot->_startLine )
+        {
+            iter.remove();
+            delete spot;
+            continue;
+        }
+
+        spot->_startLine = startLine;
+        spot->_endLine = endLine;
+
+        for (int line = startLine ; line <= endLine ; line++)
+            _hotspots.insert(line,spot);
+    }
+}
+
+void Filter::invalidate()
+{
+    _invalidated = true;
+}
+
+bool Filter::isInvalidated() const
+{
+    return _invalidated;
 }
 
 void Filter::setBuffer(const QString* buffer , const QList<int>* linePositions)
 {
     _buffer = buffer;
     _linePositions = linePositions;
+    _invalidated = false;
 }
 
 void Filter::getLineColumn(int position , int& startLine , int& startColumn)
@@ -213,30 +341,16 @@ void Filter::getLineColumn(int position , int& startLine , int& startColumn)
     Q_ASSERT( _linePositions );
     Q_ASSERT( _buffer );
 
+    // the line is the last one which starts at or before 'position'.  lines
+    // whose text is not in the buffer are empty and start at the same position
+    // as the line after them, so they are never chosen
+    const int line = qUpperBound(_linePositions->constBegin(),_linePositions->constEnd(),position) 
+                     - _linePositions->constBegin() - 1;
 
-    for (int i = 0 ; i < _linePositions->count() ; i++)
+    if ( line >= 0 )
     {
-        //kDebug() << "line position at " << i << " = " << _linePositions[i];
-        int nextLine = 0;
-
-        if ( i == _linePositions->count()-1 )
-        {
-            nextLine = _buffer->length() + 1;
-        }
-        else
-        {
-            nextLine = _linePositions->value(i+1);
-        }
-
-       // kDebug() << "pos - " << position << " line pos(" << i<< ") " << _linePositions->value(i) << 
-       //     " next = " << nextLine << " buffer len = " << _buffer->length();
-
-        if ( _linePositions->value(i) <= position && position < nextLine ) 
-        {
-            startLine = i;
-            startColumn = position - _linePositions->value(i);
-            return;
-        }
+        startLine = line;
+        startColumn = position - _linePositions->at(line);
     }
 }
     
@@ -358,6 +472,7 @@ QStringList RegExpFilter::HotSpot::capturedTexts() const
 void RegExpFilter::setRegExp(const QRegExp& regExp) 
 {
     _searchText = regExp;
+    invalidate();
 }
 QRegExp RegExpFilter::regExp() const
 {
@@ -429,6 +544,7 @@ RegExpFilter::HotSpot* UrlFilter::newHotSpot(int startLine,int startColumn,int e
 UrlFilter::HotSpot::HotSpot(int startLine,int startColumn,int endLine,int endColumn)
 : RegExpFilter::HotSpot(startLine,startColumn,endLine,endColumn)
 , _urlObject(new FilterObject(this))
+, _urlType(Unknown)
 {
     setType(Link);
 }
@@ -445,16 +561,13 @@ QString UrlFilter::HotSpot::tooltip() const
     else
         return QString();
 }
+void UrlFilter::HotSpot::setUrlType(UrlType type)
+{
+    _urlType = type;
+}
 UrlFilter::HotSpot::UrlType UrlFilter::HotSpot::urlType() const
 {
-    QString url = capturedTexts().first();
-    
-    if ( FullUrlRegExp.exactMatch(url) )
-        return StandardUrl;
-    else if ( EmailAddressRegExp.exactMatch(url) )
-        return Email;
-    else
-        return Unknown;
+    return _urlType;
 }
 
 void UrlFilter::HotSpot::activate(QObject* object)
@@ -493,26 +606,56 @@ void UrlFilter::HotSpot::activate(QObject* object)
     }
 }
 
-// Note:  Altering these regular expressions can have a major effect on the performance of the filters 
-// used for finding URLs in the text, especially if they are very general and could match very long
-// pieces of text.
-// Please be careful when altering them.
+UrlFilter::UrlFilter()
+{
+}
+bool UrlFilter::addPattern(const QString& pattern)
+{
+    if ( _scanner.addPattern(pattern) == -1 )
+        return false;
+
+    invalidate();
+    return true;
+}
+void UrlFilter::clearPatterns()
+{
+    _scanner.clearPatterns();
+    invalidate();
+}
+void UrlFilter::process()
+{
+    const QString* text = buffer();
+
+    Q_ASSERT( text );
 
-//regexp matches:
-// full url:  
-// protocolname:// or www. followed by anything other than whitespaces, <, >, ' or ", and ends before whitespaces, <, >, ', ", ], !, comma and dot
-const QRegExp UrlFilter::FullUrlRegExp("(www\\.(?!\\.)|[a-z][a-z0-9+.-]*://)[^\\s<>'\"]+[^!,\\.\\s<>'\"\\]]");
-// email address:
-// [word chars, dots or dashes]@[word chars, dots or dashes].[word chars]
-const QRegExp UrlFilter::EmailAddressRegExp("\\b(\\w|\\.|-)+@(\\w|\\.|-)+\\.\\w+\\b");
+    QVector<HotSpotScanner::Match> matches;
+    _scanner.scan(text->constData(),text->length(),matches);
 
-// matches full url or email address
-const QRegExp UrlFilter::CompleteUrlRegExp('('+FullUrlRegExp.pattern()+'|'+
-                                            EmailAddressRegExp.pattern()+')');
+    for ( int i = 0 ; i < matches.count() ; i++ )
+    {
+        const HotSpotScanner::Match& match = matches[i];
 
-UrlFilter::UrlFilter()
-{
-    setRegExp( CompleteUrlRegExp );
+        int startLine = 0;
+        int endLine = 0;
+        int startColumn = 0;
+        int endColumn = 0;
+
+        getLineColumn(match.start,startLine,startColumn);
+        getLineColumn(match.start + match.length,endLine,endColumn);
+
+        UrlFilter::HotSpot* spot = static_cast<UrlFilter::HotSpot*>(newHotSpot(startLine,startColumn,
+                                                                                endLine,endColumn));
+        spot->setCapturedTexts(QStringList() << text->mid(match.start,match.length));
+
+        if ( match.kind == HotSpotScanner::Url )
+            spot->setUrlType(HotSpot::StandardUrl);
+        else if ( match.kind == HotSpotScanner::Email )
+            spot->setUrlType(HotSpot::Email);
+        else
+            spot->setUrlType(HotSpot::Pattern);
+
+        addHotSpot( spot );
+    }
 }
 UrlFilter::HotSpot::~HotSpot()
 {
@@ -528,10 +671,23 @@ QList<QAction*> UrlFilter::HotSpot::actions()
 
     const UrlType kind = urlType();
 
-    QAction* openAction = new QAction(_urlObject);
     QAction* copyAction = new QAction(_urlObject);;
 
-    Q_ASSERT( kind == StandardUrl || kind == Email );
+    Q_ASSERT( kind == StandardUrl || kind == Email || kind == Pattern );
+
+    // there is nothing to open for text matching a pattern, it can only be copied
+    if ( kind == Pattern )
+    {
+        copyAction->setText(("Copy Text"));
+        copyAction->setObjectName("copy-action");
+
+        QObject::connect( copyAction , SIGNAL(triggered()) , _urlObject , SLOT(activated()) );
+
+        list << copyAction;
+        return list;
+    }
+
+    QAction* openAction = new QAction(_urlObject);
 
     if ( kind == StandardUrl )
     {
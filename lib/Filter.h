@@ -29,9 +29,11 @@
 #include <QtCore/QStringList>
 #include <QtCore/QHash>
 #include <QtCore/QRegExp>
+#include <QtCore/QVector>
 
 // Local
 #include "Character.h"
+#include "HotSpotScanner.h"
 
 namespace Konsole
 {
@@ -130,6 +132,9 @@ public:
        void setType(Type type);
 
     private:
+       // moves the hotspot when the lines of text are moved, see Filter::moveHotSpots()
+       friend class Filter;
+
        int    _startLine;
        int    _startColumn;
        int    _endLine;
@@ -151,6 +156,26 @@ public:
      */
     void reset();
 
+    /**
+     * Moves the hotspots to other lines after the text has moved.  A hotspot which
+     * started on line @p line is moved to line @p newLines[line], and deleted if that
+     * is -1 or if the lines covered by the hotspot did not move together.
+     */
+    void moveHotSpots(const QVector<int>& newLines);
+
+    /**
+     * Marks the hotspots found by the filter as out of date, for example because
+     * the pattern it searches for has changed.  A TerminalImageFilterChain
+     * then lets the filter process the whole image again the next time the image
+     * is set, rather than only the lines which have changed.
+     */
+    void invalidate();
+    /** 
+     * Returns true if invalidate() or reset() has been called since the last call 
+     * to setBuffer()
+     */
+    bool isInvalidated() const;
+
     /** Adds a new line of text to the filter and increments the line count */
     //void addLine(const QString& string);
 
@@ -182,6 +207,7 @@ private:
     
     const QList<int>* _linePositions;
     const QString* _buffer;
+    bool _invalidated;
 };
 
 /** 
@@ -247,7 +273,13 @@ private:
 
 class FilterObject;
 
-/** A filter which matches URLs in blocks of text */
+/**
+ * A filter which matches URLs and e-mail addresses in blocks of text, and text matching
+ * the patterns added with addPattern().
+ *
+ * The text is searched with a HotSpotScanner, which takes time proportional to the
+ * length of the text, rather than with the filter's regular expression.
+ */
 class UrlFilter : public RegExpFilter 
 {
 public:
@@ -258,6 +290,15 @@ public:
     class HotSpot : public RegExpFilter::HotSpot 
     {
     public:
+        enum UrlType
+        {
+            StandardUrl,
+            Email,
+            /** Text matching one of the patterns added with UrlFilter::addPattern() */
+            Pattern,
+            Unknown
+        };
+
         HotSpot(int startLine,int startColumn,int endLine,int endColumn);
         virtual ~HotSpot();
 
@@ -270,30 +311,37 @@ public:
         virtual void activate(QObject* object = 0);
 
         virtual QString tooltip() const;
-    private:
-        enum UrlType
-        {
-            StandardUrl,
-            Email,
-            Unknown
-        };
-        UrlType urlType() const;
 
+        /** Sets the kind of text which the hotspot covers */
+        void setUrlType(UrlType type);
+        /** Returns the kind of text which the hotspot covers */
+        UrlType urlType() const;
+    private:
         FilterObject* _urlObject;
+        UrlType _urlType;
     };
 
     UrlFilter();
 
+    /**
+     * Adds a pattern, such as "[\\w./-]+:\\d+" for file:line references, to the
+     * patterns which the filter looks for in addition to URLs and e-mail addresses.
+     * See HotSpotScanner::addPattern() for the syntax of patterns.
+     *
+     * Returns false if @p pattern is not valid or matches an empty string.
+     */
+    bool addPattern(const QString& pattern);
+    /** Removes all the patterns added with addPattern() */
+    void clearPatterns();
+
+    /** Reimplemented to search the filter's text buffer with a HotSpotScanner */
+    virtual void process();
+
 protected:
     virtual RegExpFilter::HotSpot* newHotSpot(int,int,int,int);
 
 private:
-    
-    static const QRegExp FullUrlRegExp;
-    static const QRegExp EmailAddressRegExp;
-
-    // combined OR of FullUrlRegExp and EmailAddressRegExp
-    static const QRegExp CompleteUrlRegExp; 
+    HotSpotScanner _scanner;
 };
 
 class FilterObject : public QObject
@@ -367,6 +415,12 @@ public:
     /**
      * Set the current terminal image to @p image.
      *
+     * Only the text of the lines which have changed since the previous image is given 
+     * to the filters to process.  Hotspots on lines which are unchanged, or which have
+     * only moved because the image has scrolled, are kept and moved along with their
+     * lines.  Lines which are wrapped are joined with the next line, so that hotspots
+     * can run on from one line to the next.
+     *
      * @param image The terminal image
      * @param lines The number of lines in the terminal image
      * @param columns The number of columns in the terminal image
@@ -375,8 +429,34 @@ public:
 				  const QVector<LineProperty>& lineProperties);  
 
 private:
-    QString* _buffer;
-    QList<int>* _linePositions;
+    // a line of the image together with the lines it is wrapped onto
+    struct Paragraph
+    {
+        int firstLine;
+        int lineCount;
+        uint hash;      // of the text of the lines
+    };
+
+    // appends the text of the paragraphs to 'buffer', and the position of each
+    // line to 'linePositions'.  if 'changed' is not null, only the text of the 
+    // paragraphs for which it is true is appended, and the lines of other paragraphs 
+    // are left empty
+    void decodeParagraphs(const Character* image, int columns,
+                          const QVector<LineProperty>& lineProperties,
+                          const QVector<bool>* changed,
+                          QString& buffer, QList<int>& linePositions) const;
+
+    // text of the changed lines of the image
+    QString _buffer;
+    QList<int> _linePositions;
+    // text of the whole image, for filters which have been invalidated
+    QString _fullBuffer;
+    QList<int> _fullLinePositions;
+
+    // the text of each cell and the paragraphs of the previous image
+    int _columns;
+    QVector<quint64> _cellText;
+    QVector<Paragraph> _paragraphs;
 };
 
 }
@@ -0,0 +1,122 @@
+/*
+    Copyright (C) 2026 by agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "GlyphCache.h"
+
+// Qt
+#include <QtGui/QFontMetrics>
+#include <QtGui/QPainter>
+
+using namespace Konsole;
+
+GlyphCache::GlyphCache(int maxGlyphs)
+    : _glyphs(maxGlyphs)
+    , _cellWidth(0)
+    , _cellHeight(0)
+{
+}
+
+void GlyphCache::setFont(const QFont& font, int cellWidth, int cellHeight)
+{
+    _font = font;
+    _cellWidth = cellWidth;
+    _cellHeight = cellHeight;
+    clear();
+}
+
+void GlyphCache::clear()
+{
+    _glyphs.clear();
+}
+
+const QPixmap* GlyphCache::glyph(ushort character, bool bold, bool underline, const QColor& color,
+                                 const QColor& background)
+{
+    const GlyphKey key((quint64)character |
+                       (bold ? 0x10000 : 0) |
+                       (underline ? 0x20000 : 0) |
+                       ((quint64)color.rgba() << 32),
+                       background.rgb());
+
+    const QPixmap* cached = _glyphs.object(key);
+    if (cached)
+        return cached;
+
+    QFont font = _font;
+    font.setBold(bold);
+    font.setUnderline(underline);
+
+    // characters which are not exactly one cell wide or which extend beyond
+    // their cell are left to QPainter::drawText(), otherwise they would be
+    // spaced or clipped differently from the rest of the text.
+    // the null pixmap stored for them avoids repeating these checks
+    const QChar ch(character);
+    QFontMetrics metrics(font);
+    const QRect bounds = metrics.boundingRect(ch);
+
+    QPixmap* pixmap = new QPixmap();
+    if ( ch.isPrint() && ch.category() != QChar::Mark_NonSpacing &&
+         metrics.width(ch) == _cellWidth &&
+         bounds.left() >= 0 && bounds.right() < _cellWidth &&
+         bounds.top() >= -metrics.ascent() && bounds.bottom() < _cellHeight - metrics.ascent() )
+    {
+        *pixmap = QPixmap(_cellWidth,_cellHeight);
+        pixmap->fill(background);
+
+        QPainter painter(pixmap);
+        painter.setFont(font);
+        painter.setPen(color);
+        painter.drawText(QRect(0,0,_cellWidth,_cellHeight),0,QString(ch));
+    }
+
+    _glyphs.insert(key,pixmap);
+    return pixmap;
+}
+
+bool GlyphCache::drawText(QPainter& painter, const QPointF& topLeft, const QString& text,
+                          bool bold, bool underline, const QColor& color,
+                          const QColor& background)
+{
+    Q_ASSERT( background.alpha() == 0xff );
+
+    if ( _cellWidth <= 0 || _cellHeight <= 0 )
+        return false;
+
+    const int length = text.length();
+    for (int i = 0; i < length; i++)
+    {
+        if ( glyph(text[i].unicode(),bold,underline,color,background)->isNull() )
+            return false;
+    }
+
+    for (int i = 0; i < length; i++)
+    {
+        const ushort character = text[i].unicode();
+
+        // blank cells have nothing to draw unless they are underlined
+        if ( character == ' ' && !underline )
+            continue;
+
+        painter.drawPixmap(QPointF(topLeft.x() + i*_cellWidth,topLeft.y()),
+                           *glyph(character,bold,underline,color,background));
+    }
+
+    return true;
+}
@@ -0,0 +1,99 @@
+/*
+    Copyright (C) 2026 by agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef GLYPHCACHE_H
+#define GLYPHCACHE_H
+
+// Qt
+#include <QtCore/QCache>
+#include <QtCore/QPair>
+#include <QtGui/QColor>
+#include <QtGui/QFont>
+#include <QtGui/QPixmap>
+
+class QPainter;
+class QPointF;
+class QString;
+
+namespace Konsole
+{
+
+/**
+ * Caches pre-rendered images of single characters so that text in a
+ * mono-spaced font can be drawn by copying one image per character instead
+ * of laying out and rasterising the text on every repaint.
+ *
+ * Glyphs are cached per character, weight, underline, colour and background
+ * colour, each one the size of a single character cell of the font set with
+ * setFont().  The glyphs are rendered onto their opaque background rather
+ * than onto a transparent pixmap, which keeps subpixel anti-aliasing, so they
+ * can only be used where the background of the cell is a single known colour.
+ * Characters whose glyph does not fit into a single cell are not cached,
+ * drawText() returns false for them and the caller should fall back to
+ * QPainter::drawText().
+ */
+class GlyphCache
+{
+public:
+    /**
+     * Constructs a new glyph cache which holds up to @p maxGlyphs
+     * pre-rendered characters.
+     */
+    explicit GlyphCache(int maxGlyphs = 2048);
+
+    /**
+     * Sets the font used to render the glyphs and the size of a character
+     * cell.  This clears the cache.
+     */
+    void setFont(const QFont& font, int cellWidth, int cellHeight);
+
+    /** Discards all cached glyphs. */
+    void clear();
+
+    /**
+     * Draws @p text with one character per cell, starting at @p topLeft.
+     * The cells are filled with the opaque color @p background.
+     *
+     * Returns false without drawing anything if any of the characters in
+     * @p text cannot be drawn from the cache, in which case the text should
+     * be drawn using QPainter::drawText() instead.
+     */
+    bool drawText(QPainter& painter, const QPointF& topLeft, const QString& text,
+                  bool bold, bool underline, const QColor& color,
+                  const QColor& background);
+
+private:
+    // the character, weight, underline and color of a glyph, and the
+    // color of its background
+    typedef QPair<quint64,QRgb> GlyphKey;
+
+    // returns the cached image of a character, rendering it if necessary.
+    // the returned pixmap is null if the character cannot be cached
+    const QPixmap* glyph(ushort character, bool bold, bool underline, const QColor& color,
+                         const QColor& background);
+
+    QCache<GlyphKey,QPixmap> _glyphs;
+    QFont _font;
+    int _cellWidth;
+    int _cellHeight;
+};
+
+}
+
+#endif // GLYPHCACHE_H
@@ -32,6 +32,7 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 
 
 // Reasonable line size
@@ -86,7 +87,7 @@ FIXME: There is noticeable decrease in speed, also. Perhaps,
 HistoryFile::HistoryFile()
   : ion(-1),
     length(0),
-	fileMap(0)
+	readCacheStart(0)
 {
   if (tmpFile.open())
   { 
@@ -97,48 +98,10 @@ HistoryFile::HistoryFile()
 
 HistoryFile::~HistoryFile()
 {
-	if (fileMap)
-		unmap();
-}
-
-//TODO:  Mapping the entire file in will cause problems if the history file becomes exceedingly large,
-//(ie. larger than available memory).  HistoryFile::map() should only map in sections of the file at a time,
-//to avoid this.
-void HistoryFile::map()
-{
-	assert( fileMap == 0 );
-
-	fileMap = (char*)mmap( 0 , length , PROT_READ , MAP_PRIVATE , ion , 0 );
-
-    //if mmap'ing fails, fall back to the read-lseek combination
-    if ( fileMap == MAP_FAILED )
-    {
-            readWriteBalance = 0; 
-            fileMap = 0;
-            qDebug() << ": mmap'ing history failed.  errno = " << errno;
-    }
-}
-
-void HistoryFile::unmap()
-{
-	int result = munmap( fileMap , length );
-	assert( result == 0 );
-
-	fileMap = 0;
-}
-
-bool HistoryFile::isMapped()
-{
-	return (fileMap != 0);
 }
 
 void HistoryFile::add(const unsigned char* bytes, int len)
 {
-  if ( fileMap )
-		  unmap();
-		
-  readWriteBalance++;
-
   int rc = 0;
 
   rc = lseek(ion,length,SEEK_SET); if (rc < 0) { perror("HistoryFile::add.seek"); return; }
@@ -148,28 +111,45 @@ void HistoryFile::add(const unsigned char* bytes, int len)
 
 void HistoryFile::get(unsigned char* bytes, int len, int loc)
 {
-  //count number of get() calls vs. number of add() calls.  
-  //If there are many more get() calls compared with add() 
-  //calls (decided by using MAP_THRESHOLD) then mmap the log
-  //file to improve performance.
-  readWriteBalance--;
-  if ( !fileMap && readWriteBalance < MAP_THRESHOLD )
-		  map();
-
-  if ( fileMap )
+  if (loc < 0 || len < 0 || loc + len > length)
   {
-	for (int i=0;i<len;i++)
-			bytes[i]=fileMap[loc+i];
+    fprintf(stderr,"getHist(...,%d,%d): invalid args.\n",len,loc);
+    return;
   }
-  else
-  {	
-  	int rc = 0;
 
-  	if (loc < 0 || len < 0 || loc + len > length)
-    	fprintf(stderr,"getHist(...,%d,%d): invalid args.\n",len,loc);
-  	rc = lseek(ion,loc,SEEK_SET); if (rc < 0) { perror("HistoryFile::get.seek"); return; }
-  	rc = read(ion,bytes,len);     if (rc < 0) { perror("HistoryFile::get.read"); return; }
+  if ( loc < readCacheStart || loc + len > readCacheStart + readCache.size() )
+  {
+    // requests which are too large for the cache are read directly
+    if ( len > READ_CACHE_SIZE / 2 )
+    {
+      if (pread(ion,bytes,len,loc) < 0)
+        perror("HistoryFile::get.read");
+      return;
+    }
+
+    // history is mostly read from top to bottom when a screenful of lines
+    // is displayed, but also upwards while scrolling back, so cache some
+    // data before the requested position as well
+    readCacheStart = qMax(0,loc - READ_CACHE_SIZE / 4);
+    readCache.resize(qMin((int)READ_CACHE_SIZE,length - readCacheStart));
+
+    int rc = pread(ion,readCache.data(),readCache.size(),readCacheStart);
+    if (rc < 0)
+    {
+      perror("HistoryFile::get.read");
+      readCache.clear();
+      return;
+    }
+    readCache.resize(rc);
+
+    if ( loc + len > readCacheStart + rc ) 
+    {
+      fprintf(stderr,"getHist(...,%d,%d): short read.\n",len,loc);
+      return;
+    }
   }
+
+  memcpy(bytes, readCache.constData() + (loc - readCacheStart), len);
 }
 
 int HistoryFile::len()
@@ -200,12 +180,12 @@ bool HistoryScroll::hasScroll()
 
 /* 
    The history scroll makes a Row(Row(Cell)) from
-   two history buffers. The index buffer contains
-   start of line positions which refere to the cells
-   buffer.
+   a history buffer holding the cells of all lines
+   one after another and an in-memory index of the
+   position in that buffer at which each line ends.
 
-   Note that index[0] addresses the second line
-   (line #1), while the first line (line #0) starts
+   Note that m_lineEnds[0] is the start of the second
+   line (line #1), while the first line (line #0) starts
    at 0 in cells.
 */
 
@@ -221,7 +201,7 @@ HistoryScrollFile::~HistoryScrollFile()
  
 int HistoryScrollFile::getLines()
 {
-  return index.len() / sizeof(int);
+  return m_lineEnds.count();
 }
 
 int HistoryScrollFile::getLineLen(int lineno)
@@ -231,11 +211,9 @@ int HistoryScrollFile::getLineLen(int lineno)
 
 bool HistoryScrollFile::isWrappedLine(int lineno)
 {
-  if (lineno>=0 && lineno <= getLines()) {
-    unsigned char flag;
-    lineflags.get((unsigned char*)&flag,sizeof(unsigned char),(lineno)*sizeof(unsigned char));
-    return flag;
-  }
+  if (lineno>=0 && lineno < getLines())
+    return m_wrappedLines.testBit(lineno);
+
   return false;
 }
 
@@ -243,15 +221,8 @@ int HistoryScrollFile::startOfLine(int lineno)
 {
   if (lineno <= 0) return 0;
   if (lineno <= getLines())
-    { 
-	
-	if (!index.isMapped())
-			index.map();
-	
-	int res;
-    index.get((unsigned char*)&res,sizeof(int),(lineno-1)*sizeof(int));
-    return res;
-    }
+    return m_lineEnds[lineno-1];
+
   return cells.len();
 }
 
@@ -267,13 +238,441 @@ void HistoryScrollFile::addCells(const Character text[], int count)
 
 void HistoryScrollFile::addLine(bool previousWrapped)
 {
-  if (index.isMapped())
-		  index.unmap();
+  const int line = m_lineEnds.count();
+
+  m_lineEnds.append(cells.len());
+  m_wrappedLines.resize(line + 1);
+  m_wrappedLines.setBit(line,previousWrapped);
+}
+
+
+// History Scroll Persistent //////////////////////////////////////
+
+static const char PERSISTENT_HISTORY_MAGIC[8] = { 'K','O','N','S','H','I','S','T' };
+
+HistoryScrollPersistent::HistoryScrollPersistent(const QString& fileName)
+  : HistoryScroll(new HistoryTypePersistent(fileName)),
+    m_fileName(fileName),
+    m_cellsFile(-1),
+    m_indexFile(-1),
+    m_colorsFile(-1),
+    m_charsFile(-1),
+    m_cellCount(0),
+    m_cellsMap(0),
+    m_cellsMapSize(0),
+    m_mappedCells(0)
+{
+  open();
+}
+
+HistoryScrollPersistent::~HistoryScrollPersistent()
+{
+  close();
+}
+
+qint64 HistoryScrollPersistent::openFile(const QString& path, int* fd)
+{
+  *fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_CREAT, 0600);
+  if (*fd < 0)
+  {
+    perror("HistoryScrollPersistent::open");
+    return -1;
+  }
+
+  FileHeader header;
+  memset(&header, 0, sizeof(FileHeader));
+
+  const qint64 size = lseek(*fd, 0, SEEK_END);
+  if (size >= (qint64)sizeof(FileHeader) &&
+      pread(*fd, &header, sizeof(FileHeader), 0) == (int)sizeof(FileHeader) &&
+      memcmp(header.magic, PERSISTENT_HISTORY_MAGIC, sizeof(header.magic)) == 0 &&
+      header.version == FORMAT_VERSION &&
+      header.cellSize == sizeof(Character))
+  {
+    return size - sizeof(FileHeader);
+  }
+
+  // a new file or one which was written in a different format
+  if (size > 0)
+    qDebug() << "Discarding incompatible history file" << path;
+
+  memcpy(header.magic, PERSISTENT_HISTORY_MAGIC, sizeof(header.magic));
+  header.version = FORMAT_VERSION;
+  header.cellSize = sizeof(Character);
+
+  if (ftruncate(*fd, 0) < 0 ||
+      pwrite(*fd, &header, sizeof(FileHeader), 0) != (int)sizeof(FileHeader))
+  {
+    perror("HistoryScrollPersistent::open");
+    ::close(*fd);
+    *fd = -1;
+    return -1;
+  }
+  return 0;
+}
+
+void HistoryScrollPersistent::open()
+{
+  const qint64 cellBytes = openFile(m_fileName, &m_cellsFile);
+  const qint64 indexBytes = openFile(m_fileName + ".index", &m_indexFile);
+  const qint64 colorBytes = openFile(m_fileName + ".colors", &m_colorsFile);
+  const qint64 charBytes = openFile(m_fileName + ".chars", &m_charsFile);
+
+  if (cellBytes < 0 || indexBytes < 0 || colorBytes < 0 || charBytes < 0)
+  {
+    close();
+    return;
+  }
+
+  // add the colors used by the history to the color table.  a partially 
+  // written color is dropped, it cannot be referred to by any of the cells
+  QVector<quint32> colors(colorBytes / sizeof(quint32));
+  if (!colors.isEmpty() &&
+      pread(m_colorsFile, colors.data(), colors.count() * sizeof(quint32), sizeof(FileHeader)) < 0)
+  {
+    perror("HistoryScrollPersistent::open");
+    colors.clear();
+  }
+  if (ftruncate(m_colorsFile, sizeof(FileHeader) + colors.count() * sizeof(quint32)) < 0)
+    perror("HistoryScrollPersistent::open");
+  lseek(m_colorsFile, 0, SEEK_END);
+
+  m_fileColors.resize(colors.count());
+  for (int i = 0; i < colors.count(); i++)
+  {
+    m_fileColors[i] = colors[i];
+    m_fileColorPositions.insert(colors[i],i);
+  }
+
+  // the extended characters are only added to the character table when
+  // they are read, see fromFileChar()
+  m_fileChars.resize(charBytes / sizeof(FileChar));
+  if (!m_fileChars.isEmpty() &&
+      pread(m_charsFile, m_fileChars.data(), m_fileChars.count() * sizeof(FileChar), sizeof(FileHeader)) < 0)
+  {
+    perror("HistoryScrollPersistent::open");
+    m_fileChars.clear();
+  }
+  if (ftruncate(m_charsFile, sizeof(FileHeader) + m_fileChars.count() * sizeof(FileChar)) < 0)
+    perror("HistoryScrollPersistent::open");
+  lseek(m_charsFile, 0, SEEK_END);
+  m_fileCharKeys.fill(0,m_fileChars.count());
+
+  qint64 cellCount = cellBytes / sizeof(Character);
+
+  // read the index in one go.  entries which were only partially written,
+  // or which refer to cells which never made it to disk, are dropped
+  m_index.resize(indexBytes / sizeof(quint64));
+  if (!m_index.isEmpty() &&
+      pread(m_indexFile, m_index.data(), m_index.count() * sizeof(quint64), sizeof(FileHeader)) < 0)
+  {
+    perror("HistoryScrollPersistent::open");
+    m_index.clear();
+  }
+
+  int lines = m_index.count();
+  while (lines > 0 && (qint64)(m_index[lines-1] & ~WRAPPED_LINE) > cellCount)
+    lines--;
+  m_index.resize(lines);
+
+  // cells following the end of the last line belong to a line which
+  // was never completed
+  m_cellCount = lines > 0 ? (qint64)(m_index[lines-1] & ~WRAPPED_LINE) : 0;
+
+  if (ftruncate(m_cellsFile, sizeof(FileHeader) + m_cellCount * sizeof(Character)) < 0 ||
+      ftruncate(m_indexFile, sizeof(FileHeader) + lines * sizeof(quint64)) < 0)
+    perror("HistoryScrollPersistent::open");
+
+  lseek(m_cellsFile, 0, SEEK_END);
+  lseek(m_indexFile, 0, SEEK_END);
+
+  if (m_cellCount > 0)
+  {
+    m_cellsMapSize = sizeof(FileHeader) + m_cellCount * sizeof(Character);
+    m_cellsMap = (char*)mmap(0, m_cellsMapSize, PROT_READ, MAP_SHARED, m_cellsFile, 0);
+
+    //if mmap'ing fails, fall back to reading the file
+    if (m_cellsMap == MAP_FAILED)
+    {
+      qDebug() << ": mmap'ing history failed.  errno = " << errno;
+      m_cellsMap = 0;
+      m_cellsMapSize = 0;
+    }
+    else
+    {
+      m_mappedCells = m_cellCount;
+    }
+  }
+}
+
+void HistoryScrollPersistent::close()
+{
+  if (m_cellsMap)
+    munmap(m_cellsMap, m_cellsMapSize);
+  m_cellsMap = 0;
+  m_cellsMapSize = 0;
+  m_mappedCells = 0;
+
+  if (m_cellsFile >= 0)
+    ::close(m_cellsFile);
+  if (m_indexFile >= 0)
+    ::close(m_indexFile);
+  if (m_colorsFile >= 0)
+    ::close(m_colorsFile);
+  if (m_charsFile >= 0)
+    ::close(m_charsFile);
+  m_cellsFile = -1;
+  m_indexFile = -1;
+  m_colorsFile = -1;
+  m_charsFile = -1;
+}
+
+int HistoryScrollPersistent::getLines()
+{
+  return m_index.count();
+}
+
+qint64 HistoryScrollPersistent::startOfLine(int lineno) const
+{
+  if (lineno <= 0) return 0;
+  if (lineno <= m_index.count())
+    return m_index[lineno-1] & ~WRAPPED_LINE;
+
+  return m_cellCount;
+}
+
+int HistoryScrollPersistent::getLineLen(int lineno)
+{
+  if (lineno < 0 || lineno >= m_index.count())
+    return 0;
+
+  return startOfLine(lineno+1) - startOfLine(lineno);
+}
+
+bool HistoryScrollPersistent::isWrappedLine(int lineno)
+{
+  if (lineno < 0 || lineno >= m_index.count())
+    return false;
+
+  return m_index[lineno] & WRAPPED_LINE;
+}
+
+void HistoryScrollPersistent::getCells(int lineno, int colno, int count, Character res[])
+{
+  if (count == 0) return;
+
+  const qint64 start = startOfLine(lineno) + colno;
+
+  if (start + count <= m_mappedCells)
+  {
+    memcpy(res, m_cellsMap + sizeof(FileHeader) + start * sizeof(Character), count * sizeof(Character));
+  }
+  else if (m_cellsFile < 0 ||
+           pread(m_cellsFile, res, count * sizeof(Character), 
+                 sizeof(FileHeader) + start * sizeof(Character)) < 0)
+  {
+    perror("HistoryScrollPersistent::getCells");
+    for (int i = 0; i < count; i++)
+      res[i] = Character();
+    return;
+  }
+
+  if (!m_fileColors.isEmpty())
+  {
+    FromFileColor fromFile = { this };
+    for (int i = 0; i < count; i++)
+      res[i].remapTrueColors(fromFile);
+  }
+
+  if (!m_fileChars.isEmpty())
+  {
+    for (int i = 0; i < count; i++)
+    {
+      if (res[i].rendition & RE_EXTENDED_CHAR)
+        fromFileChar(res[i]);
+    }
+  }
+}
+
+quint16 HistoryScrollPersistent::toFileColor(quint16 index)
+{
+  const QRgb rgb = TrueColorTable::instance.color(index);
+  QHash<QRgb,quint16>::const_iterator iter = m_fileColorPositions.constFind(rgb);
+  if (iter != m_fileColorPositions.constEnd())
+    return iter.value();
+
+  // the colors file is full, use its first color instead
+  if (m_fileColors.count() > 0x7FFF)
+    return 0;
+
+  // the color is written before the cells which use it, so the cells 
+  // on disk never refer to a color which is not in the colors file
+  if (m_colorsFile < 0 ||
+      write(m_colorsFile, &rgb, sizeof(quint32)) != (int)sizeof(quint32))
+  {
+    perror("HistoryScrollPersistent::add.write");
+    return 0;
+  }
+
+  const quint16 position = m_fileColors.count();
+  m_fileColors.append(rgb);
+  m_fileColorPositions.insert(rgb,position);
+  return position;
+}
+
+quint16 HistoryScrollPersistent::fromFileColor(quint16 position) const
+{
+  if (position >= m_fileColors.count())
+    return 0;
+
+  // if the color table is full, the color is replaced by the first color in it
+  return qMax(TrueColorTable::instance.indexOf(m_fileColors[position]),0);
+}
+
+static bool isSameSequence(const quint32* a, ushort aLength, const uint* b, ushort bLength)
+{
+  return aLength == bLength && memcmp(a, b, aLength * sizeof(uint)) == 0;
+}
+
+void HistoryScrollPersistent::toFileChar(Character& cell)
+{
+  ushort length = 0;
+  const uint* points = ExtendedCharTable::instance.lookupExtendedChar(cell.character,length);
+
+  // keys of discarded sequences may be reused, so check that the sequence
+  // written for the key is still the same
+  QHash<quint32,quint32>::const_iterator iter = m_fileCharPositions.constFind(cell.character);
+  if (points && iter != m_fileCharPositions.constEnd())
+  {
+    const FileChar& fileChar = m_fileChars[iter.value()];
+    if (isSameSequence(fileChar.points, fileChar.length, points, length))
+    {
+      cell.character = iter.value();
+      return;
+    }
+  }
+
+  // the sequence is written before the cells which use it, so the cells
+  // on disk never refer to a sequence which is not in the chars file
+  FileChar fileChar;
+  memset(&fileChar, 0, sizeof(FileChar));
+  fileChar.length = length;
+  if (points)
+    memcpy(fileChar.points, points, length * sizeof(uint));
+
+  if (points == 0 || m_fileChars.count() > MAX_FILE_CHARS || m_charsFile < 0 ||
+      write(m_charsFile, &fileChar, sizeof(FileChar)) != (int)sizeof(FileChar))
+  {
+    if (points)
+      perror("HistoryScrollPersistent::add.write");
+    cell.character = 0xFFFD;
+    cell.rendition &= ~RE_EXTENDED_CHAR;
+    return;
+  }
+
+  const quint32 position = m_fileChars.count();
+  m_fileChars.append(fileChar);
+  m_fileCharKeys.append(0);
+  m_fileCharPositions.insert(cell.character,position);
+  cell.character = position;
+}
+
+void HistoryScrollPersistent::fromFileChar(Character& cell)
+{
+  const quint32 position = cell.character;
+  quint32 key = 0;
+
+  if (position < (quint32)m_fileChars.count())
+  {
+    const FileChar& fileChar = m_fileChars[position];
+    key = m_fileCharKeys[position];
+
+    // add the sequence to the table again if it has been discarded
+    ushort length = 0;
+    const uint* points = key ? ExtendedCharTable::instance.lookupExtendedChar(key,length) : 0;
+    if (!points || !isSameSequence(fileChar.points, fileChar.length, points, length))
+    {
+      key = 0;
+      if (fileChar.length > 0 && fileChar.length <= (quint32)ExtendedCharTable::MAX_SEQUENCE_LENGTH)
+        key = ExtendedCharTable::instance.createExtendedChar(fileChar.points, fileChar.length);
+      m_fileCharKeys[position] = key;
+      if (key)
+        m_fileCharPositions.insert(key,position);
+    }
+  }
+
+  if (key)
+  {
+    cell.character = key;
+  }
+  else
+  {
+    cell.character = 0xFFFD;
+    cell.rendition &= ~RE_EXTENDED_CHAR;
+  }
+}
+
+void HistoryScrollPersistent::markExtendedChars(ExtendedCharTable& table)
+{
+  // the characters read since the last collection may still be shown by a 
+  // display.  they are forgotten afterwards, reading them again finds the 
+  // sequence in the table if it is still used
+  for (int i = 0; i < m_fileCharKeys.count(); i++)
+  {
+    if (m_fileCharKeys[i])
+    {
+      table.markUsed(m_fileCharKeys[i]);
+      m_fileCharKeys[i] = 0;
+    }
+  }
+}
+
+void HistoryScrollPersistent::addCells(const Character a[], int count)
+{
+  if (m_cellsFile < 0 || count == 0)
+    return;
+
+  // cells with RGB colors or extended characters are written with the 
+  // colors' and the characters' positions in the colors and chars files
+  QVarLengthArray<Character,256> remapped;
+  for (int i = 0; i < count; i++)
+  {
+    if (a[i].hasTrueColor() || (a[i].rendition & RE_EXTENDED_CHAR))
+    {
+      remapped.append(a, count);
+      ToFileColor toFile = { this };
+      for (int j = i; j < count; j++)
+      {
+        remapped[j].remapTrueColors(toFile);
+        if (remapped[j].rendition & RE_EXTENDED_CHAR)
+          toFileChar(remapped[j]);
+      }
+      a = remapped.constData();
+      break;
+    }
+  }
+
+  int rc = write(m_cellsFile, a, count * sizeof(Character));
+  if (rc < 0) { perror("HistoryScrollPersistent::add.write"); return; }
+
+  m_cellCount += rc / sizeof(Character);
+}
+
+void HistoryScrollPersistent::addLine(bool previousWrapped)
+{
+  if (m_indexFile < 0)
+    return;
+
+  // the cells of the line have already been written, so the index
+  // never refers to data which is not on disk
+  quint64 entry = m_cellCount;
+  if (previousWrapped)
+    entry |= WRAPPED_LINE;
+
+  int rc = write(m_indexFile, &entry, sizeof(quint64));
+  if (rc < 0) { perror("HistoryScrollPersistent::add.write"); return; }
 
-  int locn = cells.len();
-  index.add((unsigned char*)&locn,sizeof(int));
-  unsigned char flags = previousWrapped ? 0x01 : 0x00;
-  lineflags.add((unsigned char*)&flags,sizeof(unsigned char));
+  m_index.append(entry);
 }
 
 
@@ -455,34 +854,65 @@ void HistoryScrollNone::addLine(bool)
 {
 }
 
+// returns the number of default characters at the end of the 'count' cells
+// at 'cells'.
+//
+// these are not stored for lines which are not wrapped, since callers only
+// ask for getLineLen() cells and treat the rest of the line as blank.  they
+// are kept for wrapped lines, where they are spaces which are part of the
+// text continuing on the next line
+static int trailingBlanks(const Character* cells, int count)
+{
+  const Character defaultChar;
+  int blanks = 0;
+  while (blanks < count && cells[count-blanks-1] == defaultChar)
+    blanks++;
+  return blanks;
+}
+
 // History Scroll BlockArray //////////////////////////////////////
 
+// number of cells which fit into a single block
+static const int BLOCK_CELLS = ENTRIES / sizeof(Character);
+
 HistoryScrollBlockArray::HistoryScrollBlockArray(size_t size)
   : HistoryScroll(new HistoryTypeBlockArray(size))
+   ,m_currentBlock(0)
+   ,m_lines(new LineEntry[size])
+   ,m_maxLineCount(size)
+   ,m_usedLines(0)
+   ,m_firstLine(0)
+   ,m_lastLineBlanks(0)
 {
-  m_blockArray.setHistorySize(size); // nb. of lines.
+  // every line needs at most one block of its own, unless it is
+  // longer than a block
+  m_blockArray.setHistorySize(size); // nb. of blocks
 }
 
 HistoryScrollBlockArray::~HistoryScrollBlockArray()
 {
+  delete[] m_lines;
 }
 
 int  HistoryScrollBlockArray::getLines()
 {
-  return m_lineLengths.count();
+  return m_usedLines;
 }
 
 int  HistoryScrollBlockArray::getLineLen(int lineno)
 {
-    if ( m_lineLengths.contains(lineno) )
-        return m_lineLengths[lineno];
-    else
-        return 0;
+  if ( lineno >= 0 && lineno < m_usedLines )
+    return m_lines[lineIndex(lineno)].length;
+  else
+    return 0;
 }
 
-bool HistoryScrollBlockArray::isWrappedLine(int /*lineno*/)
+bool HistoryScrollBlockArray::isWrappedLine(int lineno)
 {
-  return false;
+  if ( lineno >= 0 && lineno < m_usedLines )
+    return m_lines[lineIndex(lineno)].wrapped;
+  else
+    return false;
 }
 
 void HistoryScrollBlockArray::getCells(int lineno, int colno,
@@ -490,61 +920,998 @@ void HistoryScrollBlockArray::getCells(int lineno, int colno,
 {
   if (!count) return;
 
-  const Block *b = m_blockArray.at(lineno);
+  assert( lineno >= 0 && lineno < m_usedLines );
 
-  if (!b) {
-    memset(res, 0, count * sizeof(Character)); // still better than random data
-    return;
-  }
+  const LineEntry& line = m_lines[lineIndex(lineno)];
+
+  assert( colno >= 0 && colno + count <= line.length );
+
+  size_t block = line.block + (line.offset + colno) / BLOCK_CELLS;
+  int position = (line.offset + colno) % BLOCK_CELLS;
+
+  while (count > 0)
+  {
+    const int n = qMin(count, BLOCK_CELLS - position);
 
-  assert(((colno + count) * sizeof(Character)) < ENTRIES);
-  memcpy(res, b->data + (colno * sizeof(Character)), count * sizeof(Character));
+    const Block *b = m_blockArray.at(block);
+    if (b)
+    {
+      memcpy(res, b->data + (position * sizeof(Character)), n * sizeof(Character));
+    }
+    else
+    {
+      for (int i = 0; i < n; i++)
+        res[i] = Character(); // still better than random data
+    }
+
+    res += n;
+    count -= n;
+    position = 0;
+    block++;
+  }
 }
 
 void HistoryScrollBlockArray::addCells(const Character a[], int count)
 {
   Block *b = m_blockArray.lastBlock();
   
-  if (!b) return;
+  m_lastLineBlanks = 0;
+
+  if (!b || m_maxLineCount == 0) return;
 
-  // put cells in block's data
-  assert((count * sizeof(Character)) < ENTRIES);
+  // whether the line is wrapped is only known when addLine() is called
+  const int blanks = trailingBlanks(a,count);
 
-  memset(b->data, 0, ENTRIES);
+  int used = b->size / sizeof(Character);
 
-  memcpy(b->data, a, count * sizeof(Character));
-  b->size = count * sizeof(Character);
+  // start lines which fit into a block in a fresh block instead of
+  // splitting them between two blocks
+  if (used > 0 && count <= BLOCK_CELLS && used + count > BLOCK_CELLS)
+  {
+    m_currentBlock = m_blockArray.newBlock();
+    b = m_blockArray.lastBlock();
+    used = 0;
 
-  size_t res = m_blockArray.newBlock();
-  assert (res > 0);
-  Q_UNUSED( res );
+    if (!b) return;
+  }
 
-  m_lineLengths.insert(m_blockArray.getCurrent(), count);
-}
+  if (m_usedLines == m_maxLineCount)
+  {
+    m_firstLine = (m_firstLine + 1) % m_maxLineCount;
+    m_usedLines--;
+  }
 
-void HistoryScrollBlockArray::addLine(bool)
-{
-}
+  LineEntry& line = m_lines[lineIndex(m_usedLines)];
+  line.block = m_currentBlock;
+  line.offset = used;
+  line.length = count;
+  line.wrapped = false;
+  m_usedLines++;
 
-//////////////////////////////////////////////////////////////////////
-// History Types
-//////////////////////////////////////////////////////////////////////
+  // put cells in the blocks' data
+  while (count > 0)
+  {
+    if (used == BLOCK_CELLS)
+    {
+      m_currentBlock = m_blockArray.newBlock();
+      b = m_blockArray.lastBlock();
+      used = 0;
 
-HistoryType::HistoryType()
-{
+      if (!b) return;
+    }
+
+    const int n = qMin(count, BLOCK_CELLS - used);
+    memcpy(b->data + (used * sizeof(Character)), a, n * sizeof(Character));
+    b->size += n * sizeof(Character);
+
+    a += n;
+    count -= n;
+    used += n;
+  }
+
+  // only the blanks in the block being filled can be given back
+  const int lastBlockCells = (m_currentBlock == line.block) ? used - line.offset : used;
+  m_lastLineBlanks = qMin(blanks,lastBlockCells);
+
+  // forget the oldest lines whose blocks have been reused
+  while (m_usedLines > 0 && !m_blockArray.has(m_lines[m_firstLine].block))
+  {
+    m_firstLine = (m_firstLine + 1) % m_maxLineCount;
+    m_usedLines--;
+  }
 }
 
-HistoryType::~HistoryType()
+void HistoryScrollBlockArray::addLine(bool previousWrapped)
 {
+  if (m_usedLines == 0)
+    return;
+
+  LineEntry& line = m_lines[lineIndex(m_usedLines - 1)];
+  line.wrapped = previousWrapped;
+
+  // the blanks are only dropped from lines which are not wrapped, see trailingBlanks()
+  Block *b = m_blockArray.lastBlock();
+  if (!previousWrapped && m_lastLineBlanks > 0 && b)
+  {
+    line.length -= m_lastLineBlanks;
+    b->size -= m_lastLineBlanks * sizeof(Character);
+  }
+  m_lastLineBlanks = 0;
 }
 
-//////////////////////////////
+// History Page Pool //////////////////////////////////////
 
-HistoryTypeNone::HistoryTypeNone()
+HistoryPagePool::HistoryPagePool()
+  : _sparePage(0)
 {
 }
 
-bool HistoryTypeNone::isEnabled() const
+HistoryPagePool::~HistoryPagePool()
+{
+  _pages.append(_sparePage);
+  foreach(Page* page , _pages)
+  {
+    if (page)
+      delete[] page->data;
+    delete page;
+  }
+}
+
+HistoryPagePool::Page* HistoryPagePool::takePage(int minimumSize)
+{
+  Page* page = 0;
+  if (_sparePage && _sparePage->capacity >= minimumSize)
+  {
+    page = _sparePage;
+    _sparePage = 0;
+  }
+  else
+  {
+    page = new Page;
+    page->capacity = qMax(minimumSize,(int)PAGE_SIZE);
+    page->data = new char[page->capacity];
+  }
+
+  page->used = 0;
+  page->allocations = 0;
+  return page;
+}
+
+void HistoryPagePool::releasePage(Page* page)
+{
+  // keep one regular page around so that a full history which keeps
+  // scrolling does not allocate a new page every PAGE_SIZE bytes
+  if (!_sparePage && page->capacity == PAGE_SIZE)
+  {
+    _sparePage = page;
+  }
+  else
+  {
+    delete[] page->data;
+    delete page;
+  }
+}
+
+// allocations are kept aligned for the structures stored in them
+static inline int alignedSize(int size)
+{
+  return (size + sizeof(quint32) - 1) & ~(int)(sizeof(quint32) - 1);
+}
+
+char* HistoryPagePool::allocate(int size)
+{
+  size = alignedSize(size);
+
+  Page* page = _pages.isEmpty() ? 0 : _pages.last();
+  if (!page || page->capacity - page->used < size)
+  {
+    page = takePage(size);
+    _pages.append(page);
+  }
+
+  char* data = page->data + page->used;
+  page->used += size;
+  page->allocations++;
+  return data;
+}
+
+void HistoryPagePool::shrinkLast(const char* data, int oldSize, int newSize)
+{
+  Q_ASSERT( newSize <= oldSize );
+
+  Page* page = _pages.isEmpty() ? 0 : _pages.last();
+  if (!page || data + alignedSize(oldSize) != page->data + page->used)
+    return;
+
+  page->used -= alignedSize(oldSize) - alignedSize(newSize);
+}
+
+void HistoryPagePool::releaseOldest()
+{
+  Q_ASSERT( !_pages.isEmpty() );
+
+  // allocations are released in the order they were made, so the
+  // oldest one always lives in the first page
+  Page* page = _pages.first();
+  if ( --page->allocations == 0 )
+  {
+    if ( _pages.count() == 1 )
+    {
+      page->used = 0;
+    }
+    else
+    {
+      _pages.removeFirst();
+      releasePage(page);
+    }
+  }
+}
+
+// History Scroll Paged //////////////////////////////////////
+
+HistoryScrollPaged::HistoryScrollPaged(unsigned int maxLineCount)
+  : HistoryScroll(new HistoryTypePaged(maxLineCount))
+   ,_lines(0)
+   ,_maxLineCount(0)
+   ,_usedLines(0)
+   ,_firstLine(0)
+{
+  setMaxNbLines(maxLineCount);
+}
+
+HistoryScrollPaged::~HistoryScrollPaged()
+{
+  delete[] _lines;
+}
+
+void HistoryScrollPaged::dropFirstLine()
+{
+  Q_ASSERT( _usedLines > 0 );
+
+  _pool.releaseOldest();
+
+  _firstLine = (_firstLine + 1) % _maxLineCount;
+  _usedLines--;
+}
+
+void HistoryScrollPaged::addCells(const Character a[], int count)
+{
+  if (_maxLineCount == 0)
+    return;
+
+  if (_usedLines == _maxLineCount)
+    dropFirstLine();
+
+  Character* cells = reinterpret_cast<Character*>(_pool.allocate(count * sizeof(Character)));
+  if (count > 0)
+    memcpy(cells, a, count * sizeof(Character));
+
+  LineEntry& entry = _lines[lineIndex(_usedLines)];
+  entry.cells = cells;
+  entry.length = count;
+  entry.wrapped = false;
+
+  _usedLines++;
+}
+
+void HistoryScrollPaged::addLine(bool previousWrapped)
+{
+  if (_usedLines == 0)
+    return;
+
+  LineEntry& entry = _lines[lineIndex(_usedLines - 1)];
+  entry.wrapped = previousWrapped;
+
+  if (!previousWrapped)
+  {
+    const int length = entry.length - trailingBlanks(entry.cells,entry.length);
+    _pool.shrinkLast(reinterpret_cast<const char*>(entry.cells),
+                     entry.length * sizeof(Character),length * sizeof(Character));
+    entry.length = length;
+  }
+}
+
+int HistoryScrollPaged::getLines()
+{
+  return _usedLines;
+}
+
+int HistoryScrollPaged::getLineLen(int lineNumber)
+{
+  Q_ASSERT( lineNumber >= 0 && lineNumber < _maxLineCount );
+
+  if (lineNumber < _usedLines)
+    return _lines[lineIndex(lineNumber)].length;
+  else
+    return 0;
+}
+
+bool HistoryScrollPaged::isWrappedLine(int lineNumber)
+{
+  Q_ASSERT( lineNumber >= 0 && lineNumber < _maxLineCount );
+
+  if (lineNumber < _usedLines)
+    return _lines[lineIndex(lineNumber)].wrapped;
+  else
+    return false;
+}
+
+void HistoryScrollPaged::getCells(int lineNumber, int startColumn, int count, Character* buffer)
+{
+  if ( count == 0 ) return;
+
+  Q_ASSERT( lineNumber < _maxLineCount );
+
+  if (lineNumber >= _usedLines)
+  {
+    for (int i = 0; i < count; i++)
+      buffer[i] = Character();
+    return;
+  }
+
+  const LineEntry& entry = _lines[lineIndex(lineNumber)];
+
+  Q_ASSERT( startColumn >= 0 && startColumn + count <= entry.length );
+
+  memcpy(buffer, entry.cells + startColumn, count * sizeof(Character));
+}
+
+void HistoryScrollPaged::setMaxNbLines(unsigned int lineCount)
+{
+  // drop the oldest lines which no longer fit
+  while (_usedLines > (int)lineCount)
+    dropFirstLine();
+
+  LineEntry* newLines = new LineEntry[lineCount];
+  for (int i = 0; i < _usedLines; i++)
+    newLines[i] = _lines[lineIndex(i)];
+
+  delete[] _lines;
+  _lines = newLines;
+  _maxLineCount = lineCount;
+  _firstLine = 0;
+
+  delete m_histType;
+  m_histType = new HistoryTypePaged(lineCount);
+}
+
+// History Scroll Compact //////////////////////////////////////
+
+HistoryScrollCompact::HistoryScrollCompact(unsigned int maxLineCount)
+  : HistoryScroll(new HistoryTypeCompact(maxLineCount))
+   ,_lines(0)
+   ,_maxLineCount(0)
+   ,_usedLines(0)
+   ,_firstLine(0)
+{
+  setMaxNbLines(maxLineCount);
+}
+
+HistoryScrollCompact::~HistoryScrollCompact()
+{
+  delete[] _lines;
+}
+
+void HistoryScrollCompact::dropFirstLine()
+{
+  Q_ASSERT( _usedLines > 0 );
+
+  _pool.releaseOldest();
+
+  _firstLine = (_firstLine + 1) % _maxLineCount;
+  _usedLines--;
+}
+
+static inline bool hasSameFormat(const Character& a, const Character& b)
+{
+  return a.rendition == b.rendition && a.hasSameColors(b);
+}
+
+void HistoryScrollCompact::FormatRun::setFormat(const Character& cell)
+{
+  foreground = cell.foregroundColor().pack();
+  background = cell.backgroundColor().pack();
+  rendition = cell.rendition;
+}
+
+Character HistoryScrollCompact::FormatRun::format() const
+{
+  return Character(' ',CharacterColor::unpack(foreground),
+                   CharacterColor::unpack(background),rendition);
+}
+
+template <typename T>
+static void storeText(char* data, const Character* cells, int count)
+{
+  T* text = reinterpret_cast<T*>(data);
+  for (int i = 0; i < count; i++)
+    text[i] = cells[i].character;
+}
+
+void HistoryScrollCompact::addCells(const Character a[], int count)
+{
+  if (_maxLineCount == 0)
+    return;
+
+  count = qMin(count,(int)MAX_LINE_LENGTH);
+
+  if (_usedLines == _maxLineCount)
+    dropFirstLine();
+
+  // count the format runs and find the size of the largest character value
+  // first, so that the line can be stored in a single allocation
+  int formatCount = 0;
+  quint32 maxCharacter = 0;
+  for (int i = 0; i < count; i++)
+  {
+    if (i == 0 || !hasSameFormat(a[i],a[i-1]))
+      formatCount++;
+    maxCharacter = qMax(maxCharacter,(quint32)a[i].character);
+  }
+
+  int width = 4;
+  if (maxCharacter <= 0xFF)
+    width = 1;
+  else if (maxCharacter <= 0xFFFF)
+    width = 2;
+
+  char* data = _pool.allocate(textSize(count,width) + formatCount * sizeof(FormatRun));
+
+  switch (width)
+  {
+    case 1: storeText<quint8>(data,a,count); break;
+    case 2: storeText<quint16>(data,a,count); break;
+    default: storeText<quint32>(data,a,count); break;
+  }
+
+  FormatRun* run = reinterpret_cast<FormatRun*>(data + textSize(count,width)) - 1;
+  for (int i = 0; i < count; i++)
+  {
+    if (i == 0 || !hasSameFormat(a[i],a[i-1]))
+    {
+      run++;
+      run->setFormat(a[i]);
+      run->length = 0;
+    }
+    run->length++;
+  }
+
+  LineEntry& entry = _lines[lineIndex(_usedLines)];
+  entry.data = data;
+  entry.length = count;
+  entry.formatCount = formatCount;
+  entry.width = width;
+  entry.wrapped = false;
+
+  _usedLines++;
+}
+
+quint32 HistoryScrollCompact::textAt(const LineEntry& entry, int column)
+{
+  switch (entry.width)
+  {
+    case 1: return reinterpret_cast<const quint8*>(entry.data)[column];
+    case 2: return reinterpret_cast<const quint16*>(entry.data)[column];
+    default: return reinterpret_cast<const quint32*>(entry.data)[column];
+  }
+}
+
+void HistoryScrollCompact::addLine(bool previousWrapped)
+{
+  if (_usedLines == 0)
+    return;
+
+  LineEntry& entry = _lines[lineIndex(_usedLines - 1)];
+  entry.wrapped = previousWrapped;
+
+  if (previousWrapped)
+    return;
+
+  // drop the trailing blanks of lines which are not wrapped, see trailingBlanks().
+  // they are spaces in the default format, so they are found at the end of
+  // the last runs
+  FormatRun* runs = reinterpret_cast<FormatRun*>(entry.data + textSize(entry.length,entry.width));
+  const Character defaultChar;
+  int length = entry.length;
+  int formatCount = entry.formatCount;
+
+  while (formatCount > 0 && runs[formatCount-1].format() == defaultChar)
+  {
+    FormatRun& run = runs[formatCount-1];
+
+    int blanks = 0;
+    while (blanks < run.length && textAt(entry,length-blanks-1) == ' ')
+      blanks++;
+
+    length -= blanks;
+    if (blanks < run.length)
+    {
+      run.length -= blanks;
+      break;
+    }
+    formatCount--;
+  }
+
+  if (length == entry.length)
+    return;
+
+  // move the runs to the end of the shorter text and give back the rest
+  const int oldSize = textSize(entry.length,entry.width) + entry.formatCount * sizeof(FormatRun);
+  const int newSize = textSize(length,entry.width) + formatCount * sizeof(FormatRun);
+
+  memmove(entry.data + textSize(length,entry.width), runs, formatCount * sizeof(FormatRun));
+  _pool.shrinkLast(entry.data,oldSize,newSize);
+
+  entry.length = length;
+  entry.formatCount = formatCount;
+}
+
+int HistoryScrollCompact::getLines()
+{
+  return _usedLines;
+}
+
+int HistoryScrollCompact::getLineLen(int lineNumber)
+{
+  Q_ASSERT( lineNumber >= 0 && lineNumber < _maxLineCount );
+
+  if (lineNumber < _usedLines)
+    return _lines[lineIndex(lineNumber)].length;
+  else
+    return 0;
+}
+
+bool HistoryScrollCompact::isWrappedLine(int lineNumber)
+{
+  Q_ASSERT( lineNumber >= 0 && lineNumber < _maxLineCount );
+
+  if (lineNumber < _usedLines)
+    return _lines[lineIndex(lineNumber)].wrapped;
+  else
+    return false;
+}
+
+template <typename T>
+void HistoryScrollCompact::loadText(const LineEntry& entry, int startColumn, int count,
+                                    Character* buffer)
+{
+  const T* text = reinterpret_cast<const T*>(entry.data);
+  const FormatRun* run = formats(entry);
+
+  // find the run containing the first requested cell
+  int runEnd = run->length;
+  while (runEnd <= startColumn)
+  {
+    run++;
+    runEnd += run->length;
+  }
+
+  Character format = run->format();
+  for (int column = startColumn; column < startColumn + count; column++)
+  {
+    if (column == runEnd)
+    {
+      run++;
+      runEnd += run->length;
+      format = run->format();
+    }
+    Character& cell = buffer[column - startColumn];
+    cell = format;
+    cell.character = text[column];
+  }
+}
+
+void HistoryScrollCompact::getCells(int lineNumber, int startColumn, int count, Character* buffer)
+{
+  if ( count == 0 ) return;
+
+  Q_ASSERT( lineNumber < _maxLineCount );
+
+  if (lineNumber >= _usedLines)
+  {
+    for (int i = 0; i < count; i++)
+      buffer[i] = Character();
+    return;
+  }
+
+  const LineEntry& entry = _lines[lineIndex(lineNumber)];
+
+  Q_ASSERT( startColumn >= 0 && startColumn + count <= entry.length );
+
+  switch (entry.width)
+  {
+    case 1: loadText<quint8>(entry,startColumn,count,buffer); break;
+    case 2: loadText<quint16>(entry,startColumn,count,buffer); break;
+    default: loadText<quint32>(entry,startColumn,count,buffer); break;
+  }
+}
+
+void HistoryScrollCompact::setMaxNbLines(unsigned int lineCount)
+{
+  while (_usedLines > (int)lineCount)
+    dropFirstLine();
+
+  LineEntry* newLines = new LineEntry[lineCount];
+  for (int i = 0; i < _usedLines; i++)
+    newLines[i] = _lines[lineIndex(i)];
+
+  delete[] _lines;
+  _lines = newLines;
+  _maxLineCount = lineCount;
+  _firstLine = 0;
+
+  delete m_histType;
+  m_histType = new HistoryTypeCompact(lineCount);
+}
+
+// History Scroll Tiered //////////////////////////////////////
+
+HistoryScrollTiered::HistoryScrollTiered(unsigned int hotLineCount)
+  : HistoryScroll(new HistoryTypeTiered(hotLineCount))
+   ,_blockCache(CACHED_BLOCK_COUNT)
+   ,_coldLines(0)
+   ,_spilledBlocks(0)
+   ,_spillFile(0)
+   ,_hotLineCount(hotLineCount)
+   ,_lastLineBlanks(0)
+{
+}
+
+HistoryScrollTiered::~HistoryScrollTiered()
+{
+  delete _spillFile;
+}
+
+void HistoryScrollTiered::setHotLineCount(unsigned int lineCount)
+{
+  _hotLineCount = lineCount;
+
+  delete m_histType;
+  m_histType = new HistoryTypeTiered(lineCount);
+}
+
+void HistoryScrollTiered::sealBlock()
+{
+  Q_ASSERT( _hotLines.count() >= BLOCK_LINE_COUNT );
+
+  int cellCount = 0;
+  for (int i = 0; i < BLOCK_LINE_COUNT; i++)
+    cellCount += _hotLines[i].count();
+
+  const int indexSize = BLOCK_LINE_COUNT * sizeof(BlockLine);
+  QByteArray block(indexSize + cellCount * sizeof(Character), 0);
+
+  BlockLine* index = reinterpret_cast<BlockLine*>(block.data());
+  Character* cells = reinterpret_cast<Character*>(block.data() + indexSize);
+
+  int offset = 0;
+  for (int i = 0; i < BLOCK_LINE_COUNT; i++)
+  {
+    const HistoryLine& line = _hotLines[i];
+
+    index[i].offset = offset;
+    index[i].length = line.count();
+    index[i].wrapped = _hotWrapped[i];
+
+    qCopy(line.constBegin(),line.constEnd(),cells + offset);
+    offset += line.count();
+  }
+
+  // favour speed over size, the blocks are compressed while output is
+  // being received and the contents of a terminal compress well anyway
+  ColdBlock cold;
+  cold.data = qCompress(block,1);
+  cold.fileOffset = -1;
+  cold.size = cold.data.size();
+  _coldBlocks.append(cold);
+  _coldLines += BLOCK_LINE_COUNT;
+
+  _hotLines.remove(0,BLOCK_LINE_COUNT);
+  _hotWrapped.remove(0,BLOCK_LINE_COUNT);
+
+  if (_coldBlocks.count() - _spilledBlocks > MEMORY_BLOCK_COUNT)
+    spillBlock();
+}
+
+void HistoryScrollTiered::spillBlock()
+{
+  if (!_spillFile)
+    _spillFile = new HistoryFile();
+
+  ColdBlock& cold = _coldBlocks[_spilledBlocks];
+
+  cold.fileOffset = _spillFile->len();
+  _spillFile->add(reinterpret_cast<const unsigned char*>(cold.data.constData()),cold.size);
+
+  // keep the block in memory if it could not be written
+  if (_spillFile->len() != cold.fileOffset + cold.size)
+  {
+    cold.fileOffset = -1;
+    return;
+  }
+
+  cold.data = QByteArray();
+  _spilledBlocks++;
+}
+
+const QByteArray* HistoryScrollTiered::coldBlock(int block)
+{
+  QByteArray* data = _blockCache.object(block);
+  if (!data)
+  {
+    const ColdBlock& cold = _coldBlocks[block];
+    if (cold.fileOffset >= 0)
+    {
+      QByteArray compressed(cold.size,0);
+      _spillFile->get(reinterpret_cast<unsigned char*>(compressed.data()),cold.size,cold.fileOffset);
+      data = new QByteArray(qUncompress(compressed));
+    }
+    else
+    {
+      data = new QByteArray(qUncompress(cold.data));
+    }
+    _blockCache.insert(block,data);
+  }
+  return data;
+}
+
+HistoryScrollTiered::BlockLine HistoryScrollTiered::coldLine(int lineNumber, const char** blockData)
+{
+  Q_ASSERT( lineNumber >= 0 && lineNumber < _coldLines );
+
+  const QByteArray* block = coldBlock(lineNumber / BLOCK_LINE_COUNT);
+
+  BlockLine line;
+  memcpy(&line, block->constData() + (lineNumber % BLOCK_LINE_COUNT) * sizeof(BlockLine),
+         sizeof(BlockLine));
+
+  if (blockData)
+    *blockData = block->constData() + BLOCK_LINE_COUNT * sizeof(BlockLine);
+
+  return line;
+}
+
+void HistoryScrollTiered::addCells(const Character a[], int count)
+{
+  // whether the line is wrapped is only known when addLine() is called
+  _lastLineBlanks = trailingBlanks(a,count);
+  count -= _lastLineBlanks;
+
+  // seal whole blocks only, so that at least _hotLineCount lines stay hot.
+  // this is done before adding the new line, whose wrap flag is only
+  // set by the following addLine() call
+  if (_hotLines.count() >= (int)_hotLineCount + BLOCK_LINE_COUNT)
+    sealBlock();
+
+  HistoryLine line(count);
+  qCopy(a,a+count,line.begin());
+
+  _hotLines.append(line);
+  _hotWrapped.append(false);
+}
+
+void HistoryScrollTiered::addLine(bool previousWrapped)
+{
+  if (_hotWrapped.isEmpty())
+    return;
+
+  _hotWrapped.last() = previousWrapped;
+
+  // the blanks are only dropped from lines which are not wrapped, see trailingBlanks().
+  // the cells added by resize() are equal to Character()
+  if (previousWrapped && _lastLineBlanks > 0)
+  {
+    HistoryLine& line = _hotLines.last();
+    line.resize(line.count() + _lastLineBlanks);
+  }
+  _lastLineBlanks = 0;
+}
+
+int HistoryScrollTiered::getLines()
+{
+  return _coldLines + _hotLines.count();
+}
+
+int HistoryScrollTiered::getLineLen(int lineNumber)
+{
+  if (lineNumber < 0 || lineNumber >= getLines())
+    return 0;
+
+  if (lineNumber >= _coldLines)
+    return _hotLines[lineNumber - _coldLines].count();
+  else
+    return coldLine(lineNumber,0).length;
+}
+
+bool HistoryScrollTiered::isWrappedLine(int lineNumber)
+{
+  if (lineNumber < 0 || lineNumber >= getLines())
+    return false;
+
+  if (lineNumber >= _coldLines)
+    return _hotWrapped[lineNumber - _coldLines];
+  else
+    return coldLine(lineNumber,0).wrapped;
+}
+
+void HistoryScrollTiered::getCells(int lineNumber, int startColumn, int count, Character* buffer)
+{
+  if ( count == 0 ) return;
+
+  Q_ASSERT( lineNumber >= 0 && lineNumber < getLines() );
+
+  if (lineNumber >= _coldLines)
+  {
+    const HistoryLine& line = _hotLines[lineNumber - _coldLines];
+
+    Q_ASSERT( startColumn >= 0 && startColumn + count <= line.count() );
+
+    memcpy(buffer, line.constData() + startColumn, count * sizeof(Character));
+  }
+  else
+  {
+    const char* cells = 0;
+    const BlockLine line = coldLine(lineNumber,&cells);
+
+    Q_ASSERT( startColumn >= 0 && startColumn + count <= line.length );
+
+    memcpy(buffer, cells + (line.offset + startColumn) * sizeof(Character),
+           count * sizeof(Character));
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+// Plain text index of the history
+//////////////////////////////////////////////////////////////////////
+
+HistoryTextIndex::HistoryTextIndex()
+  : _firstLine(0),
+    _nextLine(0),
+    _lastWrapped(false)
+{
+}
+
+static inline void appendCodePoint(QString& text, uint c, int column, QVector<int>* columns)
+{
+  if (c > 0xffff)
+  {
+    text += QChar(QChar::highSurrogate(c));
+    text += QChar(QChar::lowSurrogate(c));
+    if (columns)
+      *columns << column << column;
+  }
+  else
+  {
+    text += QChar(ushort(c));
+    if (columns)
+      columns->append(column);
+  }
+}
+
+void HistoryTextIndex::appendText(QString& text, const Character* cells, int count,
+                                  QVector<int>* columns)
+{
+  for (int i = 0 ; i < count ; i++)
+  {
+    const Character& cell = cells[i];
+
+    if (cell.rendition & RE_EXTENDED_CHAR)
+    {
+      ushort length = 0;
+      const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(cell.character,length);
+      for (int j = 0 ; chars && j < length ; j++)
+        appendCodePoint(text,chars[j],i,columns);
+    }
+    else if (cell.character != 0)
+    {
+      // the cells following wide characters are 0 and have no text
+      appendCodePoint(text,cell.character,i,columns);
+    }
+  }
+}
+
+void HistoryTextIndex::addLine(const Character* cells, int count, bool wrapped)
+{
+  // a new block is started after a line which is not wrapped, so that text
+  // running over several wrapped lines is usually kept in one block.  Very
+  // long runs of wrapped lines are split anyway, so that removeFirstLine()
+  // can free their text.  The search looks for matches across such splits
+  const int blockLines = _blocks.isEmpty() ? 0 : _blocks.last().lineStarts.count();
+  if (_blocks.isEmpty() ||
+      (!_lastWrapped && blockLines >= BLOCK_LINE_COUNT) ||
+      blockLines >= MAX_BLOCK_LINE_COUNT)
+  {
+    Block block;
+    block.firstLine = _nextLine;
+    block.lineStarts.reserve(BLOCK_LINE_COUNT);
+    _blocks.append(block);
+  }
+
+  Block& block = _blocks.last();
+  block.lineStarts.append(block.text.length());
+
+  if (!wrapped)
+  {
+    while (count > 0 && cells[count-1].character == ' ' &&
+           !(cells[count-1].rendition & RE_EXTENDED_CHAR))
+      count--;
+  }
+
+  appendText(block.text,cells,count);
+
+  if (!wrapped)
+    block.text += QLatin1Char('\n');
+
+  _nextLine++;
+  _lastWrapped = wrapped;
+}
+
+void HistoryTextIndex::removeFirstLine()
+{
+  Q_ASSERT( lineCount() > 0 );
+
+  _firstLine++;
+
+  // the text of dropped lines is kept until the whole block has been dropped
+  const Block& first = _blocks.first();
+  if (_firstLine >= first.firstLine + first.lineStarts.count())
+    _blocks.remove(0);
+}
+
+void HistoryTextIndex::clear()
+{
+  _blocks.clear();
+  _firstLine = _nextLine;
+  _lastWrapped = false;
+}
+
+//////////////////////////////////////////////////////////////////////
+// History Types
+//////////////////////////////////////////////////////////////////////
+
+HistoryType::HistoryType()
+{
+}
+
+HistoryType::~HistoryType()
+{
+}
+
+void HistoryType::copyLines(HistoryScroll* old, HistoryScroll* newScroll, int maxLines)
+{
+  int lines = (old != 0) ? old->getLines() : 0;
+  int startLine = 0;
+  if (maxLines > 0 && lines > maxLines)
+     startLine = lines - maxLines;
+
+  Character line[LINE_SIZE];
+  for(int i = startLine; i < lines; i++)
+  {
+     int size = old->getLineLen(i);
+     if (size > LINE_SIZE)
+     {
+        Character *tmp_line = new Character[size];
+        old->getCells(i, 0, size, tmp_line);
+        newScroll->addCells(tmp_line, size);
+        newScroll->addLine(old->isWrappedLine(i));
+        delete [] tmp_line;
+     }
+     else
+     {
+        old->getCells(i, 0, size, line);
+        newScroll->addCells(line, size);
+        newScroll->addLine(old->isWrappedLine(i));
+     }
+  }
+}
+
+//////////////////////////////
+
+HistoryTypeNone::HistoryTypeNone()
+{
+}
+
+bool HistoryTypeNone::isEnabled() const
 {
   return false;
 }
@@ -613,34 +1980,117 @@ HistoryScroll* HistoryTypeBuffer::scroll(HistoryScroll *old) const
     }
 
     HistoryScroll *newScroll = new HistoryScrollBuffer(m_nbLines);
-    int lines = old->getLines();
-    int startLine = 0;
-    if (lines > (int) m_nbLines)
-       startLine = lines - m_nbLines;
+    copyLines(old, newScroll, m_nbLines);
+    delete old;
+    return newScroll;
+  }
+  return new HistoryScrollBuffer(m_nbLines);
+}
+
+//////////////////////////////
 
-    Character line[LINE_SIZE];
-    for(int i = startLine; i < lines; i++)
+HistoryTypePaged::HistoryTypePaged(unsigned int nbLines)
+  : m_nbLines(nbLines)
+{
+}
+
+bool HistoryTypePaged::isEnabled() const
+{
+  return true;
+}
+
+int HistoryTypePaged::maximumLineCount() const
+{
+  return m_nbLines;
+}
+
+HistoryScroll* HistoryTypePaged::scroll(HistoryScroll *old) const
+{
+  if (old)
+  {
+    HistoryScrollPaged *oldPaged = dynamic_cast<HistoryScrollPaged*>(old);
+    if (oldPaged)
     {
-       int size = old->getLineLen(i);
-       if (size > LINE_SIZE)
-       {
-          Character *tmp_line = new Character[size];
-          old->getCells(i, 0, size, tmp_line);
-          newScroll->addCells(tmp_line, size);
-          newScroll->addLine(old->isWrappedLine(i));
-          delete [] tmp_line;
-       }
-       else
-       {
-          old->getCells(i, 0, size, line);
-          newScroll->addCells(line, size);
-          newScroll->addLine(old->isWrappedLine(i));
-       }
+       oldPaged->setMaxNbLines(m_nbLines);
+       return oldPaged;
     }
+
+    HistoryScroll *newScroll = new HistoryScrollPaged(m_nbLines);
+    copyLines(old, newScroll, m_nbLines);
     delete old;
     return newScroll;
   }
-  return new HistoryScrollBuffer(m_nbLines);
+  return new HistoryScrollPaged(m_nbLines);
+}
+
+//////////////////////////////
+
+HistoryTypeCompact::HistoryTypeCompact(unsigned int nbLines)
+  : m_nbLines(nbLines)
+{
+}
+
+bool HistoryTypeCompact::isEnabled() const
+{
+  return true;
+}
+
+int HistoryTypeCompact::maximumLineCount() const
+{
+  return m_nbLines;
+}
+
+HistoryScroll* HistoryTypeCompact::scroll(HistoryScroll *old) const
+{
+  if (old)
+  {
+    HistoryScrollCompact *oldCompact = dynamic_cast<HistoryScrollCompact*>(old);
+    if (oldCompact)
+    {
+       oldCompact->setMaxNbLines(m_nbLines);
+       return oldCompact;
+    }
+
+    HistoryScroll *newScroll = new HistoryScrollCompact(m_nbLines);
+    copyLines(old, newScroll, m_nbLines);
+    delete old;
+    return newScroll;
+  }
+  return new HistoryScrollCompact(m_nbLines);
+}
+
+//////////////////////////////
+
+HistoryTypeTiered::HistoryTypeTiered(unsigned int hotLineCount)
+  : m_hotLineCount(hotLineCount)
+{
+}
+
+bool HistoryTypeTiered::isEnabled() const
+{
+  return true;
+}
+
+int HistoryTypeTiered::maximumLineCount() const
+{
+  return 0;
+}
+
+HistoryScroll* HistoryTypeTiered::scroll(HistoryScroll *old) const
+{
+  HistoryScrollTiered *oldTiered = dynamic_cast<HistoryScrollTiered*>(old);
+  if (oldTiered)
+  {
+    oldTiered->setHotLineCount(m_hotLineCount);
+    return oldTiered;
+  }
+
+  HistoryScroll *newScroll = new HistoryScrollTiered(m_hotLineCount);
+
+  copyLines(old, newScroll);
+
+  delete old;
+  return newScroll;
 }
 
 //////////////////////////////
@@ -662,31 +2112,12 @@ const QString& HistoryTypeFile::getFileName() const
 
 HistoryScroll* HistoryTypeFile::scroll(HistoryScroll *old) const
 {
-  if (dynamic_cast<HistoryFile *>(old)) 
+  if (dynamic_cast<HistoryScrollFile *>(old)) 
      return old; // Unchanged.
 
   HistoryScroll *newScroll = new HistoryScrollFile(m_fileName);
 
-  Character line[LINE_SIZE];
-  int lines = (old != 0) ? old->getLines() : 0;
-  for(int i = 0; i < lines; i++)
-  {
-     int size = old->getLineLen(i);
-     if (size > LINE_SIZE)
-     {
-        Character *tmp_line = new Character[size];
-        old->getCells(i, 0, size, tmp_line);
-        newScroll->addCells(tmp_line, size);
-        newScroll->addLine(old->isWrappedLine(i));
-        delete [] tmp_line;
-     }
-     else
-     {
-        old->getCells(i, 0, size, line);
-        newScroll->addCells(line, size);
-        newScroll->addLine(old->isWrappedLine(i));
-     }
-  }
+  copyLines(old, newScroll);
 
   delete old;
   return newScroll; 
@@ -696,3 +2127,26 @@ int HistoryTypeFile::maximumLineCount() const
 {
   return 0;
 }
+
+//////////////////////////////
+
+HistoryTypePersistent::HistoryTypePersistent(const QString& fileName)
+  : HistoryTypeFile(fileName)
+{
+}
+
+HistoryScroll* HistoryTypePersistent::scroll(HistoryScroll *old) const
+{
+  HistoryScrollPersistent *oldPersistent = dynamic_cast<HistoryScrollPersistent*>(old);
+  if (oldPersistent && oldPersistent->fileName() == m_fileName)
+     return old; // Unchanged.
+
+  // the new history starts with the contents of the file from a previous
+  // session, followed by the lines of the current history
+  HistoryScroll *newScroll = new HistoryScrollPersistent(m_fileName);
+
+  copyLines(old, newScroll);
+
+  delete old;
+  return newScroll;
+}
@@ -26,6 +26,7 @@
 // Qt
 #include <QtCore/QBitRef>
 #include <QtCore/QHash>
+#include <QtCore/QCache>
 #include <QtCore>
 
 // Konsole
@@ -50,30 +51,20 @@ public:
   virtual void get(unsigned char* bytes, int len, int loc);
   virtual int  len();
 
-  //mmaps the file in read-only mode
-  void map();
-  //un-mmaps the file
-  void unmap();
-  //returns true if the file is mmap'ed
-  bool isMapped();
-
-
 private:
   int  ion;
   int  length;
   QTemporaryFile tmpFile;
 
-  //pointer to start of mmap'ed file data, or 0 if the file is not mmap'ed
-  char* fileMap;
- 
-  //incremented whenver 'add' is called and decremented whenever
-  //'get' is called.
-  //this is used to detect when a large number of lines are being read and processed from the history
-  //and automatically mmap the file for better performance (saves the overhead of many lseek-read calls).
-  int readWriteBalance;
-
-  //when readWriteBalance goes below this threshold, the file will be mmap'ed automatically
-  static const int MAP_THRESHOLD = -1000;
+  //reads are served from this copy of the file's contents starting at
+  //readCacheStart.  a miss refills
+  //the cache with a single read, so that reading a screenful of lines
+  //needs only one or two system calls.
+  //the file is only ever appended to, so cached data never becomes stale.
+  QByteArray readCache;
+  int readCacheStart;
+
+  static const int READ_CACHE_SIZE = 128 * 1024;
 };
 #endif
 
@@ -112,6 +103,10 @@ public:
 
   virtual void addLine(bool previousWrapped=false) = 0;
 
+  // marks the extended characters which the history has added to 'table'
+  // itself as used, see Screen::markExtendedChars()
+  virtual void markExtendedChars(ExtendedCharTable&) {}
+
   //
   // FIXME:  Passing around constant references to HistoryType instances
   // is very unsafe, because those references will no longer
@@ -148,9 +143,119 @@ private:
   int startOfLine(int lineno);
 
   QString m_logFileName;
-  HistoryFile index; // lines Row(int)
   HistoryFile cells; // text  Row(Character)
-  HistoryFile lineflags; // flags Row(unsigned char)
+
+  QVector<int> m_lineEnds;    // offset in 'cells' of the end of each line
+  QBitArray m_wrappedLines;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Persistent file-based history (e.g. to restore a session's output)
+//
+// The history is written append-only to two files which survive the
+// process: 'fileName' holds the cells of all lines one after another and
+// 'fileName.index' holds the end position and wrap flag of each line.
+// RGB colors are stored in 'fileName.colors', and the cells refer to them
+// by their position in that file rather than by their index in
+// TrueColorTable::instance, which only lasts as long as the process.
+// Extended characters are stored in 'fileName.chars' in the same way.
+// All files start with a FileHeader.  When an existing history is opened, the
+// index is read back in and the cells are mmap'ed, so restoring a long
+// history does not depend on the number of cells it contains.
+//////////////////////////////////////////////////////////////////////
+class HistoryScrollPersistent : public HistoryScroll
+{
+public:
+  HistoryScrollPersistent(const QString& fileName);
+  virtual ~HistoryScrollPersistent();
+
+  virtual int  getLines();
+  virtual int  getLineLen(int lineno);
+  virtual void getCells(int lineno, int colno, int count, Character res[]);
+  virtual bool isWrappedLine(int lineno);
+
+  virtual void addCells(const Character a[], int count);
+  virtual void addLine(bool previousWrapped=false);
+
+  virtual void markExtendedChars(ExtendedCharTable& table);
+
+  const QString& fileName() const { return m_fileName; }
+
+private:
+  struct FileHeader
+  {
+    char magic[8];
+    quint32 version;
+    quint32 cellSize;   // sizeof(Character) of the writer
+  };
+
+  // opens the history files, restoring their contents if they are valid
+  void open();
+  void close();
+  // opens 'path' and checks or writes its header.  returns the number of bytes
+  // following the header or -1 if the file could not be opened
+  qint64 openFile(const QString& path, int* fd);
+
+  qint64 startOfLine(int lineno) const;
+
+  // translate the RGB colors of cells from TrueColorTable::instance indexes 
+  // to positions in the colors file and back
+  quint16 toFileColor(quint16 index);
+  quint16 fromFileColor(quint16 index) const;
+
+  struct ToFileColor
+  {
+    HistoryScrollPersistent* history;
+    quint16 operator()(quint16 index) { return history->toFileColor(index); }
+  };
+  struct FromFileColor
+  {
+    const HistoryScrollPersistent* history;
+    quint16 operator()(quint16 index) { return history->fromFileColor(index); }
+  };
+
+  // an extended character sequence as stored in the chars file
+  struct FileChar
+  {
+    quint32 length;
+    quint32 points[ExtendedCharTable::MAX_SEQUENCE_LENGTH];
+  };
+
+  // translate the extended characters of cells from ExtendedCharTable::instance
+  // keys to positions in the chars file and back.  characters which cannot
+  // be translated are replaced by U+FFFD
+  void toFileChar(Character& cell);
+  void fromFileChar(Character& cell);
+
+  // set in an index entry if the line is wrapped
+  static const quint64 WRAPPED_LINE = Q_UINT64_C(1) << 63;
+  static const quint32 FORMAT_VERSION = 3;
+  // the positions in the chars file must fit into Character::character
+  static const int MAX_FILE_CHARS = 0xFFFFFF;
+
+  QString m_fileName;
+  int m_cellsFile;
+  int m_indexFile;
+  int m_colorsFile;
+  int m_charsFile;
+
+  // the colors are kept as RGB values rather than table indexes, since the
+  // indexes of colors which are not used by a screen are reused
+  QVector<QRgb> m_fileColors;               // colors file position -> color
+  QHash<QRgb,quint16> m_fileColorPositions; // color -> colors file position
+
+  QVector<FileChar> m_fileChars;              // chars file position -> sequence
+  QVector<quint32> m_fileCharKeys;            // chars file position -> table key,
+                                              // 0 if not read since the last
+                                              // collection of the table
+  QHash<quint32,quint32> m_fileCharPositions; // table key -> chars file position
+
+  qint64 m_cellCount;        // nb. of cells in the cells file
+  QVector<quint64> m_index;  // end of each line in cells | WRAPPED_LINE
+
+  char* m_cellsMap;          // mmap'ed cells file as found when opening it
+  size_t m_cellsMapSize;
+  qint64 m_mappedCells;      // nb. of cells which can be read from m_cellsMap
 };
 
 
@@ -249,8 +354,334 @@ public:
   virtual void addLine(bool previousWrapped=false);
 
 protected:
+  // lines are packed one after another into the blocks of m_blockArray,
+  // lines which do not fit into a block continue in the next one
+  struct LineEntry
+  {
+    size_t block;     // index of the block containing the first cell
+    int offset;       // offset in cells of the first cell within that block
+    int length;
+    bool wrapped;
+  };
+
+  int lineIndex(int lineNumber) const { return (m_firstLine + lineNumber) % m_maxLineCount; }
+
   BlockArray m_blockArray;
-  QHash<int,size_t> m_lineLengths;
+  size_t m_currentBlock;   // index of the block which is being filled
+
+  LineEntry* m_lines;      // ring of [m_maxLineCount] entries
+  int m_maxLineCount;
+  int m_usedLines;
+  int m_firstLine;
+  int m_lastLineBlanks;    // blanks at the end of the newest line which are
+                           // dropped unless it is wrapped
+};
+
+//////////////////////////////////////////////////////////////////////
+// Page pool used by the paged history implementations
+//
+// Memory for history lines is carved out of large pages in the order in
+// which the lines are added.  Since history lines are always dropped
+// oldest first, a page can be recycled as soon as all of the allocations
+// made from it have been released.
+//////////////////////////////////////////////////////////////////////
+class HistoryPagePool
+{
+public:
+  HistoryPagePool();
+  ~HistoryPagePool();
+
+  // returns 'size' bytes of memory which stay valid until this allocation
+  // and all allocations made before it have been released
+  char* allocate(int size);
+  // gives back the end of the most recent allocation, 'data', which is
+  // shrunk from 'oldSize' to 'newSize' bytes.  does nothing if 'data'
+  // is not the most recent allocation
+  void shrinkLast(const char* data, int oldSize, int newSize);
+  // releases the oldest allocation which has not been released yet
+  void releaseOldest();
+
+private:
+  struct Page
+  {
+    char* data;
+    int capacity;
+    int used;
+    int allocations;  // number of allocations still using this page
+  };
+
+  // returns an empty page with room for at least 'minimumSize' bytes
+  Page* takePage(int minimumSize);
+  void releasePage(Page* page);
+
+  // number of bytes in a regular page, larger allocations get a page of their own
+  static const int PAGE_SIZE = 96 * 1024;
+
+  QList<Page*> _pages;   // pages in use, oldest first.  the last one is allocated from
+  Page* _sparePage;      // a released page which is kept for reuse
+
+  HistoryPagePool(const HistoryPagePool&);
+  HistoryPagePool& operator=(const HistoryPagePool&);
+};
+
+//////////////////////////////////////////////////////////////////////
+// Paged history (limited to a fixed nb of lines)
+//
+// The cells of all lines are packed one after another into the pages of
+// a HistoryPagePool and found through a ring of line entries, so that
+// adding a line and dropping the oldest one are O(1) and, once the
+// history is full, do not allocate any memory.
+//////////////////////////////////////////////////////////////////////
+class HistoryScrollPaged : public HistoryScroll
+{
+public:
+  HistoryScrollPaged(unsigned int maxNbLines = 1000);
+  virtual ~HistoryScrollPaged();
+
+  virtual int  getLines();
+  virtual int  getLineLen(int lineno);
+  virtual void getCells(int lineno, int colno, int count, Character res[]);
+  virtual bool isWrappedLine(int lineno);
+
+  virtual void addCells(const Character a[], int count);
+  virtual void addLine(bool previousWrapped=false);
+
+  void setMaxNbLines(unsigned int nbLines);
+  unsigned int maxNbLines() { return _maxLineCount; }
+
+private:
+  struct LineEntry
+  {
+    const Character* cells;
+    int length;
+    bool wrapped;
+  };
+
+  // index into _lines of the entry for 'lineNumber'
+  int lineIndex(int lineNumber) const { return (_firstLine + lineNumber) % _maxLineCount; }
+  void dropFirstLine();
+
+  HistoryPagePool _pool;
+
+  LineEntry* _lines;     // ring of [_maxLineCount] entries
+  int _maxLineCount;
+  int _usedLines;
+  int _firstLine;        // index into _lines of the oldest line
+};
+
+//////////////////////////////////////////////////////////////////////
+// Compact history (limited to a fixed nb of lines)
+//
+// Like the paged history, but the text and the formatting of each line
+// are stored separately: the character values as a plain array and the
+// colors and rendition as runs of identically formatted cells.  The
+// character values of a line take 1, 2 or 4 bytes each, depending on
+// the largest of them, so lines of latin-1 text need a byte per cell.
+//
+// An 80 column line of ASCII text in a single format needs 104 bytes
+// (including its entry in the ring of lines), where the paged history
+// needs 656.  Lines of text from the basic multilingual plane need about
+// twice as much, still a fraction of complete Character cells.
+//////////////////////////////////////////////////////////////////////
+class HistoryScrollCompact : public HistoryScroll
+{
+public:
+  HistoryScrollCompact(unsigned int maxNbLines = 1000);
+  virtual ~HistoryScrollCompact();
+
+  virtual int  getLines();
+  virtual int  getLineLen(int lineno);
+  virtual void getCells(int lineno, int colno, int count, Character res[]);
+  virtual bool isWrappedLine(int lineno);
+
+  virtual void addCells(const Character a[], int count);
+  virtual void addLine(bool previousWrapped=false);
+
+  void setMaxNbLines(unsigned int nbLines);
+  unsigned int maxNbLines() { return _maxLineCount; }
+
+private:
+  // a run of cells with the same colors and rendition
+  struct FormatRun
+  {
+    // sets the colors and rendition to those of 'cell'
+    void setFormat(const Character& cell);
+    // returns a character with the colors and rendition of the run
+    Character format() const;
+
+    quint16 foreground;   // packed by CharacterColor::pack()
+    quint16 background;
+    quint16 length;
+    quint8 rendition;
+  };
+
+  // the character values of a line, 'width' bytes each, are followed by
+  // its format runs, which start at the next 2 byte boundary
+  struct LineEntry
+  {
+    char* data;
+    quint16 length;
+    quint16 formatCount;
+    quint8 width;
+    bool wrapped;
+  };
+
+  // the longest line which is stored, the rest of longer lines is dropped
+  static const int MAX_LINE_LENGTH = 0xFFFF;
+
+  static int textSize(int length, int width) { return (length * width + 1) & ~1; }
+  static const FormatRun* formats(const LineEntry& entry)
+  { return reinterpret_cast<const FormatRun*>(entry.data + textSize(entry.length,entry.width)); }
+  // returns the character value in 'column' of a line
+  static quint32 textAt(const LineEntry& entry, int column);
+  // copies 'count' cells from 'startColumn' of a line whose character values
+  // are of type T into 'buffer'
+  template <typename T>
+  static void loadText(const LineEntry& entry, int startColumn, int count, Character* buffer);
+
+  int lineIndex(int lineNumber) const { return (_firstLine + lineNumber) % _maxLineCount; }
+  void dropFirstLine();
+
+  HistoryPagePool _pool;
+
+  LineEntry* _lines;     // ring of [_maxLineCount] entries
+  int _maxLineCount;
+  int _usedLines;
+  int _firstLine;        // index into _lines of the oldest line
+};
+
+//////////////////////////////////////////////////////////////////////
+// Tiered history (unlimited nb of lines)
+//
+// The most recent lines are kept uncompressed.  Older lines are sealed
+// into blocks of BLOCK_LINE_COUNT lines which are compressed with
+// qCompress() and only decompressed when they are read again.  A small
+// cache of decompressed blocks keeps scrolling through old output smooth.
+// Only the newest MEMORY_BLOCK_COUNT compressed blocks are kept in memory,
+// older ones are moved to a temporary HistoryFile, so that the memory used
+// by the history stays bounded however long it grows.
+//////////////////////////////////////////////////////////////////////
+class HistoryScrollTiered : public HistoryScroll
+{
+public:
+  HistoryScrollTiered(unsigned int hotLineCount = 1000);
+  virtual ~HistoryScrollTiered();
+
+  virtual int  getLines();
+  virtual int  getLineLen(int lineno);
+  virtual void getCells(int lineno, int colno, int count, Character res[]);
+  virtual bool isWrappedLine(int lineno);
+
+  virtual void addCells(const Character a[], int count);
+  virtual void addLine(bool previousWrapped=false);
+
+  // sets the number of recent lines which are kept uncompressed
+  void setHotLineCount(unsigned int lineCount);
+  unsigned int hotLineCount() { return _hotLineCount; }
+
+private:
+  typedef QVector<Character> HistoryLine;
+
+  // index entry of a line in an uncompressed block.  the cells of the
+  // lines follow the BLOCK_LINE_COUNT index entries at the start of the block
+  struct BlockLine
+  {
+    int offset;    // offset in cells from the start of the block's cells
+    int length;
+    int wrapped;
+  };
+
+  // returns the decompressed contents of cold block 'block'
+  const QByteArray* coldBlock(int block);
+  // returns the index entry of the cold line 'lineNumber'
+  BlockLine coldLine(int lineNumber, const char** blockData);
+  // compresses the oldest BLOCK_LINE_COUNT hot lines into a new cold block
+  void sealBlock();
+  // moves the oldest cold block which is still in memory to _spillFile
+  void spillBlock();
+
+  static const int BLOCK_LINE_COUNT = 256;
+  static const int CACHED_BLOCK_COUNT = 8;
+  static const int MEMORY_BLOCK_COUNT = 64;
+
+  // a compressed block, held in memory or stored in _spillFile
+  struct ColdBlock
+  {
+    QByteArray data;     // empty once the block has been spilled
+    int fileOffset;      // position in _spillFile, or -1
+    int size;            // size of the compressed data
+  };
+
+  QVector<ColdBlock> _coldBlocks;           // oldest first
+  QCache<int,QByteArray> _blockCache;       // decompressed blocks by index
+  int _coldLines;                           // nb of lines in _coldBlocks
+  int _spilledBlocks;                       // nb of blocks in _spillFile
+  HistoryFile* _spillFile;                  // created when the first block is spilled
+
+  QVector<HistoryLine> _hotLines;
+  QVector<bool> _hotWrapped;
+  int _hotLineCount;
+  int _lastLineBlanks;                      // blanks dropped from the end of the newest
+                                            // line, restored if it is wrapped
+};
+
+//////////////////////////////////////////////////////////////////////
+// Plain text index of the history
+//
+// Keeps the text of the history lines as plain UTF-16 so that it can be
+// searched without decoding the cells of every line again.  Lines are
+// appended as they enter the history and identified by ids which keep
+// counting up, so that a line keeps its id when older lines are dropped.
+// The text is split into blocks of about BLOCK_LINE_COUNT lines; since the
+// blocks are implicitly shared, a copy of blocks() can be searched in
+// another thread while new lines are added.
+//////////////////////////////////////////////////////////////////////
+class HistoryTextIndex
+{
+public:
+  struct Block
+  {
+    int firstLine;             // id of the first line in the block
+    QString text;              // lines which do not continue on the
+                               // next line are followed by '\n'.  The
+                               // last line may continue in the next block
+    QVector<int> lineStarts;   // offset of each line in 'text'
+  };
+
+  HistoryTextIndex();
+
+  // appends a line of 'count' cells.  'wrapped' is true if the line
+  // continues on the next line
+  void addLine(const Character* cells, int count, bool wrapped);
+  // drops the oldest line
+  void removeFirstLine();
+  void clear();
+
+  // the id of the oldest line
+  int firstLine() const { return _firstLine; }
+  int lineCount() const { return _nextLine - _firstLine; }
+
+  // the blocks holding the lines, oldest first.  The first block may
+  // still contain lines which have been dropped, ie. lines before firstLine()
+  const QVector<Block>& blocks() const { return _blocks; }
+
+  // appends the text of 'count' cells to 'text'.  If 'columns' is not null
+  // the column of the cell which produced each UTF-16 code unit is appended
+  // to it.
+  static void appendText(QString& text, const Character* cells, int count,
+                         QVector<int>* columns = 0);
+
+  // the number of lines after which a new block is started, once a line
+  // which is not wrapped has been added
+  static const int BLOCK_LINE_COUNT = 4096;
+  // the number of lines after which a new block is started anyway
+  static const int MAX_BLOCK_LINE_COUNT = 2 * BLOCK_LINE_COUNT;
+
+private:
+  QVector<Block> _blocks;
+  int _firstLine;
+  int _nextLine;
+  bool _lastWrapped;    // the last line added continues on the next line
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -279,6 +710,13 @@ public:
   virtual int maximumLineCount()    const = 0;
 
   virtual HistoryScroll* scroll(HistoryScroll *) const = 0;
+
+protected:
+  /**
+   * Appends the lines of @p old to @p newScroll, oldest first.  If @p maxLines
+   * is not 0 only the last @p maxLines lines are copied.  @p old may be 0.
+   */
+  static void copyLines(HistoryScroll* old, HistoryScroll* newScroll, int maxLines = 0);
 };
 
 class HistoryTypeNone : public HistoryType
@@ -322,6 +760,14 @@ protected:
   QString m_fileName;
 };
 
+class HistoryTypePersistent : public HistoryTypeFile
+{
+public:
+  HistoryTypePersistent(const QString& fileName);
+
+  virtual HistoryScroll* scroll(HistoryScroll *) const;
+};
+
 
 class HistoryTypeBuffer : public HistoryType
 {
@@ -339,6 +785,48 @@ protected:
 
 #endif
 
+class HistoryTypePaged : public HistoryType
+{
+public:
+  HistoryTypePaged(unsigned int nbLines);
+
+  virtual bool isEnabled() const;
+  virtual int maximumLineCount() const;
+
+  virtual HistoryScroll* scroll(HistoryScroll *) const;
+
+protected:
+  unsigned int m_nbLines;
+};
+
+class HistoryTypeCompact : public HistoryType
+{
+public:
+  HistoryTypeCompact(unsigned int nbLines);
+
+  virtual bool isEnabled() const;
+  virtual int maximumLineCount() const;
+
+  virtual HistoryScroll* scroll(HistoryScroll *) const;
+
+protected:
+  unsigned int m_nbLines;
+};
+
+class HistoryTypeTiered : public HistoryType
+{
+public:
+  HistoryTypeTiered(unsigned int hotLineCount = 1000);
+
+  virtual bool isEnabled() const;
+  virtual int maximumLineCount() const;
+
+  virtual HistoryScroll* scroll(HistoryScroll *) const;
+
+protected:
+  unsigned int m_hotLineCount;
+};
+
 }
 
 #endif // TEHISTORY_H
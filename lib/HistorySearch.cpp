@@ -0,0 +1,482 @@
+/*
+    Copyright (C) 2026 by agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistorySearch.h"
+
+// Qt
+#include <QtCore/QRegExp>
+#include <QtCore/QTimer>
+#include <QtCore/QtConcurrentRun>
+
+// Konsole
+#include "Filter.h"
+#include "Screen.h"
+#include "ScreenWindow.h"
+#include "TerminalDisplay.h"
+
+using namespace Konsole;
+
+HistorySearch::HistorySearch(TerminalDisplay* display)
+    : QObject(display)
+    , _display(display)
+    , _highlightFilter(0)
+    , _regExp(false)
+    , _caseSensitivity(Qt::CaseInsensitive)
+    , _hasMatch(false)
+    , _pendingSearch(0)
+    , _indexing(false)
+    , _indexedScreen(0)
+{
+    connect( &_watcher , SIGNAL(finished()) , this , SLOT(searchFinished()) );
+}
+
+HistorySearch::~HistorySearch()
+{
+    _watcher.waitForFinished();
+    disableIndex();
+
+    // the display deletes the filters in its filter chain itself when it
+    // is deleted first
+    if (_display && _highlightFilter)
+    {
+        _display->filterChain()->removeFilter(_highlightFilter);
+        delete _highlightFilter;
+    }
+}
+
+void HistorySearch::setPattern(const QString& pattern, bool regExp,
+                               Qt::CaseSensitivity caseSensitivity)
+{
+    if (pattern == _pattern && regExp == _regExp && caseSensitivity == _caseSensitivity)
+        return;
+
+    _pattern = pattern;
+    _regExp = regExp;
+    _caseSensitivity = caseSensitivity;
+
+    updateHighlight();
+}
+
+bool HistorySearch::isSearching() const
+{
+    return _watcher.isRunning();
+}
+
+void HistorySearch::findNext()
+{
+    find(true);
+}
+
+void HistorySearch::findPrevious()
+{
+    find(false);
+}
+
+void HistorySearch::clear()
+{
+    _pendingSearch = 0;
+
+    if (_hasMatch && _display && _display->screenWindow())
+        _display->screenWindow()->clearSelection();
+    _hasMatch = false;
+
+    _pattern.clear();
+    updateHighlight();
+
+    disableIndex();
+}
+
+void HistorySearch::disableIndex()
+{
+    // the screens are deleted after their windows
+    if (_indexWindow && _indexedScreen)
+        _indexedScreen->setHistoryIndexEnabled(false);
+
+    _indexWindow = 0;
+    _indexedScreen = 0;
+}
+
+Screen* HistorySearch::screen() const
+{
+    if (!_display || !_display->screenWindow())
+        return 0;
+
+    return _display->screenWindow()->screen();
+}
+
+void HistorySearch::find(bool forward)
+{
+    // the request is carried out once the running search has finished, so
+    // that it continues from the match found by that search
+    if (_watcher.isRunning() || _indexing)
+        _pendingSearch = forward ? 1 : -1;
+    else
+        startSearch(forward);
+}
+
+void HistorySearch::startSearch(bool forward)
+{
+    Screen* screen = this->screen();
+
+    // ignore patterns which match an empty string, like RegExpFilter does
+    bool valid = !_pattern.isEmpty();
+    if (valid && _regExp)
+    {
+        QRegExp regExp(_pattern,_caseSensitivity);
+        valid = regExp.isValid() && !regExp.exactMatch(QString(""));
+    }
+
+    if (!screen || !valid)
+    {
+        emit noMatchFound();
+        return;
+    }
+
+    // the index is only kept while it is used, it costs about two bytes
+    // per character of history
+    if (screen != _indexedScreen || !screen->historyIndex())
+    {
+        disableIndex();
+        screen->setHistoryIndexEnabled(true);
+        _indexWindow = _display->screenWindow();
+        _indexedScreen = screen;
+    }
+
+    if (!screen->updateHistoryIndex(INDEX_SLICE_LINES))
+    {
+        _pendingSearch = forward ? 1 : -1;
+        _indexing = true;
+        QTimer::singleShot(0,this,SLOT(continueIndexing()));
+        return;
+    }
+
+    const HistoryTextIndex* index = screen->historyIndex();
+    const int histLines = screen->getHistLines();
+    const int lines = screen->getLines();
+    const int columns = screen->getColumns();
+
+    Q_ASSERT( index->lineCount() == histLines );
+
+    Job job;
+    job.blocks = index->blocks();
+    job.firstLine = index->firstLine();
+    job.pattern = _pattern;
+    job.regExp = _regExp;
+    job.caseSensitivity = _caseSensitivity;
+    job.forward = forward;
+
+    // the lines on the screen follow the lines of the history.  They get
+    // the ids which they will have in the index once they have been
+    // scrolled into the history
+    QVector<Character> image(lines*columns);
+    screen->getImage(image.data(),image.size(),histLines,histLines+lines-1);
+    const QVector<LineProperty> properties = screen->getLineProperties(histLines,histLines+lines-1);
+
+    HistoryTextIndex screenIndex;
+    for (int y = 0 ; y < lines ; y++)
+        screenIndex.addLine(image.constData() + y*columns,columns,properties[y] & LINE_WRAPPED);
+
+    foreach (HistoryTextIndex::Block block , screenIndex.blocks())
+    {
+        block.firstLine += job.firstLine + histLines;
+        job.blocks << block;
+    }
+
+    if (_hasMatch)
+    {
+        job.start = _matchStart;
+        if (forward)
+            job.start.offset++;
+    }
+    else
+    {
+        // start from the top of the display, or from its bottom when
+        // searching backwards
+        ScreenWindow* window = _display->screenWindow();
+        job.start.line = job.firstLine + window->currentLine();
+        if (!forward)
+            job.start.line += window->windowLines();
+        job.start.offset = 0;
+    }
+
+    _watcher.setFuture(QtConcurrent::run(&HistorySearch::search,job));
+}
+
+void HistorySearch::searchFinished()
+{
+    const Result result = _watcher.result();
+    Screen* screen = this->screen();
+
+    // the search has been cleared in the meantime
+    if (!_indexedScreen)
+    {
+        _pendingSearch = 0;
+        return;
+    }
+
+    int startLine = -1;
+    int endLine = -1;
+
+    if (result.found && screen && screen->historyIndex())
+    {
+        const int firstLine = screen->historyIndex()->firstLine();
+        startLine = result.start.line - firstLine;
+        endLine = result.end.line - firstLine;
+    }
+
+    // the match may have been dropped from the history since the search started
+    if (startLine < 0 || endLine >= screen->getHistLines() + screen->getLines())
+    {
+        _hasMatch = false;
+        _pendingSearch = 0;
+        emit noMatchFound();
+        return;
+    }
+
+    _hasMatch = true;
+    _matchStart = result.start;
+    _matchEnd = result.end;
+
+    const int startColumn = columnOf(startLine,result.start.offset);
+    const int endColumn = columnOf(endLine,result.end.offset - 1);
+
+    ScreenWindow* window = _display->screenWindow();
+    if (startLine < window->currentLine() ||
+        endLine >= window->currentLine() + window->windowLines())
+    {
+        _display->viewportPositionChanged(qMax(0,startLine - window->windowLines()/2),false);
+    }
+
+    window->setSelectionStart(startColumn,startLine - window->currentLine(),false);
+    window->setSelectionEnd(endColumn,endLine - window->currentLine());
+
+    _display->processFilters();
+
+    emit matchFound(startColumn,startLine,endColumn,endLine);
+
+    if (_pendingSearch != 0)
+    {
+        const bool forward = _pendingSearch > 0;
+        _pendingSearch = 0;
+        startSearch(forward);
+    }
+}
+
+void HistorySearch::continueIndexing()
+{
+    _indexing = false;
+
+    // the search has been cleared in the meantime
+    if (_pendingSearch == 0)
+        return;
+
+    const bool forward = _pendingSearch > 0;
+    _pendingSearch = 0;
+    startSearch(forward);
+}
+
+int HistorySearch::columnOf(int line, int offset) const
+{
+    Screen* screen = this->screen();
+    const int columns = screen->getColumns();
+
+    QVector<Character> cells(columns);
+    screen->getImage(cells.data(),columns,line,line);
+
+    QString text;
+    QVector<int> cellColumns;
+    HistoryTextIndex::appendText(text,cells.constData(),columns,&cellColumns);
+
+    if (offset < 0)
+        return 0;
+    if (offset >= cellColumns.count())
+        return columns - 1;
+
+    return cellColumns[offset];
+}
+
+void HistorySearch::updateHighlight()
+{
+    if (!_display)
+        return;
+
+    if (_pattern.isEmpty())
+    {
+        if (_highlightFilter)
+        {
+            _display->filterChain()->removeFilter(_highlightFilter);
+            delete _highlightFilter;
+            _highlightFilter = 0;
+        }
+    }
+    else
+    {
+        if (!_highlightFilter)
+        {
+            _highlightFilter = new RegExpFilter();
+            _display->filterChain()->addFilter(_highlightFilter);
+        }
+        _highlightFilter->setRegExp(QRegExp(_pattern,_caseSensitivity,
+                                            _regExp ? QRegExp::RegExp : QRegExp::FixedString));
+    }
+
+    _display->processFilters();
+}
+
+HistorySearch::Position HistorySearch::positionOf(const HistoryTextIndex::Block& block, int offset)
+{
+    const QVector<int>& starts = block.lineStarts;
+    const int index = qUpperBound(starts.begin(),starts.end(),offset) - starts.begin() - 1;
+
+    Q_ASSERT( index >= 0 );
+
+    Position position;
+    position.line = block.firstLine + index;
+    position.offset = offset - starts[index];
+    return position;
+}
+
+bool HistorySearch::findInText(const Job& job, QRegExp* regExp, const QString& text,
+                               int from, int limit, int* position, int* length)
+{
+    if (from >= limit)
+        return false;
+
+    if (!regExp)
+    {
+        const int pos = job.forward ? text.indexOf(job.pattern,from,job.caseSensitivity)
+                                    : text.lastIndexOf(job.pattern,limit - 1,job.caseSensitivity);
+        if (pos < from || pos >= limit)
+            return false;
+
+        *position = pos;
+        *length = job.pattern.length();
+        return true;
+    }
+
+    // QRegExp::lastIndexIn() tries to match at every position in turn, so
+    // the last match is found by searching forwards instead.  Empty matches,
+    // which patterns such as \b can produce, are skipped.
+    bool found = false;
+    int pos = regExp->indexIn(text,from);
+    while (pos >= 0 && pos < limit)
+    {
+        const int matchedLength = regExp->matchedLength();
+        if (matchedLength > 0)
+        {
+            *position = pos;
+            *length = matchedLength;
+            found = true;
+
+            if (job.forward)
+                break;
+        }
+        pos = regExp->indexIn(text,pos + 1);
+    }
+    return found;
+}
+
+HistorySearch::Result HistorySearch::search(const Job& job)
+{
+    Result result;
+    result.found = false;
+
+    const int blockCount = job.blocks.count();
+    if (blockCount == 0)
+        return result;
+
+    QRegExp regExp(job.pattern,job.caseSensitivity);
+
+    // find the offset at which the search starts
+    int startBlock = blockCount - 1;
+    while (startBlock > 0 && job.blocks[startBlock].firstLine > job.start.line)
+        startBlock--;
+
+    const HistoryTextIndex::Block& block = job.blocks[startBlock];
+    const int startIndex = job.start.line - block.firstLine;
+    int startOffset = 0;
+    if (startIndex >= block.lineStarts.count())
+        startOffset = block.text.length();
+    else if (startIndex >= 0)
+        startOffset = qMin(block.lineStarts[startIndex] + job.start.offset,block.text.length());
+
+    // search the rest of the start block, then the other blocks and finally
+    // the part of the start block which was skipped at first
+    for (int i = 0 ; i <= blockCount ; i++)
+    {
+        const int index = job.forward ? (startBlock + i) % blockCount
+                                      : (startBlock - i + blockCount) % blockCount;
+        const HistoryTextIndex::Block& current = job.blocks[index];
+
+        int from = 0;
+        int limit = current.text.length();
+        if (i == 0)
+        {
+            if (job.forward)
+                from = startOffset;
+            else
+                limit = startOffset;
+        }
+        else if (i == blockCount)
+        {
+            if (job.forward)
+                limit = startOffset;
+            else
+                from = startOffset;
+        }
+
+        // skip the lines of the first block which have been dropped
+        if (index == 0 && job.firstLine > current.firstLine)
+            from = qMax(from,current.lineStarts[job.firstLine - current.firstLine]);
+
+        // blocks may be split in the middle of a run of wrapped lines, so
+        // matches which start in this block may end in the next one
+        QString text = current.text;
+        if (index + 1 < blockCount && !text.endsWith(QLatin1Char('\n')))
+        {
+            const QString& next = job.blocks[index + 1].text;
+            const int end = next.indexOf(QLatin1Char('\n'));
+            text += (end < 0) ? next : next.left(end + 1);
+        }
+
+        int position = 0;
+        int length = 0;
+        if (findInText(job,job.regExp ? &regExp : 0,text,from,limit,&position,&length))
+        {
+            int endBlock = index;
+            int endOffset = position + length - 1;
+            if (endOffset >= current.text.length())
+            {
+                endBlock++;
+                endOffset -= current.text.length();
+            }
+
+            result.found = true;
+            result.start = positionOf(current,position);
+            result.end = positionOf(job.blocks[endBlock],endOffset);
+            result.end.offset++;
+            break;
+        }
+    }
+
+    return result;
+}
+
+//#include "moc_HistorySearch.cpp"
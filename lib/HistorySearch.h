@@ -0,0 +1,178 @@
+/*
+    Copyright (C) 2026 by agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef HISTORYSEARCH_H
+#define HISTORYSEARCH_H
+
+// Qt
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QString>
+
+// Konsole
+#include "History.h"
+
+class QRegExp;
+
+namespace Konsole
+{
+
+class RegExpFilter;
+class Screen;
+class ScreenWindow;
+class TerminalDisplay;
+
+/**
+ * Searches the history and the screen shown by a TerminalDisplay for text.
+ *
+ * The search uses the plain text index of the screen's history (see
+ * Screen::setHistoryIndexEnabled()), which is enabled when the first search
+ * is made and disabled again by clear() or when the search is deleted.
+ * The existing history is indexed in slices from the event loop, and the
+ * search starts once the index is complete.  
+ * findNext() and findPrevious() take a snapshot of the index and
+ * search it in a worker thread, so that the terminal keeps working while
+ * a long history is searched.  When a match is found the display is
+ * scrolled to it and the match is selected.  All matches in the visible
+ * part of the output are highlighted through a filter in the display's
+ * filter chain.
+ *
+ * Searches start after the previous match, or at the top of the display if
+ * there is none, and wrap around at the end of the output.
+ */
+class HistorySearch : public QObject
+{
+Q_OBJECT
+
+public:
+    /** Constructs a search over the output shown by @p display. */
+    explicit HistorySearch(TerminalDisplay* display);
+    virtual ~HistorySearch();
+
+    /**
+     * Sets the text to search for.  If @p regExp is true @p pattern is a
+     * regular expression, otherwise it is searched for literally.
+     * Patterns which match an empty string are never found.
+     */
+    void setPattern(const QString& pattern, bool regExp = false,
+                    Qt::CaseSensitivity caseSensitivity = Qt::CaseInsensitive);
+    /** Returns the text searched for, see setPattern() */
+    QString pattern() const { return _pattern; }
+
+    /** Returns true if a search is running in the worker thread. */
+    bool isSearching() const;
+
+public slots:
+    /** Searches for the next match after the current one. */
+    void findNext();
+    /** Searches for the match before the current one. */
+    void findPrevious();
+    /** Removes the highlighting and forgets the current match. */
+    void clear();
+
+signals:
+    /**
+     * Emitted when a match has been found.  The lines count from the first
+     * line of the history and @p endColumn is the last column of the match.
+     */
+    void matchFound(int startColumn, int startLine, int endColumn, int endLine);
+    /** Emitted when the pattern does not occur in the output. */
+    void noMatchFound();
+
+private slots:
+    void searchFinished();
+    // indexes the next slice of the history and starts the pending search
+    // once the index is complete
+    void continueIndexing();
+
+private:
+    // a position in the output, as the id of a line in the history index
+    // (see HistoryTextIndex) and an offset in the line's text
+    struct Position
+    {
+        int line;
+        int offset;
+    };
+
+    struct Job
+    {
+        QVector<HistoryTextIndex::Block> blocks;
+        int firstLine;          // the id of the first line which is searched
+        QString pattern;
+        bool regExp;
+        Qt::CaseSensitivity caseSensitivity;
+        Position start;
+        bool forward;
+    };
+
+    struct Result
+    {
+        bool found;
+        Position start;
+        Position end;           // just after the match
+    };
+
+    void find(bool forward);
+    void startSearch(bool forward);
+    void updateHighlight();
+    Screen* screen() const;
+    // disables the history index of the screen which it was enabled for
+    void disableIndex();
+
+    // maps the offset of a line's text to the column of its cell
+    int columnOf(int line, int offset) const;
+
+    static Result search(const Job& job);
+    // finds the first match, or the last one when searching backwards, which
+    // starts between 'from' and 'limit' in 'text'.  'regExp' is 0 for
+    // literal patterns
+    static bool findInText(const Job& job, QRegExp* regExp, const QString& text,
+                           int from, int limit, int* position, int* length);
+    static Position positionOf(const HistoryTextIndex::Block& block, int offset);
+
+    QPointer<TerminalDisplay> _display;
+    RegExpFilter* _highlightFilter;
+
+    QString _pattern;
+    bool _regExp;
+    Qt::CaseSensitivity _caseSensitivity;
+
+    bool _hasMatch;
+    Position _matchStart;
+    Position _matchEnd;
+
+    QFutureWatcher<Result> _watcher;
+    int _pendingSearch;         // 0, or 1 / -1 for a search forward / backward
+                                // requested while another one was running
+                                // or while the history was being indexed
+    bool _indexing;             // continueIndexing() is scheduled
+
+    // the screen whose history index has been enabled, and its window.
+    // The screen is only used while the window exists
+    QPointer<ScreenWindow> _indexWindow;
+    Screen* _indexedScreen;
+
+    // the number of lines of the history which are indexed at once
+    static const int INDEX_SLICE_LINES = 4096;
+};
+
+}
+
+#endif // HISTORYSEARCH_H
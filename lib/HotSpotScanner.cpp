@@ -0,0 +1,555 @@
+/*
+    Copyright (C) 2026 by agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HotSpotScanner.h"
+
+// Qt
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QtAlgorithms>
+
+using namespace Konsole;
+
+// characters which match \w
+static inline bool isWordChar(QChar c)
+{
+    return c.isLetterOrNumber() || c.isMark() || c == '_';
+}
+
+// characters which may appear in a URL
+static inline bool isUrlChar(QChar c)
+{
+    const ushort u = c.unicode();
+    return !(u == '<' || u == '>' || u == '\'' || u == '"' || c.isSpace());
+}
+
+// characters which may end a URL
+static inline bool isUrlEndChar(QChar c)
+{
+    const ushort u = c.unicode();
+    return isUrlChar(c) && !(u == '!' || u == ',' || u == '.' || u == ']');
+}
+
+// characters of the scheme of a URL, eg. "http" or "svn+ssh"
+static inline bool isSchemeChar(ushort c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+           c == '+' || c == '.' || c == '-';
+}
+
+// characters of the parts of an e-mail address
+static inline bool isEmailChar(QChar c)
+{
+    return isWordChar(c) || c == '.' || c == '-';
+}
+
+static bool matchStartsBefore(const HotSpotScanner::Match& a, const HotSpotScanner::Match& b)
+{
+    return a.start < b.start;
+}
+
+HotSpotScanner::HotSpotScanner()
+{
+}
+
+bool HotSpotScanner::Item::matches(ushort c) const
+{
+    bool hit = false;
+
+    for (int i = 0 ; i < ranges.count() && !hit ; i += 2)
+        hit = c >= ranges[i] && c <= ranges[i+1];
+
+    if (!hit && classes)
+    {
+        const QChar ch(c);
+        const bool digit = ch.isDigit();
+        const bool word = isWordChar(ch);
+        const bool space = ch.isSpace();
+
+        hit = ((classes & Digit) && digit) || ((classes & NotDigit) && !digit) ||
+              ((classes & Word) && word) || ((classes & NotWord) && !word) ||
+              ((classes & Space) && space) || ((classes & NotSpace) && !space) ||
+              ((classes & NotNewLine) && c != '\n');
+    }
+
+    return hit != negated;
+}
+
+quint32 HotSpotScanner::Pattern::itemsMatching(ushort c) const
+{
+    if (c < 128)
+        return asciiItems[c];
+
+    quint32 result = 0;
+    for (int i = 0 ; i < items.count() ; i++)
+    {
+        if (items[i].matches(c))
+            result |= 1u << i;
+    }
+    return result;
+}
+
+bool HotSpotScanner::parseEscape(const QString& pattern, int& pos, Item& item, int& literal)
+{
+    if (pos >= pattern.length())
+        return false;
+
+    const ushort c = pattern[pos++].unicode();
+    literal = -1;
+
+    switch (c)
+    {
+        case 'd': item.classes |= Digit; break;
+        case 'w': item.classes |= Word; break;
+        case 's': item.classes |= Space; break;
+        case 'D': item.classes |= NotDigit; break;
+        case 'W': item.classes |= NotWord; break;
+        case 'S': item.classes |= NotSpace; break;
+        case 't': literal = '\t'; break;
+        default:
+            // letters and digits are reserved for escapes which may be added later
+            if (QChar(c).isLetterOrNumber())
+                return false;
+            literal = c;
+    }
+    return true;
+}
+
+bool HotSpotScanner::parseItem(const QString& pattern, int& pos, Item& item)
+{
+    const int length = pattern.length();
+
+    item.classes = 0;
+    item.negated = false;
+    item.repeat = Item::Once;
+
+    const ushort c = pattern[pos++].unicode();
+    int literal = -1;
+
+    switch (c)
+    {
+        case '[':
+        {
+            if (pos < length && pattern[pos] == '^')
+            {
+                item.negated = true;
+                pos++;
+            }
+
+            // a ']' right at the start of the set is an ordinary character
+            bool first = true;
+            while (true)
+            {
+                if (pos >= length)
+                    return false;
+
+                ushort low = pattern[pos++].unicode();
+                if (low == ']' && !first)
+                    break;
+                first = false;
+
+                if (low == '\\')
+                {
+                    if (!parseEscape(pattern,pos,item,literal))
+                        return false;
+                    if (literal == -1)
+                        continue;
+                    low = literal;
+                }
+
+                ushort high = low;
+                if (pos + 1 < length && pattern[pos] == '-' && pattern[pos+1] != ']')
+                {
+                    pos++;
+                    high = pattern[pos++].unicode();
+                    if (high == '\\')
+                    {
+                        if (!parseEscape(pattern,pos,item,literal) || literal == -1)
+                            return false;
+                        high = literal;
+                    }
+                    if (high < low)
+                        return false;
+                }
+                item.ranges << low << high;
+            }
+            break;
+        }
+        case '.':
+            item.classes = NotNewLine;
+            break;
+        case '\\':
+            if (!parseEscape(pattern,pos,item,literal))
+                return false;
+            if (literal != -1)
+                item.ranges << literal << literal;
+            break;
+        case '?': case '*': case '+':
+        case '(': case ')': case '|': case '{': case '}': case '^': case '$':
+            // repeats without an item, and features of regular expressions
+            // which are not supported
+            return false;
+        default:
+            item.ranges << c << c;
+    }
+
+    if (pos < length)
+    {
+        switch (pattern[pos].unicode())
+        {
+            case '?': item.repeat = Item::Optional; pos++; break;
+            case '*': item.repeat = Item::Any; pos++; break;
+            case '+': item.repeat = Item::AtLeastOnce; pos++; break;
+        }
+    }
+    return true;
+}
+
+int HotSpotScanner::addPattern(const QString& text)
+{
+    QVector<Item> items;
+
+    int pos = 0;
+    while (pos < text.length())
+    {
+        Item item;
+        if (items.count() == MAX_PATTERN_ITEMS || !parseItem(text,pos,item))
+            return -1;
+        items.prepend(item);
+    }
+
+    bool matchesEmpty = true;
+    for (int i = 0 ; i < items.count() ; i++)
+    {
+        if (items[i].repeat == Item::Once || items[i].repeat == Item::AtLeastOnce)
+            matchesEmpty = false;
+    }
+    if (matchesEmpty)
+        return -1;
+
+    Pattern pattern;
+    pattern.items = items;
+    pattern.kind = FirstPattern + _patterns.count();
+
+    const int count = items.count();
+
+#define CAN_SKIP(i) (items[i].repeat == Item::Optional || items[i].repeat == Item::Any)
+
+    pattern.endItems = 0;
+    for (int i = 0 ; i < count ; i++)
+    {
+        pattern.endItems |= 1u << i;
+        if (!CAN_SKIP(i))
+            break;
+    }
+
+    pattern.startItems = 0;
+    for (int i = count - 1 ; i >= 0 ; i--)
+    {
+        pattern.startItems |= 1u << i;
+        if (!CAN_SKIP(i))
+            break;
+    }
+
+    pattern.previous.fill(0,count);
+    for (int i = 0 ; i < count ; i++)
+    {
+        if (items[i].repeat == Item::Any || items[i].repeat == Item::AtLeastOnce)
+            pattern.previous[i] |= 1u << i;
+
+        for (int j = i + 1 ; j < count ; j++)
+        {
+            pattern.previous[i] |= 1u << j;
+            if (!CAN_SKIP(j))
+                break;
+        }
+    }
+
+#undef CAN_SKIP
+
+    for (ushort c = 0 ; c < 128 ; c++)
+    {
+        pattern.asciiItems[c] = 0;
+        for (int i = 0 ; i < count ; i++)
+        {
+            if (items[i].matches(c))
+                pattern.asciiItems[c] |= 1u << i;
+        }
+    }
+
+    _patterns << pattern;
+    return pattern.kind;
+}
+
+void HotSpotScanner::clearPatterns()
+{
+    _patterns.clear();
+}
+
+void HotSpotScanner::scan(const QChar* text, int length, QVector<Match>& matches) const
+{
+    if (_patterns.isEmpty())
+    {
+        scanLinks(text,length,matches);
+        return;
+    }
+
+    // the matches of each kind are found separately, then those which overlap
+    // a match which starts before them are dropped
+    QVector<Match> found;
+    scanLinks(text,length,found);
+    for (int i = 0 ; i < _patterns.count() ; i++)
+        scanPattern(_patterns[i],text,length,found);
+
+    qStableSort(found.begin(),found.end(),matchStartsBefore);
+
+    int end = 0;
+    for (int i = 0 ; i < found.count() ; i++)
+    {
+        if (found[i].start >= end)
+        {
+            matches << found[i];
+            end = found[i].start + found[i].length;
+        }
+    }
+}
+
+// Finds the same URLs and e-mail addresses, at the same positions, as the
+// regular expressions which were used before:
+//
+// full url:
+//   (www\.(?!\.)|[a-z][a-z0-9+.-]*://)[^\s<>'"]+[^!,\.\s<>'"\]]
+//   protocolname:// or www. followed by anything other than whitespaces, <, >, ' or ",
+//   and ends before whitespaces, <, >, ', ", ], !, comma and dot
+// email address:
+//   \b(\w|\.|-)+@(\w|\.|-)+\.\w+\b
+//   [word chars, dots or dashes]@[word chars, dots or dashes].[word chars]
+void HotSpotScanner::scanLinks(const QChar* text, int length, QVector<Match>& matches) const
+{
+    // the first lower case letter in the run of scheme characters before the
+    // current position, where a URL starts if the run is followed by "://"
+    int schemeStart = -1;
+    // the start of the part of an e-mail address before the '@', if the
+    // current position is in one.  Like the \b in \b(\w|\.|-)+ it is the
+    // first change between word and other characters in the run
+    int emailStart = -1;
+
+    // a URL or e-mail address which starts before a "www." in the same run of
+    // characters is found instead of the one starting at the "www.".  Whether
+    // there is one is worked out once for each run, up to its end
+    int schemeRunEnd = -1;
+    bool schemeRunIsUrl = false;
+    int emailRunEnd = -1;
+    bool emailRunIsEmail = false;
+
+    int i = 0;
+    while (i < length)
+    {
+        const QChar c = text[i];
+        const ushort u = c.unicode();
+
+        Match match;
+        match.start = -1;
+        int end = -1;
+
+        if (u == ':' && schemeStart >= 0 && i + 2 < length &&
+            text[i+1] == '/' && text[i+2] == '/')
+        {
+            match.start = schemeStart;
+            match.kind = Url;
+            end = urlEnd(text,length,i + 3);
+        }
+        else if (u == 'w' && i + 3 < length && text[i+1] == 'w' && text[i+2] == 'w' &&
+                 text[i+3] == '.' && (i + 4 == length || text[i+4] != '.'))
+        {
+            if (schemeStart >= 0 && schemeStart < i && i >= schemeRunEnd)
+            {
+                schemeRunEnd = i;
+                while (schemeRunEnd < length && isSchemeChar(text[schemeRunEnd].unicode()))
+                    schemeRunEnd++;
+                schemeRunIsUrl = schemeRunEnd + 2 < length && text[schemeRunEnd] == ':' &&
+                                 text[schemeRunEnd+1] == '/' && text[schemeRunEnd+2] == '/' &&
+                                 urlEnd(text,length,schemeRunEnd + 3) != -1;
+            }
+            if (emailStart >= 0 && emailStart < i && i >= emailRunEnd)
+            {
+                emailRunEnd = i;
+                while (emailRunEnd < length && isEmailChar(text[emailRunEnd]))
+                    emailRunEnd++;
+                emailRunIsEmail = emailRunEnd < length && text[emailRunEnd] == '@' &&
+                                  emailEnd(text,length,emailRunEnd + 1) != -1;
+            }
+
+            if (!(schemeStart >= 0 && schemeStart < i && schemeRunIsUrl) &&
+                !(emailStart >= 0 && emailStart < i && emailRunIsEmail))
+            {
+                match.start = i;
+                match.kind = Url;
+                end = urlEnd(text,length,i + 4);
+            }
+        }
+        else if (u == '@' && emailStart >= 0)
+        {
+            match.start = emailStart;
+            match.kind = Email;
+            end = emailEnd(text,length,i + 1);
+        }
+
+        if (end != -1)
+        {
+            match.length = end - match.start;
+            matches << match;
+
+            i = end;
+            schemeStart = -1;
+            emailStart = -1;
+            continue;
+        }
+
+        if (isSchemeChar(u))
+        {
+            if (schemeStart == -1 && u >= 'a' && u <= 'z')
+                schemeStart = i;
+        }
+        else
+        {
+            schemeStart = -1;
+        }
+
+        if (isEmailChar(c))
+        {
+            if (emailStart == -1 && isWordChar(c) != (i > 0 && isWordChar(text[i-1])))
+                emailStart = i;
+        }
+        else
+        {
+            emailStart = -1;
+        }
+
+        i++;
+    }
+}
+
+int HotSpotScanner::urlEnd(const QChar* text, int length, int from)
+{
+    // one or more URL characters followed by one which is not a punctuation mark
+    int end = -1;
+    for (int i = from ; i < length && isUrlChar(text[i]) ; i++)
+    {
+        if (i > from && isUrlEndChar(text[i]))
+            end = i + 1;
+    }
+    return end;
+}
+
+int HotSpotScanner::emailEnd(const QChar* text, int length, int from)
+{
+    // the domain ends after the last word which follows a '.', other than
+    // one at the start of the domain
+    int end = -1;
+    int wordStart = -1;
+    for (int i = from ; i < length && isEmailChar(text[i]) ; i++)
+    {
+        if (!isWordChar(text[i]))
+            continue;
+        if (i == from || !isWordChar(text[i-1]))
+            wordStart = i;
+        if ((i + 1 == length || !isWordChar(text[i+1])) &&
+            wordStart > from + 1 && text[wordStart-1] == '.')
+            end = i + 1;
+    }
+    return end;
+}
+
+void HotSpotScanner::scanPattern(const Pattern& pattern, const QChar* text, int length,
+                                 QVector<Match>& matches) const
+{
+    // the end of the longest match starting at each position, or -1.  The
+    // pattern's items are reversed, so the automaton runs from the end of the
+    // text to its start, keeping the end of the longest match for each item
+    QVarLengthArray<int,1024> longestEnd(length);
+
+    const int count = pattern.items.count();
+    int ends[MAX_PATTERN_ITEMS];
+    int nextEnds[MAX_PATTERN_ITEMS];
+    quint32 active = 0;
+
+    for (int pos = length - 1 ; pos >= 0 ; pos--)
+    {
+        const quint32 matching = pattern.itemsMatching(text[pos].unicode());
+        quint32 next = 0;
+
+        if (matching)
+        {
+            // a new match can end after this character
+            next = pattern.endItems & matching;
+            for (int i = 0 ; i < count ; i++)
+            {
+                if (next & (1u << i))
+                    nextEnds[i] = pos + 1;
+            }
+
+            for (int i = 0 ; i < count && active ; i++)
+            {
+                if (!(active & (1u << i)))
+                    continue;
+
+                const quint32 targets = pattern.previous[i] & matching;
+                for (int j = 0 ; j < count ; j++)
+                {
+                    if (!(targets & (1u << j)))
+                        continue;
+                    if (!(next & (1u << j)) || nextEnds[j] < ends[i])
+                        nextEnds[j] = ends[i];
+                    next |= 1u << j;
+                }
+            }
+        }
+
+        active = next;
+        longestEnd[pos] = -1;
+
+        for (int i = 0 ; i < count ; i++)
+        {
+            if (!(active & (1u << i)))
+                continue;
+            ends[i] = nextEnds[i];
+            if ((pattern.startItems & (1u << i)) && ends[i] > longestEnd[pos])
+                longestEnd[pos] = ends[i];
+        }
+    }
+
+    for (int pos = 0 ; pos < length ; )
+    {
+        if (longestEnd[pos] > pos)
+        {
+            Match match;
+            match.start = pos;
+            match.length = longestEnd[pos] - pos;
+            match.kind = pattern.kind;
+            matches << match;
+
+            pos = longestEnd[pos];
+        }
+        else
+        {
+            pos++;
+        }
+    }
+}
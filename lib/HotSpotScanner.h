@@ -0,0 +1,162 @@
+/*
+    Copyright (C) 2026 by agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef HOTSPOTSCANNER_H
+#define HOTSPOTSCANNER_H
+
+// Qt
+#include <QtCore/QChar>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+namespace Konsole
+{
+
+/**
+ * Finds URLs, e-mail addresses and text matching simple user defined patterns,
+ * such as file:line references or ticket IDs, in a span of text.
+ *
+ * Unlike a backtracking regular expression, the scanner looks at each character
+ * a fixed number of times, so the time it takes grows linearly with the length of
+ * the text.  URLs and e-mail addresses are found by a hand-written scanner which
+ * looks for "://", "www." and '@' and extends the match from there.  User defined
+ * patterns are compiled into an automaton which is run over the text once, from
+ * its end to its start, to find the longest match starting at each position.
+ *
+ * The matches found are the leftmost and longest ones and do not overlap.  When
+ * matches of different kinds overlap the one which starts first is kept.  Of
+ * matches which start at the same position, URLs and e-mail addresses are preferred
+ * over user defined patterns, and patterns are preferred in the order they were added.
+ */
+class HotSpotScanner
+{
+public:
+    /**
+     * The kinds of text found by scan().  User defined patterns have the kinds
+     * returned by addPattern(), which count up from FirstPattern.
+     */
+    enum Kind
+    {
+        Url,
+        Email,
+        FirstPattern
+    };
+
+    /** A section of text found by scan() */
+    struct Match
+    {
+        int start;
+        int length;
+        int kind;
+    };
+
+    HotSpotScanner();
+
+    /**
+     * Adds a pattern to look for and returns the kind of the matches found for it,
+     * or -1 if @p pattern is not valid or matches an empty string.
+     *
+     * Patterns are a sequence of at most 32 of the following items, each of which
+     * may be followed by ?, * or + to make it optional or repeat it:
+     *
+     * - A character, which matches itself.  Characters with a special meaning are
+     *   escaped with a backslash.
+     * - '.', which matches any character except a new line.
+     * - \\d, \\w and \\s, which match digits, word characters and whitespace, and
+     *   \\D, \\W and \\S which match any other character.
+     * - A set of characters in brackets, such as [a-z_] or [^:], which may also
+     *   contain \\d, \\w and \\s.
+     *
+     * Groups and alternatives are not supported.  For example, "[\\w./-]+:\\d+"
+     * finds file:line references and "[A-Z]+-\\d+" finds ticket IDs.
+     */
+    int addPattern(const QString& pattern);
+    /** Removes all the patterns added with addPattern() */
+    void clearPatterns();
+
+    /**
+     * Appends the matches found in the @p length characters at @p text to
+     * @p matches, in the order in which they occur.  The start of each match
+     * is relative to @p text.
+     */
+    void scan(const QChar* text, int length, QVector<Match>& matches) const;
+
+private:
+    // an item of a pattern, which matches one character
+    struct Item
+    {
+        enum Repeat { Once, Optional, Any, AtLeastOnce };
+
+        bool matches(ushort c) const;
+
+        QVector<ushort> ranges;     // pairs of first and last characters
+        int classes;                // CharacterClass flags
+        bool negated;
+        Repeat repeat;
+    };
+
+    enum CharacterClass
+    {
+        Digit = 1,
+        Word = 2,
+        Space = 4,
+        NotDigit = 8,
+        NotWord = 16,
+        NotSpace = 32,
+        NotNewLine = 64
+    };
+
+    // a compiled pattern.  The items are stored in reverse order, since the
+    // automaton runs over the text backwards
+    struct Pattern
+    {
+        QVector<Item> items;
+        quint32 endItems;           // the items which can match the last character
+        quint32 startItems;         // the items which can match the first character
+        QVector<quint32> previous;  // the items which can match the character
+                                    // before the one matched by each item
+        quint32 asciiItems[128];    // the items which match each ASCII character
+        int kind;
+
+        quint32 itemsMatching(ushort c) const;
+    };
+
+    static const int MAX_PATTERN_ITEMS = 32;
+
+    static bool parseItem(const QString& pattern, int& pos, Item& item);
+    // parses the escape sequence after a backslash.  'literal' is set to the character
+    // it stands for, or to -1 if it stands for a class of characters, which is then
+    // added to 'item'
+    static bool parseEscape(const QString& pattern, int& pos, Item& item, int& literal);
+
+    void scanLinks(const QChar* text, int length, QVector<Match>& matches) const;
+    // return the end of the rest of a URL or e-mail address, which starts at 'from',
+    // or -1 if there is none
+    static int urlEnd(const QChar* text, int length, int from);
+    static int emailEnd(const QChar* text, int length, int from);
+
+    void scanPattern(const Pattern& pattern, const QChar* text, int length,
+                     QVector<Match>& matches) const;
+
+    QVector<Pattern> _patterns;
+};
+
+}
+
+#endif // HOTSPOTSCANNER_H
@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <termios.h>
+#include <sys/uio.h>
 
 // Qt
 #include <QtCore>
@@ -38,11 +39,25 @@
 //#include <KLocale>
 //#include <KDebug>
 #include "kpty.h"
+#include "Emulation.h"
 
 using namespace Konsole;
 
+// the number of queued buffers of input which are written at once
+#define SEND_BATCH_SIZE 16
+// queued buffers of input smaller than this are merged
+#define SEND_MERGE_SIZE 4096
+
 void Pty::donePty()
 {
+  // the teletype is closed, so the input waiting for it can not be sent
+  delete _writeNotifier;
+  _writeNotifier = 0;
+  _pendingSendJobs.clear();
+  _sendOffset = 0;
+  _pendingBytes = 0;
+  _bufferFull = false;
+
   emit done(exitStatus());
 }
 
@@ -216,6 +231,12 @@ int Pty::start(const QString& program,
   if ( K3Process::start(NotifyOnExit, (Communication) (Stdin | Stdout)) == false )
      return -1;
 
+  // input is written by doSendJobs() rather than K3Process::writeStdin()
+  _writeNotifier = new QSocketNotifier(pty()->masterFd(), QSocketNotifier::Write, this);
+  _writeNotifier->setEnabled(false);
+  connect(_writeNotifier, SIGNAL(activated(int)), this, SLOT(writeReady()));
+  doSendJobs();
+
   resume(); // Start...
   return 0;
 
@@ -232,19 +253,19 @@ void Pty::setWriteable(bool writeable)
 }
 
 Pty::Pty()
-    : _bufferFull(false),
+    : _sendOffset(0),
+      _pendingBytes(0),
+      _bufferFull(false),
+      _writeNotifier(0),
       _windowColumns(0),
       _windowLines(0),
       _eraseChar(0),
       _xonXoff(true),
-      _utf8(true)
+      _utf8(true),
+      _receiver(0)
 {
-  connect(this, SIGNAL(receivedStdout(K3Process *, char *, int )),
-	  this, SLOT(dataReceived(K3Process *,char *, int)));
   connect(this, SIGNAL(processExited(K3Process *)),
           this, SLOT(donePty()));
-  connect(this, SIGNAL(wroteStdin(K3Process *)),
-          this, SLOT(writeReady()));
   _pty = new KPty;
 
   setUsePty(All, false); // utmp will be overridden later
@@ -257,43 +278,126 @@ Pty::~Pty()
 
 void Pty::writeReady()
 {
-  _pendingSendJobs.erase(_pendingSendJobs.begin());
   _bufferFull = false;
   doSendJobs();
 }
 
 void Pty::doSendJobs() {
-  if(_pendingSendJobs.isEmpty())
+  if (!_writeNotifier)
+    return;
+
+  while (!_pendingSendJobs.isEmpty())
   {
-     emit bufferEmpty(); 
-     return;
+    // write the first few jobs at once, starting where the last write 
+    // stopped 
+    struct iovec iov[SEND_BATCH_SIZE];
+    int count = 0;
+    ssize_t total = 0;
+    for ( ; count < SEND_BATCH_SIZE && count < _pendingSendJobs.count() ; count++)
+    {
+      const SendJob& job = _pendingSendJobs.at(count);
+      const int offset = count == 0 ? _sendOffset : 0;
+      iov[count].iov_base = const_cast<char*>(job.data()) + offset;
+      iov[count].iov_len = job.length() - offset;
+      total += iov[count].iov_len;
+    }
+
+    ssize_t written = ::writev(pty()->masterFd(), iov, count);
+
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN)
+        break;
+
+      qWarning("Pty::doSendJobs - Could not send input data to terminal process.");
+      _pendingSendJobs.clear();
+      _sendOffset = 0;
+      _pendingBytes = 0;
+      break;
+    }
+
+    const ssize_t sent = written;
+    _sendStatistics.writes++;
+    _sendStatistics.bytes += sent;
+    _pendingBytes -= sent;
+
+    // remove the jobs which have been sent completely
+    while (written > 0)
+    {
+      const int remaining = _pendingSendJobs.first().length() - _sendOffset;
+      if (written < remaining)
+      {
+        _sendOffset += written;
+        break;
+      }
+      written -= remaining;
+      _pendingSendJobs.removeFirst();
+      _sendOffset = 0;
+    }
+
+    // the teletype did not accept everything
+    if (sent < total)
+      break;
   }
-  
-  SendJob& job = _pendingSendJobs.first();
 
-  
-  if (!writeStdin( job.data(), job.length() ))
+  if (_pendingSendJobs.isEmpty())
   {
-    qWarning("Pty::doSendJobs - Could not send input data to terminal process.");
-    return;
+    _bufferFull = false;
+    _writeNotifier->setEnabled(false);
+    emit bufferEmpty();
+  }
+  else
+  {
+    // wait for the terminal process to read some of its input
+    _bufferFull = true;
+    _sendStatistics.blockedWrites++;
+    _writeNotifier->setEnabled(true);
   }
-  _bufferFull = true;
 }
 
 void Pty::appendSendJob(const char* s, int len)
 {
-  _pendingSendJobs.append(SendJob(s,len));
+  if (!_pendingSendJobs.isEmpty() && _pendingSendJobs.last().length() < SEND_MERGE_SIZE)
+    _pendingSendJobs.last().append(s,len);
+  else
+    _pendingSendJobs.append(SendJob(s,len));
+
+  _pendingBytes += len;
+  _sendStatistics.maxQueuedBytes = qMax(_sendStatistics.maxQueuedBytes,_pendingBytes);
 }
 
 void Pty::sendData(const char* s, int len)
 {
+  if (len <= 0)
+    return;
+
   appendSendJob(s,len);
   if (!_bufferFull)
      doSendJobs();
 }
 
-void Pty::dataReceived(K3Process *,char *buf, int len)
+const SendStatistics& Pty::sendStatistics() const
 {
+  return _sendStatistics;
+}
+
+void Pty::resetSendStatistics()
+{
+  _sendStatistics = SendStatistics();
+}
+
+void Pty::setReceiver(Emulation* emulation)
+{
+  _receiver = emulation;
+}
+
+void Pty::receivedOutput(char *buf, int len)
+{
+  if (_receiver)
+    _receiver->receiveData(buf,len);
+
   emit receivedData(buf,len);
 }
 
@@ -37,6 +37,31 @@
 namespace Konsole
 {
 
+class Emulation;
+
+/**
+ * Statistics about the data which a Pty has sent to its terminal process.
+ * See Pty::sendStatistics()
+ */
+struct SendStatistics
+{
+    SendStatistics()
+        : bytes(0), writes(0), blockedWrites(0), maxQueuedBytes(0)
+    {}
+
+    /** The number of bytes written to the teletype. */
+    qint64 bytes;
+    /** The number of writes, each of which may send several queued blocks of data. */
+    int writes;
+    /** 
+     * The number of times the teletype did not accept all the queued data,
+     * so that the rest had to wait until the terminal process read some.
+     */
+    int blockedWrites;
+    /** The largest number of bytes which have been waiting to be sent. */
+    qint64 maxQueuedBytes;
+};
+
 /**
  * The Pty class is used to start the terminal process, 
  * send data to it, receive data from it and manipulate 
@@ -136,6 +161,22 @@ Q_OBJECT
      */
     bool bufferFull() const { return _bufferFull; }
 
+    /** 
+     * Returns statistics about the data sent to the terminal process 
+     * since the teletype was created or since resetSendStatistics() 
+     * was called.
+     */
+    const SendStatistics& sendStatistics() const;
+    /** Resets the statistics returned by sendStatistics() */
+    void resetSendStatistics();
+
+    /**
+     * Sets the emulation which the data received from the teletype is
+     * passed to directly, without going through a signal.  The data is
+     * still emitted with receivedData() afterwards.
+     */
+    void setReceiver(Emulation* emulation);
+
 
   public slots:
 
@@ -189,14 +230,16 @@ Q_OBJECT
     void bufferEmpty();
     
 
+  protected:
+    // called when data is received from the terminal process 
+    virtual void receivedOutput(char* buffer, int length);
+
   private slots:
     
     // called when terminal process exits
     void donePty();
-    // called when data is received from the terminal process 
-    void dataReceived(K3Process*, char* buffer, int length);
-    // sends the first enqueued buffer of data to the
-    // terminal process
+    // sends as much of the enqueued data to the terminal 
+    // process as the teletype accepts
     void doSendJobs();
     // called when the terminal process is ready to
     // receive more data
@@ -208,7 +251,7 @@ Q_OBJECT
     void addEnvironmentVariables(const QStringList& environment);
 
     // enqueues a buffer of data to be sent to the 
-    // terminal process
+    // terminal process, small buffers are merged
     void appendSendJob(const char* buffer, int length);
    
     // a buffer of data in the queue to be sent to the 
@@ -221,6 +264,13 @@ Q_OBJECT
 			memcpy( buffer.data() , b , len );
         }
 	
+		void append(const char* b, int len)
+		{
+			const int oldLength = buffer.size();
+			buffer.resize(oldLength + len);
+			memcpy( buffer.data() + oldLength , b , len );
+		}
+	
 		const char* data() const { return buffer.constData(); }
 		int length() const { return buffer.size(); }	
 	private:
@@ -228,7 +278,11 @@ Q_OBJECT
     };
 
     QList<SendJob> _pendingSendJobs;
+    int _sendOffset;        // the number of bytes of the first job already sent
+    qint64 _pendingBytes;   // the number of bytes still to be sent
     bool _bufferFull;
+    QSocketNotifier* _writeNotifier;
+    SendStatistics _sendStatistics;
 
     int  _windowColumns; 
     int  _windowLines;
@@ -236,6 +290,7 @@ Q_OBJECT
     bool _xonXoff;
     bool _utf8;
     KPty *_pty;
+    Emulation* _receiver;
 };
 
 }
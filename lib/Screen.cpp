@@ -70,9 +70,16 @@ Screen::Screen(int l, int c)
   : lines(l),
     columns(c),
     screenLines(new ImageLine[lines+1] ),
+    _firstScreenLine(0),
+    _changeStamp(1),
+    _imageChangeStamp(1),
+    _historyChangeStamp(1),
     _scrolledLines(0),
     _droppedLines(0),
     hist(new HistoryScrollNone()),
+    _historyIndex(0),
+    _historyLinesAdded(0),
+    _historyIndexNext(0),
     cuX(0), cuY(0),
     cu_re(0),
     tmargin(0), bmargin(0),
@@ -86,12 +93,19 @@ Screen::Screen(int l, int c)
     lastPos(-1)
 {
   lineProperties.resize(lines+1);
+  _lineStamps.resize(lines+1);
   for (int i=0;i<lines+1;i++)
+  {
           lineProperties[i]=LINE_DEFAULT;
+          _lineStamps[i]=_changeStamp;
+  }
 
   initTabStops();
   clearSelection();
   reset();
+
+  ExtendedCharTable::instance.addScreen(this);
+  TrueColorTable::instance.addScreen(this);
 }
 
 /*! Destructor
@@ -99,9 +113,13 @@ Screen::Screen(int l, int c)
 
 Screen::~Screen()
 {
+  ExtendedCharTable::instance.removeScreen(this);
+  TrueColorTable::instance.removeScreen(this);
+
   delete[] screenLines;
   delete[] tabstops;
   delete hist;
+  delete _historyIndex;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -254,30 +272,37 @@ void Screen::deleteChars(int n)
   if (n == 0) 
       n = 1; 
 
+  ImageLine& line = screenLines[lineSlot(cuY)];
+
   // if cursor is beyond the end of the line there is nothing to do
-  if ( cuX >= screenLines[cuY].count() )
+  if ( cuX >= line.count() )
       return;
 
-  if ( cuX+n >= screenLines[cuY].count() ) 
-       n = screenLines[cuY].count() - 1 - cuX;
+  if ( cuX+n >= line.count() ) 
+       n = line.count() - 1 - cuX;
 
   Q_ASSERT( n >= 0 );
-  Q_ASSERT( cuX+n < screenLines[cuY].count() );
+  Q_ASSERT( cuX+n < line.count() );
 
-  screenLines[cuY].remove(cuX,n);
+  line.remove(cuX,n);
+  markLineChanged(cuY);
 }
 
 void Screen::insertChars(int n)
 {
   if (n == 0) n = 1; // Default
 
-  if ( screenLines[cuY].size() < cuX )
-    screenLines[cuY].resize(cuX);
+  ImageLine& line = screenLines[lineSlot(cuY)];
+
+  if ( line.size() < cuX )
+    line.resize(cuX);
+
+  line.insert(cuX,n,' ');
 
-  screenLines[cuY].insert(cuX,n,' ');
+  if ( line.count() > columns )
+      line.resize(columns);
 
-  if ( screenLines[cuY].count() > columns )
-      screenLines[cuY].resize(columns);
+  markLineChanged(cuY);
 }
 
 void Screen::deleteLines(int n)
@@ -303,6 +328,9 @@ void Screen::insertLines(int n)
 
 void Screen::setMode(int m)
 {
+  if (m == MODE_Screen && !currParm.mode[m])
+    markImageChanged();
+
   currParm.mode[m] = true;
   switch(m)
   {
@@ -314,6 +342,9 @@ void Screen::setMode(int m)
 
 void Screen::resetMode(int m)
 {
+  if (m == MODE_Screen && currParm.mode[m])
+    markImageChanged();
+
   currParm.mode[m] = false;
   switch(m)
   {
@@ -332,6 +363,9 @@ void Screen::saveMode(int m)
 
 void Screen::restoreMode(int m)
 {
+  if (m == MODE_Screen && currParm.mode[m] != saveParm.mode[m])
+    markImageChanged();
+
   currParm.mode[m] = saveParm.mode[m];
 }
 
@@ -396,18 +430,25 @@ void Screen::resizeImage(int new_lines, int new_columns)
   
    ImageLine* newScreenLines = new ImageLine[new_lines+1];
    for (int i=0; i < qMin(lines-1,new_lines+1) ;i++)
-           newScreenLines[i]=screenLines[i];
+           qSwap(newScreenLines[i],screenLines[lineSlot(i)]);
    for (int i=lines;(i > 0) && (i<new_lines+1);i++)
            newScreenLines[i].resize( new_columns );
    
-  lineProperties.resize(new_lines+1);
-  for (int i=lines;(i > 0) && (i<new_lines+1);i++)
-          lineProperties[i] = LINE_DEFAULT;
+  QVarLengthArray<LineProperty,64> newLineProperties(new_lines+1);
+  for (int i=0;i<new_lines+1;i++)
+          newLineProperties[i] = (i < lines) ? lineProperties[lineSlot(i)] : (LineProperty)LINE_DEFAULT;
+  lineProperties = newLineProperties;
+
+  _lineStamps.resize(new_lines+1);
+  for (int i=0;i<new_lines+1;i++)
+          _lineStamps[i] = _changeStamp;
+  markImageChanged();
 
   clearSelection();
  
   delete[] screenLines; 
   screenLines = newScreenLines;
+  _firstScreenLine = 0;
 
   lines = new_lines;
   columns = new_columns;
@@ -464,11 +505,7 @@ void Screen::setDefaultMargins()
 
 void Screen::reverseRendition(Character& p) const
 { 
-	CharacterColor f = p.foregroundColor; 
-	CharacterColor b = p.backgroundColor;
-  	
-	p.foregroundColor = b; 
-	p.backgroundColor = f; //p->r &= ~RE_TRANSPARENT;
+	p.swapColors(); //p->r &= ~RE_TRANSPARENT;
 }
 
 void Screen::effectiveRendition()
@@ -499,6 +536,8 @@ void Screen::effectiveRendition()
  
   if (cu_re & RE_BOLD)
     ef_fg.toggleIntensive();
+
+  _effectiveChar = Character(' ',ef_fg,ef_bg,ef_re);
 }
 
 /*!
@@ -545,21 +584,23 @@ void Screen::copyFromScreen(Character* dest , int startLine , int count) const
 
     for (int line = startLine; line < (startLine+count) ; line++)
     {
-       int srcLineStartIndex  = line*columns;
-	   int destLineStartIndex = (line-startLine)*columns;
-
-       for (int column = 0; column < columns; column++)
-       { 
-		 int srcIndex = srcLineStartIndex + column; 
-		 int destIndex = destLineStartIndex + column;
+       const ImageLine& screenLine = screenLines[lineSlot(line)];
+       Character* destLine = dest + (line-startLine)*columns;
 
-         dest[destIndex] = screenLines[srcIndex/columns].value(srcIndex%columns,defaultChar);
+       const int length = qMin(columns,screenLine.count());
+       qCopy(screenLine.constData(),screenLine.constData()+length,destLine);
+       fillWithDefaultChar(destLine+length,columns-length);
 
-	     // invert selected text
-         if (sel_begin != -1 && isSelected(column,line + hist->getLines()))
-           reverseRendition(dest[destIndex]); 
+	   // invert selected text
+       const int histLine = line + hist->getLines();
+       if (sel_begin != -1 && histLine >= sel_TL/columns && histLine <= sel_BR/columns)
+       {
+         for (int column = 0; column < columns; column++)
+         {
+           if (isSelected(column,histLine))
+             reverseRendition(destLine[column]); 
+         }
        }
-
     }
 }
 
@@ -596,9 +637,9 @@ void Screen::getImage( Character* dest, int size, int startLine, int endLine ) c
   }
 
   // mark the character at the current cursor position
-  int cursorIndex = loc(cuX, cuY + linesInHistoryBuffer);
-  if(getMode(MODE_Cursor) && cursorIndex < columns*mergedLines)
-    dest[cursorIndex].rendition |= RE_CURSOR;
+  const int cursorLine = hist->getLines() + cuY - startLine;
+  if (getMode(MODE_Cursor) && cursorLine >= 0 && cursorLine < mergedLines)
+    dest[loc(qMin(cuX,columns-1),cursorLine)].rendition |= RE_CURSOR;
 }
 
 QVector<LineProperty> Screen::getLineProperties( int startLine , int endLine ) const
@@ -628,7 +669,7 @@ QVector<LineProperty> Screen::getLineProperties( int startLine , int endLine ) c
   const int firstScreenLine = startLine + linesInHistory - hist->getLines();
   for (int line = firstScreenLine; line < firstScreenLine+linesInScreen; line++)
 	{
-    result[index]=lineProperties[line];
+    result[index]=lineProperties[lineSlot(line)];
   	index++;
 	}
 
@@ -672,10 +713,14 @@ void Screen::BackSpace()
   cuX = qMax(0,cuX-1);
  // if (BS_CLEARS) image[loc(cuX,cuY)].character = ' ';
 
-  if (screenLines[cuY].size() < cuX+1)
-          screenLines[cuY].resize(cuX+1);
+  ImageLine& line = screenLines[lineSlot(cuY)];
+
+  if (line.size() < cuX+1)
+          line.resize(cuX+1);
 
-  if (BS_CLEARS) screenLines[cuY][cuX].character = ' ';
+  if (BS_CLEARS) line[cuX].character = ' ';
+
+  markLineChanged(cuY);
 }
 
 void Screen::Tabulate(int n)
@@ -751,87 +796,197 @@ void Screen::checkSelection(int from, int to)
   }
 }
 
-void Screen::ShowCharacter(unsigned short c)
+void Screen::ShowCharacter(uint c)
+{
+  displayCharacters(&c,1);
+}
+
+void Screen::displayCharacters(const uint* chars, int count)
 {
   // Note that VT100 does wrapping BEFORE putting the character.
   // This has impact on the assumption of valid cursor positions.
   // We indicate the fact that a newline has to be triggered by
   // putting the cursor one right to the last column of the screen.
 
-  int w = konsole_wcwidth(c);
+  QVarLengthArray<char,1024> widths(count);
+  for (int i = 0; i < count; i++)
+    widths[i] = qMax(konsole_wcwidth(chars[i]),0);
+
+  int i = 0;
+  while (i < count)
+  {
+    int w = widths[i];
+    if (w == 0)
+    {
+      composeCharacter(chars[i]);
+      i++;
+      continue;
+    }
+
+    if (cuX+w > columns) {
+      if (getMode(MODE_Wrap)) {
+        setLineProperty(LINE_WRAPPED,true);
+        NextLine();
+      }
+      else
+        cuX = columns-w;
+    }
 
-  if (w <= 0)
-     return;
+    // the run continues for as long as the characters fit onto the current line
+    int end = i+1;
+    int endX = cuX+w;
+    while (end < count && endX+widths[end] <= columns)
+      endX += widths[end++];
 
-  if (cuX+w > columns) {
-    if (getMode(MODE_Wrap)) {
-      lineProperties[cuY] = (LineProperty)(lineProperties[cuY] | LINE_WRAPPED);
-      NextLine();
+    // ensure current line vector has enough elements
+    ImageLine& line = screenLines[lineSlot(cuY)];
+    int size = line.size();
+    if (size == 0 && cuY > 0)
+    {
+          line.resize( qMax(screenLines[lineSlot(cuY-1)].size() , endX) );
     }
     else
-      cuX = columns-w;
-  }
+    {
+      if (size < endX)
+      {
+            line.resize(endX);
+      }
+    }
 
-  // ensure current line vector has enough elements
-  int size = screenLines[cuY].size();
-  if (size == 0 && cuY > 0)
-  {
-          screenLines[cuY].resize( qMax(screenLines[cuY-1].size() , cuX+w) );
+    if (getMode(MODE_Insert)) insertChars(endX-cuX);
+
+    // check if selection is still valid.
+    checkSelection(loc(cuX,cuY), loc(endX-1,cuY));
+
+    markLineChanged(cuY);
+
+    Character* data = line.data();
+    for ( ; i < end ; i++)
+    {
+      w = widths[i];
+      if (w == 0)
+      {
+        composeCharacter(chars[i]);
+        continue;
+      }
+
+      lastPos = loc(cuX,cuY);
+
+      Character& currentChar = data[cuX];
+      currentChar = _effectiveChar;
+      currentChar.character = chars[i];
+
+      // the remaining cells of a wide character are left empty
+      for (int j = 1; j < w; j++)
+      {
+        Character& ch = data[cuX + j];
+        ch = _effectiveChar;
+        ch.character = 0;
+      }
+      cuX += w;
+    }
   }
-  else
+}
+
+void Screen::compose(const QString& compose)
+{
+  const int length = compose.length();
+  for (int i = 0; i < length; i++)
   {
-    if (size < cuX+w)
+    uint c = compose[i].unicode();
+    if (compose[i].isHighSurrogate() && i+1 < length && compose[i+1].isLowSurrogate())
     {
-          screenLines[cuY].resize(cuX+w);
+      c = QChar::surrogateToUcs4(compose[i].unicode(),compose[i+1].unicode());
+      i++;
     }
+    composeCharacter(c);
   }
+}
 
-  if (getMode(MODE_Insert)) insertChars(w);
+void Screen::composeCharacter(uint c)
+{
+  // control characters have no width either, but they are not combined 
+  // with anything
+  if (c < 0xa0)
+    return;
 
-  lastPos = loc(cuX,cuY);
+  // find the character before the cursor, skipping the empty cell
+  // which follows a double width character
+  ImageLine& line = screenLines[lineSlot(cuY)];
+  int x = cuX - 1;
+  if (x > 0 && x < line.size() && line[x].character == 0)
+    x--;
+  if (x < 0 || x >= line.size())
+    return;
 
-  // check if selection is still valid.
-  checkSelection(lastPos, lastPos);
+  Character& base = line[x];
 
+  uint sequence[ExtendedCharTable::MAX_SEQUENCE_LENGTH];
+  ushort length = 0;
+  if (base.rendition & RE_EXTENDED_CHAR)
+  {
+    const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(base.character,length);
+    if (!chars || length == ExtendedCharTable::MAX_SEQUENCE_LENGTH)
+      return;
+    memcpy(sequence,chars,length*sizeof(uint));
+  }
+  else
+  {
+    sequence[length++] = base.character;
+  }
+  sequence[length++] = c;
 
-  Character& currentChar = screenLines[cuY][cuX];
+  const quint32 key = ExtendedCharTable::instance.createExtendedChar(sequence,length);
+  if (key == 0)
+    return;
 
-  currentChar.character = c;
-  currentChar.foregroundColor = ef_fg;
-  currentChar.backgroundColor = ef_bg;
-  currentChar.rendition = ef_re;
+  base.character = key;
+  base.rendition |= RE_EXTENDED_CHAR;
+  markLineChanged(cuY);
+}
 
-  int i = 0;
-  int newCursorX = cuX + w--;
-  while(w)
+void Screen::markExtendedChars(ExtendedCharTable& table)
+{
+  for (int y = 0; y < lines; y++)
   {
-     i++;
-   
-     if ( screenLines[cuY].size() < cuX + i + 1 )
-         screenLines[cuY].resize(cuX+i+1);
-     
-     Character& ch = screenLines[cuY][cuX + i];
-     ch.character = 0;
-     ch.foregroundColor = ef_fg;
-     ch.backgroundColor = ef_bg;
-     ch.rendition = ef_re;
+    const ImageLine& line = screenLines[lineSlot(y)];
+    table.markUsed(line.constData(),line.count());
+  }
 
-     w--;
+  // forget the keys whose last line has been dropped from the history
+  const qint64 firstHistoryLine = _historyLinesAdded - hist->getLines();
+  QMutableHashIterator<quint32,qint64> iter(_historyExtendedChars);
+  while (iter.hasNext())
+  {
+    iter.next();
+    if (iter.value() < firstHistoryLine)
+      iter.remove();
+    else
+      table.markUsed(iter.key());
   }
-  cuX = newCursorX;
+
+  hist->markExtendedChars(table);
 }
 
-void Screen::compose(const QString& /*compose*/)
+void Screen::markTrueColors(TrueColorTable& table)
 {
-   Q_ASSERT( 0 /*Not implemented yet*/ );
+  for (int y = 0; y < lines; y++)
+  {
+    const ImageLine& line = screenLines[lineSlot(y)];
+    table.markUsed(line.constData(),line.count());
+  }
+  table.markUsed(&_effectiveChar,1);
 
-/*  if (lastPos == -1)
-     return;
-     
-  QChar c(image[lastPos].character);
-  compose.prepend(c);
-  //compose.compose(); ### FIXME!
-  image[lastPos].character = compose[0].unicode();*/
+  const qint64 firstHistoryLine = _historyLinesAdded - hist->getLines();
+  QMutableHashIterator<quint16,qint64> iter(_historyTrueColors);
+  while (iter.hasNext())
+  {
+    iter.next();
+    if (iter.value() < firstHistoryLine)
+      iter.remove();
+    else
+      table.markUsed(iter.key());
+  }
 }
 
 int Screen::scrolledLines() const
@@ -988,14 +1143,16 @@ void Screen::clearImage(int loca, int loce, char c)
   //default character, the affected lines can simply be shrunk.
   bool isDefaultCh = (clearCh == Character());
 
+  markLinesChanged(topLine,bottomLine);
+
   for (int y=topLine;y<=bottomLine;y++)
   {
-        lineProperties[y] = 0;
+        lineProperties[lineSlot(y)] = 0;
 
         int endCol = ( y == bottomLine) ? loce%columns : columns-1;
         int startCol = ( y == topLine ) ? loca%columns : 0;
 
-        QVector<Character>& line = screenLines[y];
+        QVector<Character>& line = screenLines[lineSlot(y)];
 
         if ( isDefaultCh && endCol == columns-1 )
         {
@@ -1003,7 +1160,9 @@ void Screen::clearImage(int loca, int loce, char c)
         }
         else
         {
-            if (line.size() < endCol + 1)
+            // clearing up to the end of the line also discards any text
+            // beyond the right edge of the screen
+            if (line.size() < endCol + 1 || endCol == columns-1)
                 line.resize(endCol+1);
 
             Character* data = line.data();
@@ -1033,27 +1192,43 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
 
   Q_ASSERT( sourceBegin <= sourceEnd );
  
-  int lines=(sourceEnd-sourceBegin)/columns;
+  const int lineCount = (sourceEnd-sourceBegin)/columns;
+  const int destLine = dest/columns;
+  const int sourceLine = sourceBegin/columns;
 
-  //move screen image and line properties:
+  markLinesChanged(qMin(destLine,sourceLine),qMax(destLine,sourceLine)+lineCount);
+
+  //move screen image and line properties.
+  //the lines which are moved out of the way end up in the area which the
+  //source lines are moved away from, which the callers clear afterwards.
+  if (qMin(destLine,sourceLine) == 0 && qMax(destLine,sourceLine)+lineCount == lines-1)
+  {
+    //the whole screen is being scrolled, so rotating the ring of
+    //screen lines is enough
+    _firstScreenLine = lineSlot((sourceLine - destLine + lines) % lines);
+  }
   //the source and destination areas of the image may overlap, 
-  //so it matters that we do the copy in the right order - 
+  //so it matters that we do the swaps in the right order - 
   //forwards if dest < sourceBegin or backwards otherwise.
   //(search the web for 'memmove implementation' for details)
-  if (dest < sourceBegin)
+  else if (dest < sourceBegin)
   {
-    for (int i=0;i<=lines;i++)
+    for (int i=0;i<=lineCount;i++)
     {
-        screenLines[ (dest/columns)+i ] = screenLines[ (sourceBegin/columns)+i ];
-        lineProperties[(dest/columns)+i]=lineProperties[(sourceBegin/columns)+i];
+        const int destSlot = lineSlot(destLine+i);
+        const int sourceSlot = lineSlot(sourceLine+i);
+        qSwap(screenLines[destSlot],screenLines[sourceSlot]);
+        lineProperties[destSlot]=lineProperties[sourceSlot];
     }
   }
   else
   {
-    for (int i=lines;i>=0;i--)
+    for (int i=lineCount;i>=0;i--)
     {
-        screenLines[ (dest/columns)+i ] = screenLines[ (sourceBegin/columns)+i ];
-        lineProperties[(dest/columns)+i]=lineProperties[(sourceBegin/columns)+i];
+        const int destSlot = lineSlot(destLine+i);
+        const int sourceSlot = lineSlot(sourceLine+i);
+        qSwap(screenLines[destSlot],screenLines[sourceSlot]);
+        lineProperties[destSlot]=lineProperties[sourceSlot];
     }
   }
 
@@ -1068,6 +1243,8 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
   // Adjust selection to follow scroll.
   if (sel_begin != -1)
   {
+     markImageChanged();
+
      bool beginIsTL = (sel_begin == sel_TL);
      int diff = dest - sourceBegin; // Scroll by this amount
      int scr_TL=loc(0,hist->getLines());
@@ -1196,6 +1373,9 @@ void Screen::setBackColor(int space, int color)
 
 void Screen::clearSelection()
 {
+  if (sel_begin != -1)
+    markImageChanged();
+
   sel_BR = -1;
   sel_TL = -1;
   sel_begin = -1;
@@ -1238,6 +1418,8 @@ void Screen::setSelectionStart(/*const ScreenCursor& viewCursor ,*/ const int x,
   sel_BR = sel_begin;
   sel_TL = sel_begin;
   columnmode = mode;
+
+  markImageChanged();
 }
 
 void Screen::setSelectionEnd( const int x, const int y)
@@ -1259,6 +1441,8 @@ void Screen::setSelectionEnd( const int x, const int y)
     sel_TL = sel_begin;
     sel_BR = l;
   }
+
+  markImageChanged();
 }
 
 bool Screen::isSelected( const int x,const int y) const
@@ -1391,8 +1575,9 @@ void Screen::copyLineToStream(int line ,
 
             const int screenLine = line-hist->getLines();
 
-            Character* data = screenLines[screenLine].data();
-            int length = screenLines[screenLine].count();
+            const ImageLine& screenImageLine = screenLines[lineSlot(screenLine)];
+            const Character* data = screenImageLine.constData();
+            int length = screenImageLine.count();
 
 			//retrieve line from screen image
 			for (int i=start;i < qMin(start+count,length);i++)
@@ -1404,15 +1589,19 @@ void Screen::copyLineToStream(int line ,
 			count = qBound(0,count,length-start);
 
             Q_ASSERT( screenLine < lineProperties.count() );
-            currentLineProperties |= lineProperties[screenLine]; 
+            currentLineProperties |= lineProperties[lineSlot(screenLine)]; 
 		}
 
-		//do not decode trailing whitespace characters
-		for (int i=count-1 ; i >= 0; i--)
-				if (QChar(characterBuffer[i].character).isSpace())
-						count--;
-				else
-						break;
+		//do not decode trailing whitespace characters, unless the line is
+		//wrapped and they are part of the text continuing on the next line
+		if ( !(currentLineProperties & LINE_WRAPPED) )
+		{
+			for (int i=count-1 ; i >= 0; i--)
+					if (QChar(characterBuffer[i].character).isSpace())
+							count--;
+					else
+							break;
+		}
 
         // add new line character at end
         const bool omitLineBreak = (currentLineProperties & LINE_WRAPPED) ||
@@ -1458,6 +1647,7 @@ QString Screen::getHistoryLine(int no)
   sel_begin = loc(0,no);
   sel_TL = sel_begin;
   sel_BR = loc(columns-1,no);
+  markImageChanged();
   return selectedText(false);
 }
 
@@ -1468,13 +1658,40 @@ void Screen::addHistLine()
 
   if (hasScroll())
   {
+    _historyChangeStamp = _changeStamp;
+
     int oldHistLines = hist->getLines();
 
-    hist->addCellsVector(screenLines[0]);
-    hist->addLine( lineProperties[0] & LINE_WRAPPED );
+    hist->addCellsVector(screenLines[lineSlot(0)]);
+    hist->addLine( lineProperties[lineSlot(0)] & LINE_WRAPPED );
 
     int newHistLines = hist->getLines();
 
+    // while the index is built, the line is added by updateHistoryIndex()
+    if (_historyIndex && _historyIndexNext == _historyLinesAdded)
+    {
+      _historyIndexNext++;
+      const ImageLine& line = screenLines[lineSlot(0)];
+      _historyIndex->addLine(line.constData(),line.count(),
+                             lineProperties[lineSlot(0)] & LINE_WRAPPED);
+      while (_historyIndex->lineCount() > newHistLines)
+        _historyIndex->removeFirstLine();
+    }
+
+    const ImageLine& addedLine = screenLines[lineSlot(0)];
+    RecordTrueColor recordColor = { this };
+    for (int i = 0; i < addedLine.count(); i++)
+    {
+      if (addedLine[i].rendition & RE_EXTENDED_CHAR)
+        _historyExtendedChars.insert(addedLine[i].character,_historyLinesAdded);
+      if (addedLine[i].hasTrueColor())
+      {
+        Character cell = addedLine[i];
+        cell.remapTrueColors(recordColor);
+      }
+    }
+    _historyLinesAdded++;
+
     bool beginIsTL = (sel_begin == sel_TL);
 
     // If the history is full, increment the count
@@ -1494,6 +1711,8 @@ void Screen::addHistLine()
 
     if (sel_begin != -1)
     {
+       markImageChanged();
+
        // Scroll selection in history up
        int top_BR = loc(0, 1+newHistLines);
 
@@ -1530,6 +1749,8 @@ int Screen::getHistLines()
 void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
 {
   clearSelection();
+  markImageChanged();
+  _historyChangeStamp = _changeStamp;
 
   if ( copyPreviousScroll )
     hist = t.scroll(hist);
@@ -1538,9 +1759,65 @@ void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
       HistoryScroll* oldScroll = hist;
       hist = t.scroll(0);
       delete oldScroll;
+      _historyExtendedChars.clear();
+      _historyTrueColors.clear();
+  }
+
+  if (_historyIndex)
+  {
+    _historyIndex->clear();
+    _historyIndexNext = _historyLinesAdded - hist->getLines();
+  }
+}
+
+void Screen::setHistoryIndexEnabled(bool enable)
+{
+  if (enable == (_historyIndex != 0))
+    return;
+
+  if (enable)
+  {
+    _historyIndex = new HistoryTextIndex();
+    _historyIndexNext = _historyLinesAdded - hist->getLines();
+  }
+  else
+  {
+    delete _historyIndex;
+    _historyIndex = 0;
   }
 }
 
+bool Screen::updateHistoryIndex(int maxLines)
+{
+  Q_ASSERT( _historyIndex );
+
+  const qint64 firstHistoryLine = _historyLinesAdded - hist->getLines();
+
+  // forget the lines which have been dropped from the history since they
+  // were indexed
+  if (_historyIndexNext < firstHistoryLine)
+  {
+    while (_historyIndex->lineCount() > 0)
+      _historyIndex->removeFirstLine();
+    _historyIndexNext = firstHistoryLine;
+  }
+  while (_historyIndex->lineCount() > _historyIndexNext - firstHistoryLine)
+    _historyIndex->removeFirstLine();
+
+  QVarLengthArray<Character,1024> cells;
+  for (int i = 0; i < maxLines && _historyIndexNext < _historyLinesAdded; i++)
+  {
+    const int y = _historyIndexNext - firstHistoryLine;
+    const int length = hist->getLineLen(y);
+    cells.resize(length);
+    hist->getCells(y,0,length,cells.data());
+    _historyIndex->addLine(cells.constData(),length,hist->isWrappedLine(y));
+    _historyIndexNext++;
+  }
+
+  return _historyIndexNext == _historyLinesAdded;
+}
+
 bool Screen::hasScroll()
 {
   return hist->hasScroll();
@@ -1553,13 +1830,17 @@ const HistoryType& Screen::getScroll()
 
 void Screen::setLineProperty(LineProperty property , bool enable)
 {
+	LineProperty& currentProperties = lineProperties[lineSlot(cuY)];
+
+	markLineChanged(cuY);
+
 	if ( enable )
 	{
-		lineProperties[cuY] = (LineProperty)(lineProperties[cuY] | property);
+		currentProperties = (LineProperty)(currentProperties | property);
 	}
 	else
 	{
-		lineProperties[cuY] = (LineProperty)(lineProperties[cuY] & ~property);
+		currentProperties = (LineProperty)(currentProperties & ~property);
 	}
 }
 void Screen::fillWithDefaultChar(Character* dest, int count)
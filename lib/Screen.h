@@ -26,6 +26,7 @@
 #define SCREEN_H
 
 // Qt
+#include <QtCore/QHash>
 #include <QtCore/QRect>
 #include <QtCore/QTextStream>
 #include <QtCore/QVarLengthArray>
@@ -341,10 +342,44 @@ public:
      * is inserted at the current cursor position, otherwise it will replace the 
      * character already at the current cursor position.  
      */ 
-    void ShowCharacter(unsigned short c);
+    void ShowCharacter(uint c);
+
+    /**
+     * Displays a run of characters starting at the current cursor position,
+     * using the current rendition and colors.  This behaves exactly like calling
+     * ShowCharacter() for each character in @p chars, but the wrapping, resizing
+     * and selection checks are performed once for each part of the run which
+     * fits onto a line rather than once per character.
+     *
+     * @param chars The unicode characters to display
+     * @param count The number of characters in @p chars
+     */
+    void displayCharacters(const uint* chars, int count);
     
-    // Do composition with last shown character FIXME: Not implemented yet for KDE 4
+    /**
+     * Combines the characters in @p compose, such as combining marks, with
+     * the character before the cursor position.  The combined characters
+     * are stored in ExtendedCharTable::instance.
+     *
+     * displayCharacters() does this for characters with a width of zero.
+     */
     void compose(const QString& compose);
+
+    /** 
+     * Marks the combined characters used by the screen and its history as
+     * used in @p table.  See ExtendedCharTable::addScreen()
+     *
+     * The history is not read, instead the screen remembers the combined 
+     * characters of the lines added to it until the last of those lines 
+     * has been dropped.
+     */
+    void markExtendedChars(ExtendedCharTable& table);
+    /**
+     * Marks the RGB colors used by the screen and its history as used in 
+     * @p table, in the same way as markExtendedChars().  See 
+     * TrueColorTable::addScreen()
+     */
+    void markTrueColors(TrueColorTable& table);
     
     /** 
      * Resizes the image to a new fixed size of @p new_lines by @p new_columns.  
@@ -376,6 +411,29 @@ public:
      * other attributes control the size of characters in the line.
      */
     QVector<LineProperty> getLineProperties( int startLine , int endLine ) const;
+
+    /**
+     * Returns a stamp which identifies the current state of the screen image
+     * and starts a new one.  Pass the stamp to isLineChanged() later on to find
+     * out which lines of the image have been modified in the meantime.
+     */
+    quint32 takeChangeStamp() { return _changeStamp++; }
+    /**
+     * Returns true if line @p line of the screen (where 0 is the first line of
+     * the screen rather than of the history) may look different in the image
+     * returned by getImage() than it did when @p stamp was returned by
+     * takeChangeStamp().
+     */
+    bool isLineChanged(int line, quint32 stamp) const
+    { return qMax(_lineStamps[line],_imageChangeStamp) > stamp; }
+    /**
+     * Returns true if lines have been added to or dropped from the history,
+     * or the history lines may look different in the image (for example
+     * because the selection changed), since @p stamp was returned by
+     * takeChangeStamp().
+     */
+    bool isHistoryChanged(quint32 stamp) const
+    { return qMax(_historyChangeStamp,_imageChangeStamp) > stamp; }
 	
 
     /** Return the number of lines. */
@@ -398,6 +456,30 @@ public:
      */
     bool hasScroll();
 
+    /**
+     * Sets whether the screen keeps a plain text index of the lines in the
+     * history, which can be searched without decoding the history again.
+     *
+     * The index starts out empty and is built from the current history by
+     * calling updateHistoryIndex().  Once it has caught up with the history
+     * it is updated as lines are added to the history.
+     */
+    void setHistoryIndexEnabled(bool enable);
+    /**
+     * Adds up to @p maxLines lines of the history which are not in the 
+     * index yet to the index, oldest first.  Returns true if the index 
+     * then contains all lines of the history.
+     *
+     * The history index must be enabled.
+     */
+    bool updateHistoryIndex(int maxLines);
+    /**
+     * Returns the plain text index of the history, or 0 if it is not enabled.
+     * Once updateHistoryIndex() has returned true, the lines of the history 
+     * are the last HistoryTextIndex::lineCount() lines in the index.
+     */
+    const HistoryTextIndex* historyIndex() const { return _historyIndex; }
+
     /** 
      * Sets the start of the selection.
      *
@@ -576,6 +658,10 @@ private:
     void effectiveRendition();
     void reverseRendition(Character& p) const;
 
+    // combines a character with a width of zero with the character before
+    // the cursor
+    void composeCharacter(uint c);
+
     bool isSelectionValid() const;
 
 	// copies 'count' lines from the screen buffer into 'dest',
@@ -593,6 +679,37 @@ private:
     typedef QVector<Character> ImageLine;      // [0..columns]
     ImageLine*          screenLines;    // [lines]
 
+    // the first 'lines' slots of screenLines and lineProperties form a ring,
+    // so that scrolling the whole screen only needs to move the slot of the
+    // first line.  lineSlot() maps a line of the screen to its slot.
+    // The extra slot at the end lies outside the ring and always maps to itself.
+    int _firstScreenLine;
+    int lineSlot(int line) const
+    {
+        Q_ASSERT( line >= 0 && line <= lines );
+        if ( line == lines )
+            return lines;
+        const int slot = _firstScreenLine + line;
+        return slot < lines ? slot : slot - lines;
+    }
+
+    // change stamps, see takeChangeStamp() and isLineChanged().
+    // _lineStamps is indexed by line rather than by slot and records the
+    // stamp of the last modification of each line, _imageChangeStamp the
+    // last change which affected the whole image, such as a new selection,
+    // and _historyChangeStamp the last change of the history.
+    quint32 _changeStamp;
+    quint32 _imageChangeStamp;
+    quint32 _historyChangeStamp;
+    QVarLengthArray<quint32,64> _lineStamps;
+    void markLineChanged(int line) { _lineStamps[line] = _changeStamp; }
+    void markLinesChanged(int first, int last)
+    {
+        for (int line = first; line <= last; line++)
+            _lineStamps[line] = _changeStamp;
+    }
+    void markImageChanged() { _imageChangeStamp = _changeStamp; }
+
     int _scrolledLines;
     QRect _lastScrolledRegion;
 
@@ -602,6 +719,25 @@ private:
 	
     // history buffer ---------------
     HistoryScroll *hist;
+    HistoryTextIndex* _historyIndex;
+    // the number of lines added to 'hist' since it was created
+    qint64 _historyLinesAdded;
+    // the next line of 'hist' to add to _historyIndex, counted like 
+    // _historyLinesAdded.  the index is complete when the two are equal
+    qint64 _historyIndexNext;
+    // the extended character keys used by the history and the number of 
+    // the last line using each key, counted like _historyLinesAdded
+    QHash<quint32,qint64> _historyExtendedChars;
+    // the same for the TrueColorTable indexes used by the history
+    QHash<quint16,qint64> _historyTrueColors;
+    // records the colors passed to Character::remapTrueColors() in 
+    // _historyTrueColors and leaves them unchanged
+    struct RecordTrueColor
+    {
+      Screen* screen;
+      quint16 operator()(quint16 index) 
+      { screen->_historyTrueColors.insert(index,screen->_historyLinesAdded); return index; }
+    };
     
     // cursor location
     int cuX;
@@ -634,6 +770,8 @@ private:
     CharacterColor ef_fg;      // These are derived from
     CharacterColor ef_bg;      // the cu_* variables above
     quint8 ef_re;      // to speed up operation
+    Character _effectiveChar; // a blank with the effective colors and rendition,
+                              // copied into the image by displayCharacters()
 
     //
     // save cursor, rendition & states ------------
@@ -35,6 +35,10 @@ ScreenWindow::ScreenWindow(QObject* parent)
 	, _windowBuffer(0)
 	, _windowBufferSize(0)
 	, _bufferNeedsUpdate(true)
+	, _bufferChangeStamp(0)
+	, _bufferLine(-1)
+	, _bufferEndLine(-1)
+	, _bufferCursorLine(-1)
 	, _windowLines(1)
     , _currentLine(0)
     , _trackOutput(true)
@@ -50,6 +54,10 @@ void ScreenWindow::setScreen(Screen* screen)
     Q_ASSERT( screen );
 
     _screen = screen;
+
+    // the change stamps of the new screen are unrelated to those of the old
+    // one, so the whole buffer is copied again by the next getImage() call
+    _bufferLine = -1;
 }
 
 Screen* ScreenWindow::screen() const
@@ -61,29 +69,76 @@ Character* ScreenWindow::getImage()
 {
 	// reallocate internal buffer if the window size has changed
 	int size = windowLines() * windowColumns();
+	bool fullUpdate = false;
 	if (_windowBuffer == 0 || _windowBufferSize != size) 
 	{
 		delete[] _windowBuffer;
 		_windowBufferSize = size;
 		_windowBuffer = new Character[size];
 		_bufferNeedsUpdate = true;
+		fullUpdate = true;
 	}
 
 	 if (!_bufferNeedsUpdate)
 		return _windowBuffer;
- 
-	_screen->getImage(_windowBuffer,size,
-					  currentLine(),endWindowLine());
 
-	// this window may look beyond the end of the screen, in which 
-	// case there will be an unused area which needs to be filled
-	// with blank characters
-	fillUnusedArea();
+	const int histLines = _screen->getHistLines();
+	const int startLine = currentLine();
+	const int endLine = endWindowLine();
+	const int cursorLine = histLines + _screen->getCursorY();
+	const quint32 stamp = _screen->takeChangeStamp();
+
+	if (_changedLines.size() != windowLines())
+		_changedLines.fill(false,windowLines());
+
+	if (fullUpdate || startLine != _bufferLine || endLine != _bufferEndLine ||
+		_screen->isHistoryChanged(_bufferChangeStamp))
+	{
+		_screen->getImage(_windowBuffer,size,startLine,endLine);
+
+		// this window may look beyond the end of the screen, in which 
+		// case there will be an unused area which needs to be filled
+		// with blank characters
+		fillUnusedArea();
+
+		_changedLines.fill(true);
+	}
+	else
+	{
+		// copy the lines which have changed, plus the lines which the cursor 
+		// has moved from and to
+		const int columns = windowColumns();
+		for (int line = qMax(startLine,histLines); line <= endLine; line++)
+		{
+			if ( _screen->isLineChanged(line - histLines,_bufferChangeStamp) ||
+				 line == cursorLine || line == _bufferCursorLine )
+			{
+				const int y = line - startLine;
+				_screen->getImage(_windowBuffer + y*columns,columns,line,line);
+				_changedLines.setBit(y);
+			}
+		}
+	}
+
+	_bufferChangeStamp = stamp;
+	_bufferLine = startLine;
+	_bufferEndLine = endLine;
+	_bufferCursorLine = cursorLine;
 
 	_bufferNeedsUpdate = false;
 	return _windowBuffer;
 }
 
+const QBitArray& ScreenWindow::changedLines() const
+{
+	return _changedLines;
+}
+
+void ScreenWindow::resetChangedLines()
+{
+	_changedLines.fill(false);
+}
+
 void ScreenWindow::fillUnusedArea()
 {
 	int screenEndLine = _screen->getHistLines() + _screen->getLines() - 1;
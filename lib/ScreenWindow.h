@@ -23,6 +23,7 @@
 #define SCREENWINDOW_H
 
 // Qt
+#include <QtCore/QBitArray>
 #include <QtCore/QObject>
 #include <QtCore/QPoint>
 #include <QtCore/QRect>
@@ -82,6 +83,15 @@ public:
      */
     Character* getImage();
 
+    /**
+     * Returns the lines of the image returned by getImage() which have been
+     * updated since the last call to resetChangedLines().  The other lines 
+     * have the same contents as they had at that time.
+     */
+    const QBitArray& changedLines() const;
+    /** Clears the set of changed lines returned by changedLines() */
+    void resetChangedLines();
+
     /**
      * Returns the line attributes associated with the lines of characters which
      * are currently visible through this window
@@ -245,6 +255,15 @@ private:
 	int _windowBufferSize;
 	bool _bufferNeedsUpdate;
 
+	// state of the screen when the buffer was last updated, only the lines 
+	// which have changed since then are copied into the buffer unless the
+	// window has moved or the history has changed
+	quint32 _bufferChangeStamp;
+	int _bufferLine;
+	int _bufferEndLine;
+	int _bufferCursorLine;
+	QBitArray _changedLines;
+
 	int  _windowLines;
     int  _currentLine; // see scrollTo() , currentLine()
     bool _trackOutput; // see setTrackOutput() , trackOutput() 
@@ -106,10 +106,12 @@ Session::Session() :
     //connect teletype to emulation backend
     _shellProcess->setUtf8Mode(_emulation->utf8());
 
+    _shellProcess->setReceiver(_emulation);
     connect( _shellProcess,SIGNAL(receivedData(const char*,int)),this,
             SLOT(onReceiveBlock(const char*,int)) );
     connect( _emulation,SIGNAL(sendData(const char*,int)),_shellProcess,
             SLOT(sendData(const char*,int)) );
+    connect( _shellProcess,SIGNAL(bufferEmpty()),_emulation,SLOT(sendBufferEmpty()) );
     connect( _emulation,SIGNAL(lockPtyRequest(bool)),_shellProcess,SLOT(lockPty(bool)) );
     connect( _emulation,SIGNAL(useUtf8Request(bool)),_shellProcess,SLOT(setUtf8Mode(bool)) );
 
@@ -220,6 +222,8 @@ void Session::addView(TerminalDisplay* widget)
                SLOT(sendMouseEvent(int,int,int,int)) );
         connect( widget , SIGNAL(sendStringToEmu(const char*)) , _emulation ,
                SLOT(sendString(const char*)) );
+        connect( widget , SIGNAL(pasteRequest(const QString&)) , _emulation ,
+               SLOT(paste(const QString&)) );
 
         // allow emulation to notify view when the foreground process
         // indicates whether or not it is interested in mouse signals
@@ -753,6 +757,11 @@ void Session::sendText(const QString &text) const
   _emulation->sendText(text);
 }
 
+void Session::cancelPaste()
+{
+  _emulation->cancelPaste();
+}
+
 Session::~Session()
 {
   delete _emulation;
@@ -769,6 +778,9 @@ QString Session::profileKey() const { return _profileKey; }
 
 void Session::done(int exitStatus)
 {
+  // the rest of a paste can no longer be sent to the terminal process
+  _emulation->cancelPaste();
+
   if (!_autoClose)
   {
     _userTitle = ("<Finished>");
@@ -896,6 +908,26 @@ void Session::clearHistory()
     _emulation->clearHistory();
 }
 
+const FrameStatistics& Session::frameStatistics() const
+{
+  return _emulation->frameStatistics();
+}
+
+void Session::resetFrameStatistics()
+{
+  _emulation->resetFrameStatistics();
+}
+
+const SendStatistics& Session::sendStatistics() const
+{
+  return _shellProcess->sendStatistics();
+}
+
+void Session::resetSendStatistics()
+{
+  _shellProcess->resetSendStatistics();
+}
+
 QStringList Session::arguments() const
 {
   return _arguments;
@@ -1079,8 +1111,10 @@ void Session::zmodemFinished()
 */
 void Session::onReceiveBlock( const char* buf, int len )
 {
-    _emulation->receiveData( buf, len );
-    emit receivedData( QString::fromLatin1( buf, len ) );
+    // the teletype passes the data to the emulation itself, it only
+    // needs to be copied if something listens to receivedData()
+    if ( receivers(SIGNAL(receivedData(const QString&))) > 0 )
+        emit receivedData( QString::fromLatin1( buf, len ) );
 }
 
 QSize Session::size()
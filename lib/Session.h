@@ -42,6 +42,8 @@ namespace Konsole
 {
 
 class Emulation;
+struct FrameStatistics;
+struct SendStatistics;
 class Pty;
 class TerminalDisplay;
 //class ZModemDialog;
@@ -221,6 +223,23 @@ public:
    */
   void clearHistory();
 
+  /**
+   * Returns statistics about how often and how promptly the output of
+   * this session has been sent to its views.  
+   * See Emulation::frameStatistics()
+   */
+  const FrameStatistics& frameStatistics() const;
+  /** Resets the statistics returned by frameStatistics() */
+  void resetFrameStatistics();
+
+  /**
+   * Returns statistics about the input which has been sent to the
+   * terminal process.  See Pty::sendStatistics()
+   */
+  const SendStatistics& sendStatistics() const;
+  /** Resets the statistics returned by sendStatistics() */
+  void resetSendStatistics();
+
   /**
    * Enables monitoring for activity in the session.
    * This will cause notifySessionState() to be emitted
@@ -314,6 +333,12 @@ public:
    */
   void sendText(const QString& text) const;
 
+  /**
+   * Stops sending text which the user has pasted into one of the
+   * session's views.  See Emulation::cancelPaste()
+   */
+  void cancelPaste();
+
   /**
    * Returns the process id of the terminal process.
    * This is the id used by the system API to refer to the process.
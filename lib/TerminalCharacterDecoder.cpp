@@ -86,12 +86,16 @@ void PlainTextDecoder::decodeLine(const Character* const characters, int count,
         if (characters[i].rendition & RE_EXTENDED_CHAR)
         {
             ushort extendedCharLength = 0;
-            const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(characters[i].character, extendedCharLength);
+            const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(characters[i].character, extendedCharLength);
             if (chars)
             {
-                const QString s = QString::fromUtf16(chars, extendedCharLength);
+                const QString s = QString::fromUcs4(chars, extendedCharLength);
                 plainText.append(s);
-                i += string_width(s);
+                i += qMax(1,string_width(s));
+            }
+            else
+            {
+                i++;
             }
         }
         else
@@ -103,8 +107,12 @@ void PlainTextDecoder::decodeLine(const Character* const characters, int count,
             // This feels tricky, but otherwise leading "whitespaces" may be
             // lost in some situation. One typical example is copying the result
             // of `dialog --infobox "qwe" 10 10` .
-                plainText.append( QChar(characters[i].character) );
-                i += qMax(1,konsole_wcwidth(characters[i].character));
+                const uint ucs = characters[i].character;
+                if (ucs > 0xffff)
+                    plainText.append( QString::fromUcs4(&ucs,1) );
+                else
+                    plainText.append( QChar(ucs) );
+                i += qMax(1,konsole_wcwidth(ucs));
         }
     }
 
@@ -158,19 +166,20 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
 		
 	for (int i=0;i<count;i++)
 	{
-		QChar ch(characters[i].character);
+		const uint ucs = characters[i].character;
+		QChar ch(ucs);
 
 		//check if appearance of character is different from previous char
 		if ( characters[i].rendition != _lastRendition  ||
-		     characters[i].foregroundColor != _lastForeColor  ||
-			 characters[i].backgroundColor != _lastBackColor )
+		     characters[i].foregroundColor() != _lastForeColor  ||
+			 characters[i].backgroundColor() != _lastBackColor )
 		{
 			if ( _innerSpanOpen )
 					closeSpan(text);
 
 			_lastRendition = characters[i].rendition;
-			_lastForeColor = characters[i].foregroundColor;
-			_lastBackColor = characters[i].backgroundColor;
+			_lastForeColor = characters[i].foregroundColor();
+			_lastBackColor = characters[i].backgroundColor();
 			
 			//build up style string
 			QString style;
@@ -200,7 +209,7 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
 		}
 
 		//handle whitespace
-		if (ch.isSpace())
+		if (ucs <= 0xffff && ch.isSpace())
 			spaceCount++;
 		else
 			spaceCount = 0;
@@ -210,7 +219,15 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
 		if (spaceCount < 2)
 		{
 			//escape HTML tag characters and just display others as they are
-			if ( ch == '<' )
+			if ( characters[i].rendition & RE_EXTENDED_CHAR )
+			{
+				ushort extendedCharLength = 0;
+				const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(characters[i].character, extendedCharLength);
+				text.append(QString::fromUcs4(chars, extendedCharLength));
+			}
+			else if ( ucs > 0xffff )
+				text.append(QString::fromUcs4(&ucs,1));
+			else if ( ch == '<' )
 				text.append("&lt;");
 			else if (ch == '>')
 					text.append("&gt;");
@@ -58,6 +58,14 @@ Graphics View Framework Port TODO:
 #include "TerminalCharacterDecoder.h"
 #include "ColorTables.h"
 
+// System
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 using namespace Konsole;
 
 #ifndef loc
@@ -141,6 +149,7 @@ void TerminalDisplay::setScreenWindow(ScreenWindow* window)
     }
 
     _screenWindow = window;
+    _compareAllLines = true;
 
     if ( window )
     {
@@ -166,6 +175,8 @@ void TerminalDisplay::setColorTable(const ColorEntry table[])
   p.setColor( QPalette::Window, _colorTable[DEFAULT_BACK_COLOR].color );
   setPalette( p );
 
+  _lineCache.clear();
+
   // Avoid propagating the palette change to the scroll bar 
   // _scrollBar->setPalette( QApplication::palette() );  
 
@@ -190,7 +201,22 @@ void TerminalDisplay::setColorTable(const ColorEntry table[])
    QCodec.
 */
 
-static inline bool isLineChar(quint16 c) { return ((c & 0xFF80) == 0x2500);}
+static inline bool isLineChar(quint32 c) { return ((c & ~0x7Fu) == 0x2500);}
+
+// appends a character to a UTF-16 buffer, characters outside of the
+// basic multilingual plane are stored as a pair of surrogates
+static inline void appendCharacter(QChar* buffer, int& length, quint32 c)
+{
+    if (c > 0xffff)
+    {
+        buffer[length++] = QChar::highSurrogate(c);
+        buffer[length++] = QChar::lowSurrogate(c);
+    }
+    else
+    {
+        buffer[length++] = QChar((ushort)c);
+    }
+}
 static inline bool isLineCharString(const QString& string)
 {
 		return (string.length() > 0) && (isLineChar(string.at(0).unicode()));
@@ -236,6 +262,10 @@ void TerminalDisplay::fontChange(const QFont&)
 
   _fontAscent = fm.ascent();
 
+  _glyphCache.setFont(font(),_fontWidth,_fontHeight);
+  _lineCache.clear();
+  _sparePixmaps.clear();
+
   emit changedFontMetricSignal( _fontHeight, _fontWidth );
   propagateSize();
   update();
@@ -277,6 +307,68 @@ void TerminalDisplay::setFont(const QFont &)
   // ignore font change request if not coming from konsole itself
 }
 
+// Compares the characters first..last of two lines one by one and marks
+// those which differ in 'dirty'.  Returns true if any character differs.
+static bool compareCells(const Character* newLine, const Character* oldLine,
+                         int first, int last, char* dirty)
+{
+  bool changed = false;
+  for (int x = first; x <= last; x++)
+  {
+    if (newLine[x] != oldLine[x])
+    {
+      dirty[x] = true;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+// Compares 'count' characters of two lines and marks those which differ in
+// 'dirty'.  Returns true if any character differs.
+//
+// The lines are compared as plain memory first, 16 bytes at a time where SSE2
+// or NEON are available, and only the characters in the blocks which differ 
+// are compared individually.
+static bool compareLines(const Character* newLine, const Character* oldLine,
+                         int count, char* dirty)
+{
+  const uchar* newBytes = reinterpret_cast<const uchar*>(newLine);
+  const uchar* oldBytes = reinterpret_cast<const uchar*>(oldLine);
+  const int size = count * sizeof(Character);
+  const int cellSize = sizeof(Character);
+
+  bool changed = false;
+  int offset = 0;
+
+#if defined(__SSE2__)
+  for ( ; offset + 16 <= size; offset += 16)
+  {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(newBytes + offset));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(oldBytes + offset));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(a,b)) != 0xFFFF)
+      changed |= compareCells(newLine,oldLine,offset/cellSize,(offset+15)/cellSize,dirty);
+  }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+  for ( ; offset + 16 <= size; offset += 16)
+  {
+    const uint8x16_t equal = vceqq_u8(vld1q_u8(newBytes + offset),vld1q_u8(oldBytes + offset));
+    uint8x8_t allEqual = vand_u8(vget_low_u8(equal),vget_high_u8(equal));
+    allEqual = vpmin_u8(allEqual,allEqual);
+    allEqual = vpmin_u8(allEqual,allEqual);
+    allEqual = vpmin_u8(allEqual,allEqual);
+    if (vget_lane_u8(allEqual,0) != 0xFF)
+      changed |= compareCells(newLine,oldLine,offset/cellSize,(offset+15)/cellSize,dirty);
+  }
+#endif
+
+  // the rest of the line, or all of it without SIMD instructions
+  if ( offset < size && memcmp(newBytes + offset,oldBytes + offset,size - offset) != 0 )
+    changed |= compareCells(newLine,oldLine,offset/cellSize,count-1,dirty);
+
+  return changed;
+}
+
 /* ------------------------------------------------------------------------- */
 /*                                                                           */
 /*                         Constructor / Destructor                          */
@@ -288,6 +380,9 @@ TerminalDisplay::TerminalDisplay(QGraphicsWidget *parent)
 ,_screenWindow(0)
 ,_allowBell(true)
  //,_gridLayout(0)
+,_lineCache(LINE_CACHE_SIZE)
+,_lineCacheHits(0)
+,_lineCacheMisses(0)
 ,_fontHeight(1)
 ,_fontWidth(1)
 ,_fontAscent(1)
@@ -300,6 +395,8 @@ TerminalDisplay::TerminalDisplay(QGraphicsWidget *parent)
 ,_image(0)
 ,_randomSeed(0)
 ,_resizing(false)
+,_compareAllLines(true)
+,_trueColorGeneration(TrueColorTable::instance.generation())
 ,_terminalSizeHint(false)
 ,_terminalSizeStartup(true)
 ,_bidiEnabled(false)
@@ -592,6 +689,11 @@ void TerminalDisplay::setOpacity(qreal opacity)
     _blendColor = color.rgba();
 }
 
+bool TerminalDisplay::hasOpaqueBackground() const
+{
+    return !HAVE_TRANSPARENCY || qAlpha(_blendColor) == 0xff;
+}
+
 void TerminalDisplay::drawBackground(QPainter& painter, const QRectF& rect, const QColor& backgroundColor, bool useOpacitySetting )
 {
         // the area of the widget showing the contents of the terminal display is drawn
@@ -705,7 +807,7 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
        painter.setFont(font);
     }
 
-    const CharacterColor& textColor = ( invertCharacterColor ? style->backgroundColor : style->foregroundColor );
+    const CharacterColor textColor = ( invertCharacterColor ? style->backgroundColor() : style->foregroundColor() );
     const QColor color = textColor.color(_colorTable);
 
     QPen pen = painter.pen();
@@ -720,12 +822,27 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
     }
     else
 	{
+		// text in a mono-spaced font is copied from pre-rendered glyphs, one
+		// character per cell, unless it is scaled or some of its characters 
+		// cannot be cached.  The glyphs are rendered onto the background of
+		// the cells, which drawTextFragment() has drawn in a single colour
+		// unless the cell contains the cursor or shows the translucent 
+		// background of the display
+		const QColor background = style->backgroundColor().color(_colorTable);
+		const bool cached = _fixedFont &&
+		                    !(style->rendition & RE_CURSOR) &&
+		                    (hasOpaqueBackground() || background != palette().background().color()) &&
+		                    painter.worldTransform().type() <= QTransform::TxTranslate &&
+		                    text.length() * _fontWidth == qRound(rect.width()) &&
+		                    _glyphCache.drawText(painter,rect.topLeft(),text,useBold,useUnderline,color,background);
+
 		// the drawText(rect,flags,string) overload is used here with null flags
 		// instead of drawText(rect,string) because the (rect,string) overload causes 
 		// the application's default layout direction to be used instead of 
 		// the widget-specific layout direction, which should always be
 		// Qt::LeftToRight for this widget
-        painter.drawText(rect,0,text);
+        if (!cached)
+            painter.drawText(rect,0,text);
 	}
 }
 
@@ -737,8 +854,8 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
     painter.save();
 
     // setup painter 
-    const QColor foregroundColor = style->foregroundColor.color(_colorTable);
-    const QColor backgroundColor = style->backgroundColor.color(_colorTable);
+    const QColor foregroundColor = style->foregroundColor().color(_colorTable);
+    const QColor backgroundColor = style->backgroundColor().color(_colorTable);
     
     // draw background if different from the display's background color
     if ( backgroundColor != palette().background().color() )
@@ -919,7 +1036,8 @@ void TerminalDisplay::updateImage()
   // optimization - scroll the existing image where possible and 
   // avoid expensive text drawing for parts of the image that 
   // can simply be moved up or down
-  scrollImage( _screenWindow->scrollCount() ,
+  const int scrollCount = _screenWindow->scrollCount();
+  scrollImage( scrollCount ,
                _screenWindow->scrollRegion() );
   _screenWindow->resetScrollCount();
 
@@ -927,6 +1045,22 @@ void TerminalDisplay::updateImage()
   int lines = _screenWindow->windowLines();
   int columns = _screenWindow->windowColumns();
 
+  // lines which the screen window has not updated since the last call are
+  // still the same as in _image, unless _image has just been scrolled
+  const QBitArray& changedLines = _screenWindow->changedLines();
+
+  // the indexes of RGB colors which were discarded from the color table 
+  // may have been reused for other colors, so that cells which have the 
+  // same value as those in _image can still be drawn differently
+  const bool colorsReused = (_trueColorGeneration != TrueColorTable::instance.generation());
+  if (colorsReused)
+  {
+    _trueColorGeneration = TrueColorTable::instance.generation();
+    _lineCache.clear();
+  }
+
+  const bool compareAllLines = (scrollCount != 0) || _compareAllLines || colorsReused;
+
   setScroll( _screenWindow->currentLine() , _screenWindow->lineCount() );
 
   if (!_image)
@@ -935,7 +1069,7 @@ void TerminalDisplay::updateImage()
   Q_ASSERT( this->_usedLines <= this->_lines );
   Q_ASSERT( this->_usedColumns <= this->_columns );
 
-  int y,x,len;
+  int y,x;
 
   QPointF tL  = contentsRect().topLeft();
 
@@ -943,14 +1077,9 @@ void TerminalDisplay::updateImage()
   int    tLy = tL.y();
   _hasBlinker = false;
 
-  CharacterColor cf;       // undefined
-  CharacterColor _clipboard;       // undefined
-  int cr  = -1;   // undefined
-
   const int linesToUpdate = qMin(this->_lines, qMax(0,lines  ));
   const int columnsToUpdate = qMin(this->_columns,qMax(0,columns));
 
-  QChar *disstrU = new QChar[columnsToUpdate];
   char *dirtyMask = new char[columnsToUpdate+2]; 
   QRegion dirtyRegion;
 
@@ -965,75 +1094,40 @@ void TerminalDisplay::updateImage()
     const Character* const newLine = &newimg[y*columns];
 
     bool updateLine = false;
-    
-    // The dirty mask indicates which characters need repainting. We also
-    // mark surrounding neighbours dirty, in case the character exceeds
-    // its cell boundaries
-    memset(dirtyMask, 0, columnsToUpdate+2);
-   
-    for( x = 0 ; x < columnsToUpdate ; x++)
+
+    if ( !compareAllLines && (y >= changedLines.size() || !changedLines.testBit(y)) )
     {
-        if ( newLine[x] != currentLine[x] ) 
+        if (!_resizing)
+        for (x = 0; x < columnsToUpdate && !_hasBlinker; x++)
+            _hasBlinker |= (currentLine[x].rendition & RE_BLINK);
+
+        if (_lineProperties.count() > y && (_lineProperties[y] & LINE_DOUBLEHEIGHT))
         {
-            dirtyMask[x] = true;
+            dirtyLineCount++;
+            dirtyRegion |= QRect( _leftMargin+tLx , 
+                                  _topMargin+tLy+_fontHeight*y , 
+                                  _fontWidth * columnsToUpdate , 
+                                  _fontHeight );
         }
+        continue;
     }
+    
+    // The dirty mask indicates which characters need repainting
+    memset(dirtyMask, 0, columnsToUpdate+2);
+    const bool lineChanged = compareLines(newLine,currentLine,columnsToUpdate,dirtyMask);
 
     if (!_resizing) // not while _resizing, we're expecting a paintEvent
-    for (x = 0; x < columnsToUpdate; x++)
     {
-      _hasBlinker |= (newLine[x].rendition & RE_BLINK);
-    
-      // Start drawing if this character or the next one differs.
-      // We also take the next one into account to handle the situation
-      // where characters exceed their cell width.
-      if (dirtyMask[x])
-      {
-        quint16 c = newLine[x+0].character;
-        if ( !c )
-            continue;
-        int p = 0;
-        disstrU[p++] = c; //fontMap(c);
-        bool lineDraw = isLineChar(c);
-        bool doubleWidth = (x+1 == columnsToUpdate) ? false : (newLine[x+1].character == 0);
-        cr = newLine[x].rendition;
-        _clipboard = newLine[x].backgroundColor;
-        if (newLine[x].foregroundColor != cf) cf = newLine[x].foregroundColor;
-        int lln = columnsToUpdate - x;
-        for (len = 1; len < lln; len++)
-        {
-            const Character& ch = newLine[x+len];
-
-            if (!ch.character)
-                continue; // Skip trailing part of multi-col chars.
-
-			bool nextIsDoubleWidth = (x+len+1 == columnsToUpdate) ? false : (newLine[x+len+1].character == 0);
-
-            if (  ch.foregroundColor != cf || 
-                  ch.backgroundColor != _clipboard || 
-                  ch.rendition != cr ||
-                  !dirtyMask[x+len] || 
-                  isLineChar(c) != lineDraw || 
-                  nextIsDoubleWidth != doubleWidth )
-            break;
-
-          disstrU[p++] = c; //fontMap(c);
-        }
+      for (x = 0; x < columnsToUpdate && !_hasBlinker; x++)
+        _hasBlinker |= (newLine[x].rendition & RE_BLINK);
 
-        QString unistr(disstrU, p);
-
-        bool saveFixedFont = _fixedFont;
-        if (lineDraw)
-           _fixedFont = false;
-        if (doubleWidth)
-           _fixedFont = false;
-
-		updateLine = true;
-
-		_fixedFont = saveFixedFont;
-        x += len - 1;
+      // the line must be repainted if any character has changed, other than
+      // the trailing parts of multi-column characters
+      if (lineChanged)
+      {
+        for (x = 0; x < columnsToUpdate && !updateLine; x++)
+          updateLine = dirtyMask[x] && newLine[x].character;
       }
-      
     }
 
 	//both the top and bottom halves of double height _lines must always be redrawn
@@ -1043,6 +1137,8 @@ void TerminalDisplay::updateImage()
     if (_lineProperties.count() > y)
         updateLine |= (_lineProperties[y] & LINE_DOUBLEHEIGHT);
 
+    updateLine |= colorsReused;
+
     // if the characters on the line are different in the old and the new _image
     // then this line must be repainted.    
     if (updateLine)
@@ -1061,7 +1157,8 @@ void TerminalDisplay::updateImage()
 
     // replace the line of characters in the old _image with the 
     // current line of the new _image 
-    memcpy((void*)currentLine,(const void*)newLine,columnsToUpdate*sizeof(Character));
+    if (lineChanged)
+      memcpy((void*)currentLine,(const void*)newLine,columnsToUpdate*sizeof(Character));
   }
 
   // if the new _image is smaller than the previous _image, then ensure that the area
@@ -1089,10 +1186,12 @@ void TerminalDisplay::updateImage()
   // update the parts of the display which have changed
   update(dirtyRegion.boundingRect());
 
+  _screenWindow->resetChangedLines();
+  _compareAllLines = false;
+
   if ( _hasBlinker && !_blinkTimer->isActive()) _blinkTimer->start( BLINK_DELAY ); 
   if (!_hasBlinker && _blinkTimer->isActive()) { _blinkTimer->stop(); _blinking = false; }
   delete[] dirtyMask;
-  delete[] disstrU;
 
 }
 
@@ -1229,7 +1328,7 @@ void TerminalDisplay::paintFilters(QPainter& painter)
     getCharacterPosition( cursorPos , cursorLine , cursorColumn );
     Character cursorCharacter = _image[loc(cursorColumn,cursorLine)];
 
-    painter.setPen( QPen(cursorCharacter.foregroundColor.color(colorTable())) );
+    painter.setPen( QPen(cursorCharacter.foregroundColor().color(colorTable())) );
 
     // iterate over hotspots identified by the display's currently active filters 
     // and draw appropriate visuals to indicate the presence of the hotspot
@@ -1316,74 +1415,96 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRectF &rect)
   int rlx = qMin(qreal(_usedColumns-1), qMax(zero, (rect.right()  - tLx - _leftMargin ) / _fontWidth));
   int rly = qMin(qreal(_usedLines-1),  qMax(zero, (rect.bottom() - tLy - _topMargin  ) / _fontHeight));
 
-  const int bufferSize = _usedColumns;
-  QChar *disstrU = new QChar[bufferSize];
+  const bool transformed = paint.worldTransform().type() > QTransform::TxTranslate;
+
+  // characters outside of the basic multilingual plane take up two entries
+  // and combined characters are drawn on their own
+  QChar *disstrU = new QChar[2*qMax(_usedColumns,(int)ExtendedCharTable::MAX_SEQUENCE_LENGTH)];
   for (int y = luy; y <= rly; y++)
   {
-    quint16 c = _image[loc(lux,y)].character;
-    int x = lux;
-    if(!c && x)
-      x--; // Search for start of multi-column character
-    for (; x <= rlx; x++)
-    {
-      int len = 1;
-      int p = 0;
+    const QPoint lineOrigin(_leftMargin+tLx , _topMargin+tLy+_fontHeight*y);
+
+    if ( transformed || !drawCachedLine(paint,lineOrigin,y,lux,rlx,disstrU) )
+        drawLine(paint,lineOrigin,y,lux,rlx,disstrU);
+
+    //double-height _lines are represented by two adjacent _lines 
+    //containing the same characters
+    //both _lines will have the LINE_DOUBLEHEIGHT attribute.  
+    //If the current line has the LINE_DOUBLEHEIGHT attribute, 
+    //we can therefore skip the next line
+    if (y < _lineProperties.size()-1 && (_lineProperties[y] & LINE_DOUBLEHEIGHT))
+        y++;
+  }
+  delete [] disstrU;
+}
 
-      // is this a single character or a sequence of characters ?
-      if ( _image[loc(x,y)].rendition & RE_EXTENDED_CHAR )
-      {
-        // sequence of characters
-        ushort extendedCharLength = 0;
-        ushort* chars = ExtendedCharTable::instance
-                            .lookupExtendedChar(_image[loc(x,y)].charSequence,extendedCharLength);
-        for ( int index = 0 ; index < extendedCharLength ; index++ ) 
-        {
-            Q_ASSERT( p < bufferSize );
-            disstrU[p++] = chars[index];
-        }
-      }
-      else
+void TerminalDisplay::drawLine(QPainter &paint, const QPoint& origin, int y,
+                               int startColumn, int endColumn, QChar* buffer)
+{
+  quint32 c = _image[loc(startColumn,y)].character;
+  int x = startColumn;
+  if(!c && x)
+    x--; // Search for start of multi-column character
+  for (; x <= endColumn; x++)
+  {
+    int len = 1;
+    int p = 0;
+
+    // is this a single character or a sequence of characters ?
+    if ( _image[loc(x,y)].rendition & RE_EXTENDED_CHAR )
+    {
+      // sequence of characters
+      ushort extendedCharLength = 0;
+      const uint* chars = ExtendedCharTable::instance
+                          .lookupExtendedChar(_image[loc(x,y)].character,extendedCharLength);
+      for ( int index = 0 ; index < extendedCharLength ; index++ ) 
+          appendCharacter(buffer,p,chars[index]);
+
+      // combined characters are not drawn as line graphics
+      c = 0;
+    }
+    else
+    {
+      // single character
+      c = _image[loc(x,y)].character;
+      if (c)
       {
-        // single character
-        c = _image[loc(x,y)].character;
-        if (c)
-        {
-             Q_ASSERT( p < bufferSize );
-             disstrU[p++] = c; //fontMap(c);
-        }
+           Q_ASSERT( p < 2*_usedColumns );
+           appendCharacter(buffer,p,c); //fontMap(c);
       }
+    }
 
-      bool lineDraw = isLineChar(c);
-      bool doubleWidth = (_image[ qMin(loc(x,y)+1,_imageSize) ].character == 0);
-      CharacterColor currentForeground = _image[loc(x,y)].foregroundColor;
-      CharacterColor currentBackground = _image[loc(x,y)].backgroundColor;
-      quint8 currentRendition = _image[loc(x,y)].rendition;
+    bool lineDraw = isLineChar(c);
+    bool doubleWidth = (_image[ qMin(loc(x,y)+1,_imageSize) ].character == 0);
+    const Character& currentStyle = _image[loc(x,y)];
 	  
-      while (x+len <= rlx &&
-             _image[loc(x+len,y)].foregroundColor == currentForeground &&
-             _image[loc(x+len,y)].backgroundColor == currentBackground &&
-             _image[loc(x+len,y)].rendition == currentRendition &&
-             (_image[ qMin(loc(x+len,y)+1,_imageSize) ].character == 0) == doubleWidth &&
-             isLineChar( c = _image[loc(x+len,y)].character) == lineDraw) // Assignment!
-      {
-        if (c)
-          disstrU[p++] = c; //fontMap(c);
-        if (doubleWidth) // assert((_image[loc(x+len,y)+1].character == 0)), see above if condition
-          len++; // Skip trailing part of multi-column character
-        len++;
-      }
-      if ((x+len < _usedColumns) && (!_image[loc(x+len,y)].character))
-        len++; // Adjust for trailing part of multi-column character
-
-   	     bool save__fixedFont = _fixedFont;
-         if (lineDraw)
-            _fixedFont = false;
-         if (doubleWidth)
-            _fixedFont = false;
-         QString unistr(disstrU,p);
-
-         // Create a text scaling matrix for double width and double height lines.
-         QMatrix textScale;
+    // combined characters are drawn on their own, which also stops runs of
+    // other characters at the next one because its rendition differs
+    while (!(currentStyle.rendition & RE_EXTENDED_CHAR) &&
+           x+len <= endColumn &&
+           _image[loc(x+len,y)].hasSameColors(currentStyle) &&
+           _image[loc(x+len,y)].rendition == currentStyle.rendition &&
+           (_image[ qMin(loc(x+len,y)+1,_imageSize) ].character == 0) == doubleWidth &&
+           isLineChar( c = _image[loc(x+len,y)].character) == lineDraw) // Assignment!
+    {
+      if (c)
+        appendCharacter(buffer,p,c); //fontMap(c);
+      if (doubleWidth) // assert((_image[loc(x+len,y)+1].character == 0)), see above if condition
+        len++; // Skip trailing part of multi-column character
+      len++;
+    }
+    if ((x+len < _usedColumns) && (!_image[loc(x+len,y)].character))
+      len++; // Adjust for trailing part of multi-column character
+
+ 	     bool save__fixedFont = _fixedFont;
+       if (lineDraw)
+          _fixedFont = false;
+       if (doubleWidth)
+          _fixedFont = false;
+       QString unistr(buffer,p);
+
+       // Create a text scaling matrix for double width and double height lines.
+       QMatrix textScale;
 	 bool scaled = false;
 
 		 if (y < _lineProperties.size())
@@ -1404,48 +1525,132 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRectF &rect)
 		     paint.setWorldMatrix(textScale, true);
 
 		 //calculate the area in which the text will be drawn
-		 QRect textArea = QRect( _leftMargin+tLx+_fontWidth*x , 
-					_topMargin+tLy+_fontHeight*y , 
+		 QRect textArea = QRect( origin.x()+_fontWidth*x , 
+					origin.y() , 
 					_fontWidth*len, 
 					_fontHeight);
 		
 		 //move the calculated area to take account of scaling applied to the painter.
 		 //the position of the area from the origin (0,0) is scaled 
-         //by the opposite of whatever
+       //by the opposite of whatever
 		 //transformation has been applied to the painter.  this ensures that 
 		 //painting does actually start from textArea.topLeft() 
-         //(instead of textArea.topLeft() * painter-scale)	
+       //(instead of textArea.topLeft() * painter-scale)	
 		 textArea.moveTopLeft( textScale.inverted().map(textArea.topLeft()) );
 		 
 		 //paint text fragment
-         drawTextFragment(	paint,
-                		    textArea,
-                		    unistr, 
+       drawTextFragment(	paint,
+              		    textArea,
+              		    unistr, 
 					    	&_image[loc(x,y)] ); //, 
 						    //0, 
 						    //!_isPrinting );
-         
+       
 		 _fixedFont = save__fixedFont;
-     
+   
 		 //reset back to single-width, single-height _lines 
 		 if (scaled)
 		     paint.setWorldMatrix(textScale.inverted(), true);
 
-		 if (y < _lineProperties.size()-1)
-		 {
-			//double-height _lines are represented by two adjacent _lines 
-            //containing the same characters
-			//both _lines will have the LINE_DOUBLEHEIGHT attribute.  
-            //If the current line has the LINE_DOUBLEHEIGHT attribute, 
-            //we can therefore skip the next line
-			if (_lineProperties[y] & LINE_DOUBLEHEIGHT)
-				y++;
-		 }
 		 
 	    x += len - 1;
+  }
+}
+
+// hashes the contents of a line of the image, see drawCachedLine().
+// Character has no padding, so all of its bytes are significant
+static uint lineHash(const Character* line, int count)
+{
+  const uchar* bytes = reinterpret_cast<const uchar*>(line);
+  const int size = count * sizeof(Character);
+
+  uint hash = 2166136261u;
+  for (int i = 0; i < size; i++)
+    hash = (hash ^ bytes[i]) * 16777619u;
+  return hash;
+}
+
+bool TerminalDisplay::drawCachedLine(QPainter &paint, const QPoint& origin, int y,
+                                     int startColumn, int endColumn, QChar* buffer)
+{
+  const Character* line = &_image[loc(0,y)];
+  const int length = _usedColumns;
+
+  // the lines are rendered onto the opaque background colour so that the
+  // text keeps its subpixel anti-aliasing, which rules out a translucent
+  // background
+  if (!hasOpaqueBackground())
+    return false;
+
+  // lines which are scaled, which contain the cursor or blinking text, or
+  // whose look depends on more than their characters are drawn directly
+  if (y < _lineProperties.size() && (_lineProperties[y] & (LINE_DOUBLEWIDTH | LINE_DOUBLEHEIGHT)))
+    return false;
+
+  for (int x = 0; x < length; x++)
+  {
+    if (line[x].rendition & (RE_CURSOR | RE_BLINK))
+      return false;
+  }
+
+  const uint key = lineHash(line,length);
+  QPixmap pixmap;
+
+  RenderedLine* cached = _lineCache.object(key);
+  if ( cached && cached->cells.count() == length && 
+       cached->pixmap.height() == _fontHeight &&
+       qEqual(line,line+length,cached->cells.constBegin()) )
+  {
+    _lineCacheHits++;
+    pixmap = cached->pixmap;
+  }
+  else
+  {
+    _lineCacheMisses++;
+
+    // only lines which are drawn completely are rendered into the cache,
+    // otherwise rendering the rest of the line would cost more than it saves
+    if (startColumn != 0 || endColumn != length-1)
+      return false;
+
+    // while the display follows the output, most lines change before they
+    // are drawn again, so a line is only cached when it is drawn a second time
+    if (_screenWindow && _screenWindow->trackOutput() && !_uncachedLines.contains(key))
+    {
+      if (_uncachedLines.count() >= MAX_UNCACHED_LINES)
+        _uncachedLines.clear();
+      _uncachedLines.insert(key);
+      return false;
     }
+    _uncachedLines.remove(key);
+
+    const QSize size(length*_fontWidth,_fontHeight);
+    while (pixmap.isNull() && !_sparePixmaps.isEmpty())
+    {
+      const QPixmap spare = _sparePixmaps.takeLast();
+      if (spare.size() == size)
+        pixmap = spare;
+    }
+    if (pixmap.isNull())
+      pixmap = QPixmap(size);
+    pixmap.fill(palette().background().color());
+
+    QPainter linePainter(&pixmap);
+    linePainter.setFont(paint.font());
+    drawLine(linePainter,QPoint(0,0),y,0,length-1,buffer);
+    linePainter.end();
+
+    RenderedLine* rendered = new RenderedLine(&_sparePixmaps);
+    rendered->cells.resize(length);
+    qCopy(line,line+length,rendered->cells.begin());
+    rendered->pixmap = pixmap;
+    _lineCache.insert(key,rendered,qMax(1,pixmap.width()*pixmap.height()*pixmap.depth()/8/1024));
   }
-  delete [] disstrU;
+
+  paint.drawPixmap(origin + QPoint(startColumn*_fontWidth,0),
+                   pixmap,
+                   QRect(startColumn*_fontWidth,0,(endColumn-startColumn+1)*_fontWidth,_fontHeight));
+  return true;
 }
 
 void TerminalDisplay::blinkEvent()
@@ -1919,9 +2124,9 @@ void TerminalDisplay::extendSelection( const QPointF& position )
     QPoint left = left_not_right ? here : _iPntSelCorr;
     i = loc(left.x(),left.y());
     if (i>=0 && i<=_imageSize) {
-      selClass = charClass(_image[i].character);
+      selClass = charClass(_image[i]);
       while ( ((left.x()>0) || (left.y()>0 && (_lineProperties[left.y()-1] & LINE_WRAPPED) )) 
-                      && charClass(_image[i-1].character) == selClass )
+                      && charClass(_image[i-1]) == selClass )
       { i--; if (left.x()>0) left.rx()--; else {left.rx()=_usedColumns-1; left.ry()--;} }
     }
 
@@ -1929,9 +2134,9 @@ void TerminalDisplay::extendSelection( const QPointF& position )
     QPoint right = left_not_right ? _iPntSelCorr : here;
     i = loc(right.x(),right.y());
     if (i>=0 && i<=_imageSize) {
-      selClass = charClass(_image[i].character);
+      selClass = charClass(_image[i]);
       while( ((right.x()<_usedColumns-1) || (right.y()<_usedLines-1 && (_lineProperties[right.y()] & LINE_WRAPPED) )) 
-                      && charClass(_image[i+1].character) == selClass )
+                      && charClass(_image[i+1]) == selClass )
       { i++; if (right.x()<_usedColumns-1) right.rx()++; else {right.rx()=0; right.ry()++; } }
     }
 
@@ -2001,10 +2206,10 @@ void TerminalDisplay::extendSelection( const QPointF& position )
     {
       i = loc(right.x(),right.y());
       if (i>=0 && i<=_imageSize) {
-        selClass = charClass(_image[i-1].character);
+        selClass = charClass(_image[i-1]);
        /* if (selClass == ' ')
         {
-          while ( right.x() < _usedColumns-1 && charClass(_image[i+1].character) == selClass && (right.y()<_usedLines-1) && 
+          while ( right.x() < _usedColumns-1 && charClass(_image[i+1]) == selClass && (right.y()<_usedLines-1) && 
                           !(_lineProperties[right.y()] & LINE_WRAPPED))
           { i++; right.rx()++; }
           if (right.x() < _usedColumns-1)
@@ -2181,12 +2386,12 @@ void TerminalDisplay::mouseDoubleClickEvent(QGraphicsSceneMouseEvent* ev)
   _wordSelectionMode = true;
 
   // find word boundaries...
-  int selClass = charClass(_image[i].character);
+  int selClass = charClass(_image[i]);
   {
      // find the start of the word
      int x = bgnSel.x();
      while ( ((x>0) || (bgnSel.y()>0 && (_lineProperties[bgnSel.y()-1] & LINE_WRAPPED) )) 
-					 && charClass(_image[i-1].character) == selClass )
+					 && charClass(_image[i-1]) == selClass )
      {  
        i--; 
        if (x>0) 
@@ -2205,7 +2410,7 @@ void TerminalDisplay::mouseDoubleClickEvent(QGraphicsSceneMouseEvent* ev)
      i = loc( endSel.x(), endSel.y() );
      x = endSel.x();
      while( ((x<_usedColumns-1) || (endSel.y()<_usedLines-1 && (_lineProperties[endSel.y()] & LINE_WRAPPED) )) 
-					 && charClass(_image[i+1].character) == selClass )
+					 && charClass(_image[i+1]) == selClass )
      { 
          i++; 
          if (x<_usedColumns-1) 
@@ -2287,13 +2492,13 @@ void TerminalDisplay::mouseTripleClickEvent(QGraphicsSceneMouseEvent* ev)
   if (_tripleClickMode == SelectForwardsFromCursor) {
     // find word boundary start
     int i = loc(_iPntSel.x(),_iPntSel.y());
-    int selClass = charClass(_image[i].character);
+    int selClass = charClass(_image[i]);
     int x = _iPntSel.x();
     
     while ( ((x>0) || 
              (_iPntSel.y()>0 && (_lineProperties[_iPntSel.y()-1] & LINE_WRAPPED) )
             ) 
-            && charClass(_image[i-1].character) == selClass )
+            && charClass(_image[i-1]) == selClass )
     {
         i--; 
         if (x>0) 
@@ -2333,8 +2538,27 @@ bool TerminalDisplay::focusNextPrevChild( bool next )
 }
 
 
-int TerminalDisplay::charClass(quint16 ch) const
+int TerminalDisplay::charClass(const Character& character) const
 {
+    // combined characters belong to the class of their base character
+    quint32 ch = character.character;
+    if ( character.rendition & RE_EXTENDED_CHAR )
+    {
+        ushort extendedCharLength = 0;
+        const uint* chars = ExtendedCharTable::instance
+                                .lookupExtendedChar(character.character,extendedCharLength);
+        ch = chars ? chars[0] : ' ';
+    }
+
+    if ( ch > 0xffff )
+    {
+        const QChar::Category category = QChar::category(ch);
+        if ( (category >= QChar::Number_DecimalDigit && category <= QChar::Number_Other) ||
+             (category >= QChar::Letter_Uppercase && category <= QChar::Letter_Other) )
+            return 'a';
+        return 1;
+    }
+
     QChar qch=QChar(ch);
     if ( qch.isSpace() ) return ' ';
 
@@ -2373,16 +2597,13 @@ void TerminalDisplay::emitSelection(bool useXselection,bool appendReturn)
   if ( !_screenWindow ) 
       return;
 
-  // Paste Clipboard by simulating keypress events
   QString text = QApplication::clipboard()->text(useXselection ? QClipboard::Selection :
                                                                  QClipboard::Clipboard);
   if(appendReturn)
     text.append("\r");
   if ( ! text.isEmpty() )
   {
-    text.replace("\n", "\r");
-    QKeyEvent e(QEvent::KeyPress, 0, Qt::NoModifier, text);
-    emit keyPressedSignal(&e); // expose as a big fat keypress event
+    emit pasteRequest(text);
     
     _screenWindow->clearSelection();
   }
@@ -2695,12 +2916,10 @@ void TerminalDisplay::clearImage()
   // We initialize _image[_imageSize] too. See makeImage()
   for (int i = 0; i <= _imageSize; i++)
   {
-    _image[i].character = ' ';
-    _image[i].foregroundColor = CharacterColor(COLOR_SPACE_DEFAULT,
-                                               DEFAULT_FORE_COLOR);
-    _image[i].backgroundColor = CharacterColor(COLOR_SPACE_DEFAULT,
-                                               DEFAULT_BACK_COLOR);
-    _image[i].rendition = DEFAULT_RENDITION;
+    _image[i] = Character(' ',
+                          CharacterColor(COLOR_SPACE_DEFAULT,DEFAULT_FORE_COLOR),
+                          CharacterColor(COLOR_SPACE_DEFAULT,DEFAULT_BACK_COLOR),
+                          DEFAULT_RENDITION);
   }
 }
 
@@ -2761,6 +2980,7 @@ void TerminalDisplay::makeImage()
   _image = new Character[_imageSize+1];
 
   clearImage();
+  _compareAllLines = true;
 }
 
 // calculate the needed size
@@ -28,13 +28,19 @@
 
 // Qt
 #include <QtGui/QColor>
+#include <QtGui/QPixmap>
+#include <QtCore/QCache>
 #include <QtCore/QPointer>
+#include <QtCore/QList>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
 #include <QtGui/QGraphicsWidget>
 
 // Konsole
 #include "Filter.h"
 #include "Character.h"
 #include "ColorTables.h"
+#include "GlyphCache.h"
 
 class QDrag;
 class QDragEnterEvent;
@@ -385,6 +391,20 @@ public:
     void setBidiEnabled(bool set) { _bidiEnabled=set; }
     bool isBidiEnabled() { return _bidiEnabled; }
 
+    /** 
+     * Returns the number of lines which have been repainted by copying them
+     * from the cache of rendered lines since the display was created or 
+     * resetLineCacheStatistics() was last called.
+     */
+    qint64 lineCacheHits() const { return _lineCacheHits; }
+    /**
+     * Returns the number of lines which could have been repainted from the cache 
+     * of rendered lines but were not found in it.  See lineCacheHits()
+     */
+    qint64 lineCacheMisses() const { return _lineCacheMisses; }
+    /** Resets the counters returned by lineCacheHits() and lineCacheMisses() */
+    void resetLineCacheStatistics() { _lineCacheHits = 0; _lineCacheMisses = 0; }
+
     /**
      * Sets the terminal screen section which is displayed in this widget.
      * When updateImage() is called, the display fetches the latest character image from the
@@ -477,6 +497,12 @@ signals:
      */
     void keyPressedSignal(QKeyEvent *e);
 
+    /**
+     * Emitted when the user pastes the clipboard or the selection into 
+     * the terminal.  See Emulation::paste()
+     */
+    void pasteRequest(const QString& text);
+
     /**
      * Emitted when the user presses the suspend or resume flow control key combinations 
      * 
@@ -547,7 +573,7 @@ protected:
       QDrag           *dragObject;
     } dragInfo;
 
-    virtual int charClass(quint16) const;
+    virtual int charClass(const Character& character) const;
 
     void clearImage();
 
@@ -578,6 +604,20 @@ protected:
     // fragments according to their colors and styles and calls
     // drawTextFragment() to draw the fragments 
     void drawContents(QPainter &paint, const QRectF &rect);
+    // draws columns 'startColumn' to 'endColumn' of line 'y' of the image,
+    // 'origin' is the top-left corner of the line and 'buffer' must have room
+    // for a line of characters
+    void drawLine(QPainter &paint, const QPoint& origin, int y, 
+                  int startColumn, int endColumn, QChar* buffer);
+    // draws part of a line like drawLine() by copying it from the cache of
+    // rendered lines, rendering the line into the cache first if necessary.
+    // returns false if the line was not drawn because it cannot be cached
+    bool drawCachedLine(QPainter &paint, const QPoint& origin, int y,
+                        int startColumn, int endColumn, QChar* buffer);
+    // returns false if the display's background is drawn translucent, in
+    // which case the glyph and line caches are not used because they are
+    // rendered onto an opaque background
+    bool hasOpaqueBackground() const;
     // draws a section of text, all the text in this section
     // has a common color and style
     void drawTextFragment(QPainter& painter, const QRectF& rect, 
@@ -650,6 +690,30 @@ protected:
 #endif
 
     bool _fixedFont; // has fixed pitch
+    GlyphCache _glyphCache; // pre-rendered characters of the current font
+
+    // a line of the image and its rendered pixmap, see drawCachedLine()
+    struct RenderedLine
+    {
+        RenderedLine(QList<QPixmap>* spare) : sparePixmaps(spare) {}
+        // keeps the pixmap for rendering another line when the line is 
+        // discarded from the cache
+        ~RenderedLine()
+        {
+            if (sparePixmaps->count() < MAX_SPARE_PIXMAPS)
+                sparePixmaps->append(pixmap);
+        }
+
+        QVector<Character> cells;
+        QPixmap pixmap;
+        QList<QPixmap>* sparePixmaps;
+    };
+    QList<QPixmap> _sparePixmaps; // pixmaps of lines discarded from _lineCache
+    QCache<uint,RenderedLine> _lineCache; // keyed by a hash of the line's cells,
+                                          // cost in KiB
+    QSet<uint> _uncachedLines; // hashes of lines drawn without caching them
+    qint64 _lineCacheHits;
+    qint64 _lineCacheMisses;
     int  _fontHeight;     // height
     int  _fontWidth;     // width
     int  _fontAscent;     // ascend
@@ -680,6 +744,8 @@ protected:
     uint _randomSeed;
 
     bool _resizing;
+    bool _compareAllLines; // compare all lines of _image in the next updateImage()
+    int _trueColorGeneration; // TrueColorTable::generation() when _image was last updated
     bool _terminalSizeHint;
     bool _terminalSizeStartup;
     bool _bidiEnabled;
@@ -764,6 +830,13 @@ protected:
 	static const int DEFAULT_LEFT_MARGIN = 1;
 	static const int DEFAULT_TOP_MARGIN = 1;
 
+    //the maximum size in KiB of the rendered lines in _lineCache
+    static const int LINE_CACHE_SIZE = 8192;
+    //the maximum number of pixmaps in _sparePixmaps
+    static const int MAX_SPARE_PIXMAPS = 16;
+    //the maximum number of hashes in _uncachedLines
+    static const int MAX_UNCACHED_LINES = 1024;
+
 public:
     static void setTransparencyEnabled(bool enable)
     {
@@ -208,14 +208,16 @@ void Vt102Emulation::reset()
 
 /* The tokenizers state
 
-   The state is represented by the buffer (pbuf, ppos),
-   and accompanied by decoded arguments kept in (argv,argc).
+   The state is represented by the buffer (pbuf, ppos) and, in ANSI mode,
+   by an explicit parser state (_parserState), accompanied by decoded
+   arguments kept in (argv,argc).
    Note that they are kept internal in the tokenizer.
 */
 
 void Vt102Emulation::resetToken()
 {
   ppos = 0; argc = 0; argv[0] = 0; argv[1] = 0;
+  _parserState = Ground;
 }
 
 void Vt102Emulation::addDigit(int dig)
@@ -245,6 +247,9 @@ void Vt102Emulation::pushToToken(int cc)
 #define GRP 32
 #define CPS 64
 
+#define ESC 27
+#define CNTL(c) ((c)-'@')
+
 void Vt102Emulation::initTokenizer()
 { int i; quint8* s;
   for(i =  0;                      i < 256; i++) tbl[ i]  = 0;
@@ -256,14 +261,96 @@ void Vt102Emulation::initTokenizer()
   for(s = (quint8*)"0123456789"        ; *s; s++) tbl[*s] |= DIG;
   for(s = (quint8*)"()+*%"             ; *s; s++) tbl[*s] |= SCS;
   for(s = (quint8*)"()+*#[]%"          ; *s; s++) tbl[*s] |= GRP;
+
+  // every code below 256 falls into exactly one of the classes
+  // used by the ANSI transition table, see receiveChar()
+  for(i =  0;                      i < 256; i++) _charClass[i] = ClassPrintable;
+  for(i =  0;                      i <  32; i++) _charClass[i] = ClassControl;
+  _charClass[CNTL('G')] = ClassBell;
+  _charClass[CNTL('X')] = ClassCancel;
+  _charClass[CNTL('Z')] = ClassCancel;
+  _charClass[ESC]       = ClassEscape;
+  _charClass[ESC+128]   = ClassCsi8;
+  for(s = (quint8*)"0123456789"        ; *s; s++) _charClass[*s] = ClassDigit;
+  for(s = (quint8*)"@ABCDGHILMPSTXZcdfry"; *s; s++) _charClass[*s] = ClassParamFinal;
+  for(s = (quint8*)"()+*%"             ; *s; s++) _charClass[*s] = ClassCharset;
+  _charClass[';'] = ClassSeparator;
+  _charClass['?'] = ClassMarker;
+  _charClass['>'] = ClassMarker;
+  _charClass['!'] = ClassBang;
+  _charClass['#'] = ClassHash;
+  _charClass['['] = ClassCsiIntro;
+  _charClass[']'] = ClassOscIntro;
+  _charClass['t'] = ClassWindowOp;
+
   resetToken();
 }
 
-/* Ok, here comes the nasty part of the decoder.
+/* The ANSI tokenizer is a state machine in the style of the DEC ANSI
+   parser.  Each incoming character is mapped to a class (_charClass) and
+   the pair (state, class) selects an action and the follow-up state from
+   the transition table below.
+
+   - Control characters are executed immediately from any state and
+     neither reset nor advance the token (DEC HACK ALERT! This is how
+     VT100s behave), except for CAN/SUB which abort the sequence, ESC
+     which starts a new one, and BEL which terminates an OSC sequence.
+   - Printable characters in the Ground state are displayed directly.
+   - The remaining states collect escape and control sequences into
+     (pbuf, ppos) and (argv, argc) until a final character dispatches
+     them to tau().
+
+   The first byte of each entry is the action, the second the next state.
+*/
+
+#define T(A,S) { Vt102Emulation::A, Vt102Emulation::S }
 
-   Instead of keeping an explicit state, we deduce it from the
-   token scanned so far. It is then immediately combined with
-   the current character to form a scanning decision.
+// Columns:  Control, Bell, Cancel, Escape, Csi8, Digit, Separator, Marker,
+//           Bang, Charset, Hash, CsiIntro, OscIntro, ParamFinal, WindowOp, Printable
+const quint8 Vt102Emulation::_transitions[ParserStateCount][CharClassCount][2] =
+{
+  /* Ground */
+  { T(ActExecute,Ground), T(ActExecute,Ground), T(ActCancel,Ground), T(ActEscape,Escape),
+    T(ActCsi8,CsiEntry), T(ActPrint,Ground), T(ActPrint,Ground), T(ActPrint,Ground),
+    T(ActPrint,Ground), T(ActPrint,Ground), T(ActPrint,Ground), T(ActPrint,Ground),
+    T(ActPrint,Ground), T(ActPrint,Ground), T(ActPrint,Ground), T(ActPrint,Ground) },
+  /* Escape */
+  { T(ActExecute,Escape), T(ActExecute,Escape), T(ActCancel,Ground), T(ActEscape,Escape),
+    T(ActEscDispatch,Ground), T(ActEscDispatch,Ground), T(ActEscDispatch,Ground), T(ActEscDispatch,Ground),
+    T(ActEscDispatch,Ground), T(ActCollect,EscapeGroup), T(ActCollect,EscapeGroup), T(ActCollect,CsiEntry),
+    T(ActCollect,Osc), T(ActEscDispatch,Ground), T(ActEscDispatch,Ground), T(ActEscDispatch,Ground) },
+  /* EscapeGroup */
+  { T(ActExecute,EscapeGroup), T(ActExecute,EscapeGroup), T(ActCancel,Ground), T(ActEscape,Escape),
+    T(ActCharsetDispatch,Ground), T(ActCharsetDispatch,Ground), T(ActCharsetDispatch,Ground), T(ActCharsetDispatch,Ground),
+    T(ActCharsetDispatch,Ground), T(ActCharsetDispatch,Ground), T(ActCharsetDispatch,Ground), T(ActCharsetDispatch,Ground),
+    T(ActCharsetDispatch,Ground), T(ActCharsetDispatch,Ground), T(ActCharsetDispatch,Ground), T(ActCharsetDispatch,Ground) },
+  /* CsiEntry */
+  { T(ActExecute,CsiEntry), T(ActExecute,CsiEntry), T(ActCancel,Ground), T(ActEscape,Escape),
+    T(ActCsiDispatch,Ground), T(ActParam,CsiParam), T(ActSeparator,CsiParam), T(ActCollect,CsiParam),
+    T(ActCollect,CsiBang), T(ActCsiDispatch,Ground), T(ActCsiDispatch,Ground), T(ActCsiDispatch,Ground),
+    T(ActCsiDispatch,Ground), T(ActParamFinal,Ground), T(ActWindowOp,Ground), T(ActCsiDispatch,Ground) },
+  /* CsiParam */
+  { T(ActExecute,CsiParam), T(ActExecute,CsiParam), T(ActCancel,Ground), T(ActEscape,Escape),
+    T(ActCsiDispatch,Ground), T(ActParam,CsiParam), T(ActSeparator,CsiParam), T(ActCsiDispatch,Ground),
+    T(ActCsiDispatch,Ground), T(ActCsiDispatch,Ground), T(ActCsiDispatch,Ground), T(ActCsiDispatch,Ground),
+    T(ActCsiDispatch,Ground), T(ActParamFinal,Ground), T(ActWindowOp,Ground), T(ActCsiDispatch,Ground) },
+  /* CsiBang */
+  { T(ActExecute,CsiBang), T(ActExecute,CsiBang), T(ActCancel,Ground), T(ActEscape,Escape),
+    T(ActBangDispatch,Ground), T(ActBangDispatch,Ground), T(ActBangDispatch,Ground), T(ActBangDispatch,Ground),
+    T(ActBangDispatch,Ground), T(ActBangDispatch,Ground), T(ActBangDispatch,Ground), T(ActBangDispatch,Ground),
+    T(ActBangDispatch,Ground), T(ActBangDispatch,Ground), T(ActBangDispatch,Ground), T(ActBangDispatch,Ground) },
+  /* Osc */
+  { T(ActExecute,Osc), T(ActOscEnd,Ground), T(ActCancel,Ground), T(ActEscape,Escape),
+    T(ActCollect,Osc), T(ActCollect,Osc), T(ActCollect,Osc), T(ActCollect,Osc),
+    T(ActCollect,Osc), T(ActCollect,Osc), T(ActCollect,Osc), T(ActCollect,Osc),
+    T(ActCollect,Osc), T(ActCollect,Osc), T(ActCollect,Osc), T(ActCollect,Osc) }
+};
+
+#undef T
+
+/* The VT52 tokenizer has no explicit state.  Instead, the state is
+   deduced from the token scanned so far. It is then immediately
+   combined with the current character to form a scanning decision.
 
    This is done by the following defines.
 
@@ -275,67 +362,89 @@ void Vt102Emulation::initTokenizer()
 */
 
 #define lec(P,L,C) (p == (P) &&                     s[(L)]         == (C))
-#define lun(     ) (p ==  1  &&                       cc           >= 32 )
 #define les(P,L,C) (p == (P) && s[L] < 256  && (tbl[s[(L)]] & (C)) == (C))
-#define eec(C)     (p >=  3  &&        cc                          == (C))
-#define ees(C)     (p >=  3  && cc < 256 &&    (tbl[  cc  ] & (C)) == (C))
-#define eps(C)     (p >=  3  && s[2] != '?' && s[2] != '!' && s[2] != '>' && cc < 256 && (tbl[  cc  ] & (C)) == (C))
-#define epp( )     (p >=  3  && s[2] == '?'                              )
-#define epe( )     (p >=  3  && s[2] == '!'                              )
-#define egt(     ) (p >=  3  && s[2] == '>'                              )
 #define Xpe        (ppos>=2  && pbuf[1] == ']'                           )
 #define Xte        (Xpe                        &&     cc           ==  7 )
 #define ces(C)     (            cc < 256 &&    (tbl[  cc  ] & (C)) == (C) && !Xte)
 
-#define ESC 27
-#define CNTL(c) ((c)-'@')
-
 // process an incoming unicode character
 
 void Vt102Emulation::receiveChar(int cc)
 { 
-  int i;
   if (cc == 127) return; //VT100: ignore.
 
-  if (ces(    CTL))
-  { // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
-    // This means, they do neither a resetToken nor a pushToToken. Some of them, do
-    // of course. Guess this originates from a weakly layered handling of the X-on
-    // X-off protocol, which comes really below this level.
-    if (cc == CNTL('X') || cc == CNTL('Z') || cc == ESC) resetToken(); //VT100: CAN or SUB
-    if (cc != ESC)    { tau( TY_CTL(cc+'@' ),   0,  0); return; }
+  if (!getMode(MODE_Ansi))
+  {
+    receiveVt52Char(cc);
+    return;
   }
 
-  pushToToken(cc); // advance the state
+  const quint8* transition = _transitions[_parserState][ cc < 256 ? _charClass[cc] : ClassPrintable ];
 
-  int* s = pbuf;
-  int  p = ppos;
+  if (transition[0] >= ActCollect)
+    pushToToken(cc); // advance the state
 
-  if (getMode(MODE_Ansi)) // decide on proper action
+  switch (transition[0])
   {
-    if (lec(1,0,ESC)) {                                                       return; }
-    if (lec(1,0,ESC+128)) { s[0] = ESC; receiveChar('[');                   return; }
-    if (les(2,1,GRP)) {                                                       return; }
-    if (Xte         ) { XtermHack();                            resetToken(); return; }
-    if (Xpe         ) {                                                       return; }
-    if (lec(3,2,'?')) {                                                       return; }
-    if (lec(3,2,'>')) {                                                       return; }
-    if (lec(3,2,'!')) {                                                       return; }
-    if (lun(       )) { tau( TY_CHR(), applyCharset(cc), 0); resetToken(); return; }
-    if (lec(2,0,ESC)) { tau( TY_ESC(s[1]),   0,  0);       resetToken(); return; }
-    if (les(3,1,SCS)) { tau( TY_ESC_CS(s[1],s[2]),   0,  0);  resetToken(); return; }
-    if (lec(3,1,'#')) { tau( TY_ESC_DE(s[2]),   0,  0);       resetToken(); return; }
-    if (eps(    CPN)) { tau( TY_CSI_PN(cc), argv[0],argv[1]);   resetToken(); return; }
+    case ActExecute       : tau( TY_CTL(cc+'@'), 0, 0); return;
+    case ActCancel        : resetToken(); tau( TY_CTL(cc+'@'), 0, 0); return;
+    case ActPrint         : tau( TY_CHR(), applyCharset(cc), 0); return;
+    case ActCsi8          : resetToken(); pushToToken(ESC); pushToToken('['); break;
+    case ActEscape        : resetToken(); pushToToken(cc); break;
+    case ActCollect       : break;
+    case ActEscDispatch   : tau( TY_ESC(cc), 0, 0); resetToken(); return;
+    case ActCharsetDispatch:
+      if (pbuf[1] == '#') tau( TY_ESC_DE(cc), 0, 0);
+      else                tau( TY_ESC_CS(pbuf[1],cc), 0, 0);
+      resetToken(); return;
+    case ActParam         : addDigit(cc-'0'); break;
+    case ActSeparator     : addArgument(); break;
+    case ActParamFinal    :
+      if (pbuf[2] == '?' || pbuf[2] == '>') { dispatchCsi(cc); return; }
+      tau( TY_CSI_PN(cc), argv[0], argv[1]); resetToken(); return;
+    case ActWindowOp      : // resize = \e[8;<row>;<col>t
+      if (pbuf[2] == '?' || pbuf[2] == '>') { dispatchCsi(cc); return; }
+      tau( TY_CSI_PS(cc, argv[0]), argv[1], argv[2]); resetToken(); return;
+    case ActCsiDispatch   : dispatchCsi(cc); return;
+    case ActBangDispatch  : tau( TY_CSI_PE(cc), 0, 0); resetToken(); return;
+    case ActOscEnd        : XtermHack(); resetToken(); return;
+  }
 
-// resize = \e[8;<row>;<col>t
-    if (eps(    CPS)) { tau( TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);   resetToken(); return; }
-
-    if (epe(       )) { tau( TY_CSI_PE(cc),     0,  0);       resetToken(); return; }
-    if (ees(    DIG)) { addDigit(cc-'0');                                     return; }
-    if (eec(    ';')) { addArgument();                                        return; }
-    for (i=0;i<=argc;i++)
-    if ( epp(     ))  { tau( TY_CSI_PR(cc,argv[i]),   0,  0); }
-    else if(egt(    ))   { tau( TY_CSI_PG(cc     ),   0,  0); } // spec. case for ESC]>0c or ESC]>c
+  _parserState = transition[1];
+}
+
+void Vt102Emulation::receiveChars(const uint* chars, int count)
+{
+  int i = 0;
+  while (i < count)
+  {
+    // plain text arriving in the Ground state does not need to go through
+    // the tokenizer at all, so hand the whole run to the screen at once
+    if (_parserState == Ground && getMode(MODE_Ansi))
+    {
+      int end = i;
+      while (end < count && chars[end] >= 32 && chars[end] != 127 && chars[end] != ESC+128)
+        end++;
+      if (end > i)
+      {
+        showCharacters(chars+i,end-i);
+        i = end;
+        if (i == count)
+          break;
+      }
+    }
+    receiveChar(chars[i++]);
+  }
+}
+
+void Vt102Emulation::dispatchCsi(int cc)
+{
+  for (int i=0;i<=argc;i++)
+  {
+    if (pbuf[2] == '?')
+    { tau( TY_CSI_PR(cc,argv[i]),   0,  0); }
+    else if (pbuf[2] == '>')
+    { tau( TY_CSI_PG(cc     ),   0,  0); } // spec. case for ESC]>0c or ESC]>c
     else if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 2)
     { // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ... 38;2;<red>;<green>;<blue> ... m
       i += 2;
@@ -347,18 +456,34 @@ void Vt102Emulation::receiveChar(int cc)
       i += 2;
       tau( TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_256, argv[i]);
     }
-    else              { tau( TY_CSI_PS(cc,argv[i]),   0,  0); }
-    resetToken();
+    else
+    { tau( TY_CSI_PS(cc,argv[i]),   0,  0); }
   }
-  else // mode VT52
-  {
-    if (lec(1,0,ESC))                                                      return;
-    if (les(1,0,CHR)) { tau( TY_CHR(       ), s[0],  0); resetToken(); return; }
-    if (lec(2,1,'Y'))                                                      return;
-    if (lec(3,1,'Y'))                                                      return;
-    if (p < 4)        { tau( TY_VT52(s[1]   ),   0,  0); resetToken(); return; }
-                        tau( TY_VT52(s[1]   ), s[2],s[3]); resetToken(); return;
+  resetToken();
+}
+
+void Vt102Emulation::receiveVt52Char(int cc)
+{
+  if (ces(    CTL))
+  { // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
+    // This means, they do neither a resetToken nor a pushToToken. Some of them, do
+    // of course. Guess this originates from a weakly layered handling of the X-on
+    // X-off protocol, which comes really below this level.
+    if (cc == CNTL('X') || cc == CNTL('Z') || cc == ESC) resetToken(); //VT100: CAN or SUB
+    if (cc != ESC)    { tau( TY_CTL(cc+'@' ),   0,  0); return; }
   }
+
+  pushToToken(cc); // advance the state
+
+  int* s = pbuf;
+  int  p = ppos;
+
+  if (lec(1,0,ESC))                                                      return;
+  if (les(1,0,CHR)) { tau( TY_CHR(       ), s[0],  0); resetToken(); return; }
+  if (lec(2,1,'Y'))                                                      return;
+  if (lec(3,1,'Y'))                                                      return;
+  if (p < 4)        { tau( TY_VT52(s[1]   ),   0,  0); resetToken(); return; }
+                      tau( TY_VT52(s[1]   ), s[2],s[3]); resetToken(); return;
 }
 
 void Vt102Emulation::XtermHack()
@@ -759,6 +884,11 @@ switch( N )
     case TY_CSI_PR('h', 1049) : saveCursor(); _screen[1]->clearEntireScreen(); setMode(MODE_AppScreen); break; //XTERM
     case TY_CSI_PR('l', 1049) : resetMode(MODE_AppScreen); restoreCursor(); break; //XTERM
 
+    case TY_CSI_PR('h', 2004) :          setMode      (MODE_BracketedPaste); break; //XTERM
+    case TY_CSI_PR('l', 2004) :        resetMode      (MODE_BracketedPaste); break; //XTERM
+    case TY_CSI_PR('s', 2004) :         saveMode      (MODE_BracketedPaste); break; //XTERM
+    case TY_CSI_PR('r', 2004) :      restoreMode      (MODE_BracketedPaste); break; //XTERM
+
     //FIXME: weird DEC reset sequence
     case TY_CSI_PE('p'      ) : /* IGNORED: reset         (        ) */ break;
 
@@ -987,6 +1117,7 @@ void Vt102Emulation::sendKeyEvent( QKeyEvent* event )
         else
             textToSend += _codec->fromUnicode(event->text());
 
+        keyPressed();
         sendData( textToSend.constData() , textToSend.length() );
     }
     else
@@ -1031,13 +1162,30 @@ void Vt102Emulation::sendKeyEvent( QKeyEvent* event )
 
 // Apply current character map.
 
-unsigned short Vt102Emulation::applyCharset(unsigned short c)
+uint Vt102Emulation::applyCharset(uint c)
 {
   if (CHARSET.graphic && 0x5f <= c && c <= 0x7e) return vt100_graphics[c-0x5f];
   if (CHARSET.pound                && c == '#' ) return 0xa3; //This mode is obsolete
   return c;
 }
 
+// Display a run of plain characters, applying the current character map.
+
+void Vt102Emulation::showCharacters(const uint* chars, int count)
+{
+  if (CHARSET.graphic || CHARSET.pound)
+  {
+    QVarLengthArray<uint,1024> mapped(count);
+    for (int i = 0; i < count; i++)
+      mapped[i] = applyCharset(chars[i]);
+    _currentScreen->displayCharacters(mapped.constData(),count);
+  }
+  else
+  {
+    _currentScreen->displayCharacters(chars,count);
+  }
+}
+
 /*
    "Charset" related part of the emulation state.
    This configures the VT100 _charset filter.
@@ -1136,6 +1284,7 @@ void Vt102Emulation::resetModes()
   resetMode(MODE_Mouse1003); saveMode(MODE_Mouse1003);
 
   resetMode(MODE_AppScreen); saveMode(MODE_AppScreen);
+  resetMode(MODE_BracketedPaste); saveMode(MODE_BracketedPaste);
   // here come obsolete modes
   resetMode(MODE_AppCuKeys); saveMode(MODE_AppCuKeys);
   resetMode(MODE_NewLine  );
@@ -1206,6 +1355,14 @@ bool Vt102Emulation::getMode(int m)
   return _currParm.mode[m];
 }
 
+QByteArray Vt102Emulation::pasteDelimiter(bool start) const
+{
+  if (!_currParm.mode[MODE_BracketedPaste])
+      return QByteArray();
+
+  return start ? "\033[200~" : "\033[201~";
+}
+
 char Vt102Emulation::getErase() const
 {
   KeyboardTranslator::Entry entry = _keyTranslator->findEntry(
@@ -45,7 +45,8 @@
 #define MODE_Mouse1002 (MODES_SCREEN+5)
 #define MODE_Mouse1003 (MODES_SCREEN+6)
 #define MODE_Ansi      (MODES_SCREEN+7)
-#define MODE_total     (MODES_SCREEN+8)
+#define MODE_BracketedPaste (MODES_SCREEN+8)
+#define MODE_total     (MODES_SCREEN+9)
 
 namespace Konsole
 {
@@ -105,9 +106,12 @@ protected:
   // reimplemented
   virtual void setMode    (int mode);
   virtual void resetMode  (int mode);
+  virtual QByteArray pasteDelimiter(bool start) const;
 
   // reimplemented 
   virtual void receiveChar(int cc);
+  // reimplemented
+  virtual void receiveChars(const uint* chars, int count);
   
 
 private slots:
@@ -118,7 +122,9 @@ private slots:
 
 
 private:
-  unsigned short applyCharset(unsigned short c);
+  uint applyCharset(uint c);
+  // displays a run of printable characters using the current character map
+  void showCharacters(const uint* chars, int count);
   void setCharset(int n, int cs);
   void useCharset(int n);
   void setAndUseCharset(int n, int cs);
@@ -152,6 +158,34 @@ private:
   void initTokenizer();
   int tbl[256];
 
+  // states, character classes and actions of the ANSI tokenizer,
+  // see the transition table in Vt102Emulation.cpp
+  enum ParserState
+  {
+    Ground, Escape, EscapeGroup, CsiEntry, CsiParam, CsiBang, Osc,
+    ParserStateCount
+  };
+  enum CharClass
+  {
+    ClassControl, ClassBell, ClassCancel, ClassEscape, ClassCsi8, ClassDigit,
+    ClassSeparator, ClassMarker, ClassBang, ClassCharset, ClassHash,
+    ClassCsiIntro, ClassOscIntro, ClassParamFinal, ClassWindowOp, ClassPrintable,
+    CharClassCount
+  };
+  // actions from ActCollect onwards push the character to the token first
+  enum ParserAction
+  {
+    ActExecute, ActCancel, ActPrint, ActCsi8, ActEscape,
+    ActCollect, ActEscDispatch, ActCharsetDispatch, ActParam, ActSeparator,
+    ActParamFinal, ActWindowOp, ActCsiDispatch, ActBangDispatch, ActOscEnd
+  };
+  static const quint8 _transitions[ParserStateCount][CharClassCount][2];
+  quint8 _charClass[256];
+  int _parserState;
+
+  void dispatchCsi(int cc);
+  void receiveVt52Char(int cc);
+
   void scan_buffer_report(); //FIXME: rename
   void ReportErrorToken();   //FIXME: rename
 
@@ -64,11 +64,17 @@
 #include <QtCore/QMap>
 #include <QtCore/QFile>
 #include <QtCore/QSocketNotifier>
+#include <QtCore/QTime>
 
 //#include <kdebug.h>
 //#include <kstandarddirs.h>
 //#include <kuser.h>
 
+// the size of the buffer into which the output of the child process is read
+#define OUTPUT_BUFFER_SIZE (64*1024)
+// the longest time in milliseconds which childOutput() spends reading output,
+// so that a flood of output from the child does not block the event loop
+#define OUTPUT_TIME_BUDGET 8
 
 //////////////////
 // private data //
@@ -96,6 +102,9 @@ public:
    QString wd;
    QByteArray shell;
    QByteArray executable;
+
+   // reused by childOutput() for every read
+   QByteArray outputBuffer;
 };
 
 /////////////////////////////
@@ -776,19 +785,53 @@ int K3Process::childOutput(int fdno)
   }
   else
   {
-     char buffer[1025];
+     // drain the output into the buffer with large reads until no more is
+     // available, the output is suspended or the time budget is used up.
+     // The buffer is only handed on when it is full or when the reading
+     // stops, rather than once per read.
+     if (d->outputBuffer.isEmpty())
+        d->outputBuffer.resize(OUTPUT_BUFFER_SIZE + 1);
+     char* buffer = d->outputBuffer.data();
+
+     QTime time;
+     time.start();
+
+     int total = 0;
+     int used = 0;
      int len;
 
-     len = ::read(fdno, buffer, 1024);
+     do {
+        len = ::read(fdno, buffer + used, OUTPUT_BUFFER_SIZE - used);
+
+        if (len > 0) {
+           used += len;
+           total += len;
 
-     if (len > 0) {
-        buffer[len] = 0; // Just in case.
-        emit receivedStdout(this, buffer, len);
+           if (used == OUTPUT_BUFFER_SIZE) {
+              buffer[used] = 0; // Just in case.
+              receivedOutput(buffer, used);
+              used = 0;
+           }
+        }
+     } while (len > 0 && (!outnot || outnot->isEnabled()) &&
+              time.elapsed() < OUTPUT_TIME_BUDGET);
+
+     if (used > 0) {
+        buffer[used] = 0; // Just in case.
+        receivedOutput(buffer, used);
      }
-     return len;
+
+     if (len == 0 || total == 0)
+        return len;
+     return total;
   }
 }
 
+void K3Process::receivedOutput(char *buffer, int buflen)
+{
+  emit receivedStdout(this, buffer, buflen);
+}
+
 int K3Process::childError(int fdno)
 {
   char buffer[1025];
@@ -881,6 +924,10 @@ int K3Process::commSetupDoneP()
     close(err[1]);
   in[0] = out[1] = err[1] = -1;
 
+  // childOutput() reads until no more output is available
+  if ((communication & Stdout) && !(communication & NoRead))
+    fcntl(out[0], F_SETFL, O_NONBLOCK | fcntl(out[0], F_GETFL));
+
   // Don't create socket notifiers if no interactive comm is to be expected
   if (run_mode != NotifyOnExit && run_mode != OwnGroup)
     return 1;
@@ -808,12 +808,24 @@ protected:
   Communication communication;
 
   /**
-   * Called by slotChildOutput() this function copies data arriving from
-   * the child process' stdout to the respective buffer and emits the signal
-   * receivedStdout().
+   * Called by slotChildOutput() this function reads the data arriving from
+   * the child process' stdout into a buffer of 64 KiB and passes it to
+   * receivedOutput().  It keeps reading until no more data is available,
+   * the output is suspended or a few milliseconds have passed, so that
+   * heavy output is handed on in large blocks.
    */
   int childOutput(int fdno);
 
+  /**
+   * Called by childOutput() with each block of data read from the child
+   * process' stdout.  The default implementation emits receivedStdout().
+   *
+   * Reimplement this to consume the output directly.  @p buffer is reused
+   * for the next block, so the data must be processed or copied before
+   * returning.
+   */
+  virtual void receivedOutput(char *buffer, int buflen);
+
   /**
    * Called by slotChildError() this function copies data arriving from
    * the child process' stderr to the respective buffer and emits the signal
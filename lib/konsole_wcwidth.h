@@ -14,10 +14,7 @@
 #include <QtCore/QBool>
 #include <QtCore/QString>
 
-int konsole_wcwidth(quint16 ucs);
-#if 0
-int konsole_wcwidth_cjk(Q_UINT16 ucs);
-#endif
+int konsole_wcwidth(quint32 ucs);
 
 int string_width( const QString &txt );
 
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+#
+# Generates konsole_wcwidth_table.h, the two-level lookup table used by
+# konsole_wcwidth(), from the Unicode database of the Python interpreter
+# which runs it:
+#
+#     python3 konsole_wcwidth_table.py > konsole_wcwidth_table.h
+#
+# The column widths follow the rules described in konsole_wcwidth.cpp.
+# The code points are split into pages of 256 characters.  Identical pages
+# are only stored once and the widths within a page are packed into two
+# bits per character.
+
+import sys
+import unicodedata
+
+MAX_UCS = 0x110000
+PAGE_SIZE = 256
+
+# unassigned code points in these blocks default to East Asian Wide
+WIDE_BLOCKS = [ (0x3400, 0x4DBF), (0x4E00, 0x9FFF), (0xF900, 0xFAFF),
+                (0x20000, 0x2FFFD), (0x30000, 0x3FFFD) ]
+
+def width(ucs):
+    ch = chr(ucs)
+    category = unicodedata.category(ch)
+
+    # Hangul Jamo medial vowels and final consonants combine with the
+    # preceding initial consonant
+    if 0x1160 <= ucs <= 0x11FF or 0xD7B0 <= ucs <= 0xD7FF:
+        return 0
+    # SOFT HYPHEN is displayed when a line is broken at it
+    if category in ('Mn', 'Me', 'Cf') and ucs != 0x00AD:
+        return 0
+
+    if unicodedata.east_asian_width(ch) in ('W', 'F'):
+        return 2
+    if category == 'Cn':
+        for first, last in WIDE_BLOCKS:
+            if first <= ucs <= last:
+                return 2
+    return 1
+
+def main():
+    pages = []
+    page_indexes = {}
+    index = []
+
+    for start in range(0, MAX_UCS, PAGE_SIZE):
+        packed = [0] * (PAGE_SIZE // 4)
+        for i in range(PAGE_SIZE):
+            packed[i // 4] |= width(start + i) << ((i % 4) * 2)
+        packed = tuple(packed)
+
+        if packed not in page_indexes:
+            page_indexes[packed] = len(pages)
+            pages.append(packed)
+        index.append(page_indexes[packed])
+
+    assert len(pages) <= 256
+
+    out = sys.stdout
+    out.write('/* Generated by konsole_wcwidth_table.py from Unicode %s, do not edit. */\n\n'
+              % unicodedata.unidata_version)
+    out.write('#ifndef KONSOLE_WCWIDTH_TABLE_H\n#define KONSOLE_WCWIDTH_TABLE_H\n\n')
+
+    out.write('/* index of the page of widths for each block of 256 code points */\n')
+    out.write('static const unsigned char wcwidth_pages[%d] = {\n' % len(index))
+    for i in range(0, len(index), 16):
+        out.write('  ' + ', '.join('%3d' % p for p in index[i:i+16]) + ',\n')
+    out.write('};\n\n')
+
+    out.write('/* column widths of 256 code points, packed into two bits each */\n')
+    out.write('static const unsigned char wcwidth_widths[%d][%d] = {\n'
+              % (len(pages), PAGE_SIZE // 4))
+    for page in pages:
+        out.write('  {\n')
+        for i in range(0, len(page), 16):
+            out.write('    ' + ', '.join('0x%02x' % b for b in page[i:i+16]) + ',\n')
+        out.write('  },\n')
+    out.write('};\n\n')
+
+    out.write('#endif\n')
+
+if __name__ == '__main__':
+    main()
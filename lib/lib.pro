@@ -31,20 +31,20 @@ DEFINES 	+= HAVE_POSIX_OPENPT
 HEADERS 	= TerminalCharacterDecoder.h Character.h CharacterColor.h \
 		KeyboardTranslator.h \
 		ExtendedDefaultTranslator.h \
-		Screen.h History.h BlockArray.h konsole_wcwidth.h \
+		Screen.h History.h HistorySearch.h BlockArray.h konsole_wcwidth.h konsole_wcwidth_table.h \
 		ScreenWindow.h \
 		Emulation.h \
-		Vt102Emulation.h TerminalDisplay.h Filter.h LineFont.h \
+		Vt102Emulation.h TerminalDisplay.h GlyphCache.h Filter.h HotSpotScanner.h LineFont.h \
 		Pty.h kpty.h kpty_p.h k3process.h k3processcontroller.h \
 		Session.h ShellCommand.h \
 		qgraphicstermwidget.h
 
 SOURCES 	= TerminalCharacterDecoder.cpp \
 		KeyboardTranslator.cpp \
-		Screen.cpp History.cpp BlockArray.cpp konsole_wcwidth.cpp \
+		Screen.cpp History.cpp HistorySearch.cpp BlockArray.cpp konsole_wcwidth.cpp \
 		ScreenWindow.cpp \
 		Emulation.cpp \
-		Vt102Emulation.cpp TerminalDisplay.cpp Filter.cpp \
+		Vt102Emulation.cpp TerminalDisplay.cpp GlyphCache.cpp Filter.cpp HotSpotScanner.cpp \
 		Pty.cpp kpty.cpp k3process.cpp k3processcontroller.cpp \
 		Session.cpp ShellCommand.cpp \
 		qgraphicstermwidget.cpp
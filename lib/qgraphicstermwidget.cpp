@@ -87,7 +87,7 @@ Session *QGraphicsTermWidget::createSession()
     session->setCodec(QTextCodec::codecForName("UTF-8"));
 			
     session->setFlowControlEnabled(true);
-    session->setHistoryType(HistoryTypeBuffer(1000));
+    session->setHistoryType(HistoryTypePaged(1000));
     
     session->setDarkBackground(true);
 	    
@@ -205,9 +205,9 @@ void QGraphicsTermWidget::setSize(int h, int v)
 void QGraphicsTermWidget::setHistorySize(int lines)
 {
     if (lines < 0)
-        m_session->setHistoryType(HistoryTypeFile());
+        m_session->setHistoryType(HistoryTypeTiered());
     else
-	m_session->setHistoryType(HistoryTypeBuffer(lines));
+	m_session->setHistoryType(HistoryTypePaged(lines));
 }
 
 void QGraphicsTermWidget::setScrollBarPosition(ScrollBarPosition pos)
@@ -0,0 +1,161 @@
+/*
+    Copyright (C) 2026 by agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Qt
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTextCodec>
+#include <QtCore/QTextStream>
+#include <QtTest/QtTest>
+
+// Konsole
+#include "History.h"
+#include "TerminalCharacterDecoder.h"
+#include "Vt102Emulation.h"
+
+using namespace Konsole;
+
+/**
+ * A Vt102Emulation which passes every character through the tokenizer,
+ * as receiveData() did before the bulk path for plain text.
+ */
+class PerCharEmulation : public Vt102Emulation
+{
+protected:
+    virtual void receiveChars(const uint* chars, int count)
+    {
+        Emulation::receiveChars(chars,count);
+    }
+};
+
+/**
+ * Checks that the bulk path of Vt102Emulation produces the same output as
+ * the tokenizer, and measures how fast a build log is received.
+ */
+class EmulationTest : public QObject
+{
+Q_OBJECT
+
+private slots:
+    void bulkPathMatchesTokenizer();
+
+    void benchmarkReceiveData();
+    void benchmarkReceiveDataPerChar();
+
+private:
+    static void setUp(Emulation& emulation);
+    // returns the text of the screen and its history
+    static QString text(Emulation& emulation);
+    // returns about 'size' bytes of UTF-8 build output with colours
+    static QByteArray logData(int size);
+    static void benchmark(Emulation& emulation);
+};
+
+void EmulationTest::setUp(Emulation& emulation)
+{
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setHistory(HistoryTypeBuffer(1000));
+}
+
+QString EmulationTest::text(Emulation& emulation)
+{
+    QString result;
+    QTextStream stream(&result);
+    PlainTextDecoder decoder;
+
+    decoder.begin(&stream);
+    emulation.writeToStream(&decoder,0,emulation.lineCount()-1);
+    decoder.end();
+
+    return result;
+}
+
+QByteArray EmulationTest::logData(int size)
+{
+    static const char* const lines[] =
+    {
+        "[ %1%] Building CXX object lib/CMakeFiles/konsole.dir/Screen.cpp.o\r\n",
+        "\033[01;32m[ %1%]\033[0m \033[1mLinking CXX shared library libkonsole.so\033[0m\r\n",
+        "lib/History.cpp:%1:12: \033[01;35mwarning: \033[0munused variable \xe2\x80\x98line\xe2\x80\x99\r\n",
+        "\tg++ -c -pipe -O2 -Wall -W -D_REENTRANT -DQT_NO_DEBUG -I../lib -o Emulation.o Emulation.cpp\r\n",
+        "  %1 | \xe4\xb8\xad\xe6\x96\x87 \xc3\xa9t\xc3\xa9 \033[7mreverse\033[27m \033[38;5;%1mindexed\033[39m\r\n"
+    };
+    static const int lineCount = sizeof(lines) / sizeof(lines[0]);
+
+    QByteArray data;
+    for (int i = 0 ; data.size() < size ; i++)
+        data += QString::fromUtf8(lines[i % lineCount]).arg(i % 100).toUtf8();
+
+    return data;
+}
+
+void EmulationTest::bulkPathMatchesTokenizer()
+{
+    const QByteArray data = logData(256*1024);
+
+    Vt102Emulation bulk;
+    PerCharEmulation perChar;
+    setUp(bulk);
+    setUp(perChar);
+
+    // odd chunk sizes split escape sequences and UTF-8 sequences
+    // between calls to receiveData()
+    for (int i = 0 ; i < data.size() ; i += 997)
+    {
+        const int length = qMin(997,data.size()-i);
+        bulk.receiveData(data.constData()+i,length);
+        perChar.receiveData(data.constData()+i,length);
+    }
+
+    QVERIFY(bulk.lineCount() > 1000);
+    QCOMPARE(text(bulk),text(perChar));
+}
+
+void EmulationTest::benchmark(Emulation& emulation)
+{
+    const QByteArray data = logData(4*1024*1024);
+    setUp(emulation);
+
+    QBENCHMARK
+    {
+        emulation.receiveData(data.constData(),data.size());
+    }
+}
+
+void EmulationTest::benchmarkReceiveData()
+{
+    Vt102Emulation emulation;
+    benchmark(emulation);
+}
+
+void EmulationTest::benchmarkReceiveDataPerChar()
+{
+    PerCharEmulation emulation;
+    benchmark(emulation);
+}
+
+// the emulation's timers need an application object, but QTEST_MAIN would
+// create a QApplication, which needs a display
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc,argv);
+    EmulationTest test;
+    return QTest::qExec(&test,argc,argv);
+}
+
+#include "EmulationTest.moc"
@@ -0,0 +1,192 @@
+/*
+    Copyright (C) 2026 by agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Qt
+#include <QtTest/QtTest>
+
+// Konsole
+#include "History.h"
+#include "Screen.h"
+
+using namespace Konsole;
+
+/**
+ * Checks that the history implementations keep the text of the lines
+ * which scroll off the screen.
+ */
+class HistoryTest : public QObject
+{
+Q_OBJECT
+
+public:
+    enum Kind
+    {
+        Buffer,
+        Paged,
+        Compact,
+        Tiered,
+        BlockArray
+    };
+
+private slots:
+    void keepsTrailingBlanksOfWrappedLines_data();
+    void keepsTrailingBlanksOfWrappedLines();
+    void copiesSelectionAcrossWrap_data();
+    void copiesSelectionAcrossWrap();
+    void indexSplitsLongWrappedRuns();
+
+private:
+    static void addKinds();
+    // returns a new history type of the given kind with room for 'lines' lines
+    static HistoryType* createType(int kind, int lines);
+    static void display(Screen& screen, const char* text);
+};
+
+Q_DECLARE_METATYPE(HistoryTest::Kind)
+
+void HistoryTest::addKinds()
+{
+    QTest::addColumn<HistoryTest::Kind>("kind");
+
+    QTest::newRow("buffer") << Buffer;
+    QTest::newRow("paged") << Paged;
+    QTest::newRow("compact") << Compact;
+    QTest::newRow("tiered") << Tiered;
+    QTest::newRow("block array") << BlockArray;
+}
+
+HistoryType* HistoryTest::createType(int kind, int lines)
+{
+    switch (kind)
+    {
+        case Buffer:
+            return new HistoryTypeBuffer(lines);
+        case Paged:
+            return new HistoryTypePaged(lines);
+        case Compact:
+            return new HistoryTypeCompact(lines);
+        case Tiered:
+            return new HistoryTypeTiered(lines);
+        case BlockArray:
+            return new HistoryTypeBlockArray(lines);
+    }
+    return 0;
+}
+
+void HistoryTest::display(Screen& screen, const char* text)
+{
+    QVector<uint> chars;
+    for (const char* c = text ; *c ; c++)
+        chars << *c;
+    screen.displayCharacters(chars.constData(),chars.count());
+}
+
+void HistoryTest::keepsTrailingBlanksOfWrappedLines_data()
+{
+    addKinds();
+}
+
+void HistoryTest::keepsTrailingBlanksOfWrappedLines()
+{
+    QFETCH(HistoryTest::Kind,kind);
+
+    HistoryType* type = createType(kind,100);
+    HistoryScroll* scroll = type->scroll(0);
+    delete type;
+
+    // "ab" followed by two spaces, which are equal to Character()
+    Character line[4];
+    line[0].character = 'a';
+    line[1].character = 'b';
+
+    scroll->addCells(line,4);
+    scroll->addLine(true);
+    scroll->addCells(line,4);
+    scroll->addLine(false);
+
+    QCOMPARE(scroll->getLines(),2);
+    QVERIFY(scroll->isWrappedLine(0));
+    QCOMPARE(scroll->getLineLen(0),4);
+    QVERIFY(!scroll->isWrappedLine(1));
+    QVERIFY(scroll->getLineLen(1) >= 2);
+
+    Character cells[4];
+    scroll->getCells(0,0,4,cells);
+    for (int i = 0 ; i < 4 ; i++)
+        QVERIFY(cells[i] == line[i]);
+
+    delete scroll;
+}
+
+void HistoryTest::copiesSelectionAcrossWrap_data()
+{
+    addKinds();
+}
+
+void HistoryTest::copiesSelectionAcrossWrap()
+{
+    QFETCH(HistoryTest::Kind,kind);
+
+    // "hello " fills the first line, so the line wraps after the space
+    Screen screen(3,6);
+    HistoryType* type = createType(kind,100);
+    screen.setScroll(*type);
+    delete type;
+
+    display(screen,"hello world");
+
+    screen.setSelectionStart(0,0,false);
+    screen.setSelectionEnd(4,1);
+    QCOMPARE(screen.selectedText(true),QString("hello world"));
+
+    // scroll both lines into the history
+    for (int i = 0 ; i < 3 ; i++)
+        screen.NextLine();
+    QCOMPARE(screen.getHistLines(),2);
+
+    screen.setSelectionStart(0,0,false);
+    screen.setSelectionEnd(4,1);
+    QCOMPARE(screen.selectedText(true),QString("hello world"));
+}
+
+void HistoryTest::indexSplitsLongWrappedRuns()
+{
+    Character cells[4];
+    for (int i = 0 ; i < 4 ; i++)
+        cells[i].character = 'a' + i;
+
+    // a single run of wrapped lines, of which only the last lines are kept
+    HistoryTextIndex index;
+    for (int i = 0 ; i < 3 * HistoryTextIndex::MAX_BLOCK_LINE_COUNT ; i++)
+    {
+        index.addLine(cells,4,true);
+        if (index.lineCount() > HistoryTextIndex::BLOCK_LINE_COUNT)
+            index.removeFirstLine();
+    }
+
+    int length = 0;
+    foreach (const HistoryTextIndex::Block& block , index.blocks())
+        length += block.text.length();
+
+    QVERIFY(length <= (HistoryTextIndex::MAX_BLOCK_LINE_COUNT + HistoryTextIndex::BLOCK_LINE_COUNT) * 4);
+}
+
+QTEST_APPLESS_MAIN(HistoryTest)
+
+#include "HistoryTest.moc"
@@ -0,0 +1,16 @@
+TEMPLATE	= app
+TARGET		= historytest
+
+CONFIG		+= qt qtestlib warn_on console
+CONFIG		-= app_bundle
+
+QT		+= core gui
+
+INCLUDEPATH	= ../../lib
+
+# libkonsole is put into lib/ by release builds and into the top level
+# directory by debug builds
+LIBS		+= -L../../lib -L../.. -lkonsole
+QMAKE_RPATHDIR	+= $$PWD/../../lib $$PWD/../..
+
+SOURCES		= HistoryTest.cpp
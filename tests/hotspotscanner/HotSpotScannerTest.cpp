@@ -0,0 +1,222 @@
+/*
+    Copyright (C) 2026 by agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Qt
+#include <QtCore/QRegExp>
+#include <QtCore/QStringList>
+#include <QtTest/QtTest>
+
+// Konsole
+#include "HotSpotScanner.h"
+
+using namespace Konsole;
+
+typedef HotSpotScanner::Match Match;
+
+/**
+ * Checks that HotSpotScanner finds the same URLs and e-mail addresses as the
+ * regular expressions UrlFilter used before, and compares the time they take.
+ */
+class HotSpotScannerTest : public QObject
+{
+Q_OBJECT
+
+private slots:
+    void linksMatchCompleteUrlRegExp_data();
+    void linksMatchCompleteUrlRegExp();
+    void randomLinksMatchCompleteUrlRegExp();
+
+    void benchmarkScanner();
+    void benchmarkScannerWithPatterns();
+    void benchmarkCompleteUrlRegExp();
+
+private:
+    // finds the links in 'text' in the same way as RegExpFilter::process() did
+    // with UrlFilter's regular expression, and classifies them in the same way
+    // as UrlFilter::HotSpot::urlType() did
+    static QVector<Match> regExpLinks(const QString& text);
+    static QVector<Match> scannerLinks(const QString& text);
+    static QString toString(const QVector<Match>& matches);
+    static QString logText();
+
+    static const QRegExp FullUrlRegExp;
+    static const QRegExp EmailAddressRegExp;
+    static const QRegExp CompleteUrlRegExp;
+};
+
+// the expressions which were used by UrlFilter before HotSpotScanner
+const QRegExp HotSpotScannerTest::FullUrlRegExp("(www\\.(?!\\.)|[a-z][a-z0-9+.-]*://)[^\\s<>'\"]+[^!,\\.\\s<>'\"\\]]");
+const QRegExp HotSpotScannerTest::EmailAddressRegExp("\\b(\\w|\\.|-)+@(\\w|\\.|-)+\\.\\w+\\b");
+const QRegExp HotSpotScannerTest::CompleteUrlRegExp('('+FullUrlRegExp.pattern()+'|'+
+                                                    EmailAddressRegExp.pattern()+')');
+
+QVector<Match> HotSpotScannerTest::regExpLinks(const QString& text)
+{
+    QVector<Match> matches;
+    QRegExp searchText(CompleteUrlRegExp);
+    int pos = 0;
+
+    while ( (pos = searchText.indexIn(text,pos)) >= 0 )
+    {
+        Match match;
+        match.start = pos;
+        match.length = searchText.matchedLength();
+        match.kind = FullUrlRegExp.exactMatch(searchText.cap(0)) ? HotSpotScanner::Url
+                                                                  : HotSpotScanner::Email;
+        matches << match;
+
+        pos += searchText.matchedLength();
+    }
+
+    return matches;
+}
+
+QVector<Match> HotSpotScannerTest::scannerLinks(const QString& text)
+{
+    HotSpotScanner scanner;
+    QVector<Match> matches;
+    scanner.scan(text.constData(),text.length(),matches);
+    return matches;
+}
+
+QString HotSpotScannerTest::toString(const QVector<Match>& matches)
+{
+    QStringList list;
+    for (int i = 0 ; i < matches.count() ; i++)
+        list << QString("%1+%2/%3").arg(matches[i].start)
+                                   .arg(matches[i].length)
+                                   .arg(matches[i].kind);
+    return list.join(" ");
+}
+
+QString HotSpotScannerTest::logText()
+{
+    const QString link("2026-10-17 12:00:01.123 INFO  [worker-7] src/net/Connection.cpp:482 "
+                       "GET https://example.com/api/v2/items?id=1234&sort=asc "
+                       "from admin@example.org took 12ms (PROJ-1234)\n");
+    const QString plain("2026-10-17 12:00:01.124 DEBUG [worker-3] cache hit ratio 0.9731, "
+                        "48213 entries, evicted 12 stale items in 0.3ms\n");
+
+    QString text;
+    for (int i = 0 ; i < 2000 ; i++)
+        text += (i % 2) ? link : plain;
+    return text;
+}
+
+void HotSpotScannerTest::linksMatchCompleteUrlRegExp_data()
+{
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("url") << "see http://example.com/path?a=1 for details";
+    QTest::newRow("url with trailing dot") << "go to https://example.com/.";
+    QTest::newRow("url in brackets") << "[http://example.com/a] <ftp://host/b>";
+    QTest::newRow("url in quotes") << "'svn+ssh://host/repo' \"file:///tmp/x\"";
+    QTest::newRow("www") << "www.example.com, www..example.com and www.";
+    QTest::newRow("scheme after upper case") << "Xhttp://example.com HTTP://example.com";
+    QTest::newRow("email") << "mail me at first.last-name@example.co.uk!";
+    QTest::newRow("email without domain") << "user@localhost and @example.com";
+    QTest::newRow("email in url") << "http://user@example.com/ and www.user@example.com-";
+    QTest::newRow("multiple lines") << "a@b.c\nhttp://x/y\n\nwww.z.org\n";
+    QTest::newRow("empty") << "";
+}
+
+void HotSpotScannerTest::linksMatchCompleteUrlRegExp()
+{
+    QFETCH(QString,text);
+
+    QCOMPARE(toString(scannerLinks(text)),toString(regExpLinks(text)));
+}
+
+void HotSpotScannerTest::randomLinksMatchCompleteUrlRegExp()
+{
+    // fragments which are likely to start, end or break up URLs and e-mail addresses
+    static const char* const fragments[] = { "http","://","www.","www..","@",".",
+                                             " ","a","b","x","-","_","9",",","!","]",
+                                             "<","'","svn+ssh","mail","com",":/","/",
+                                             "Z","\t","..","@@","w","ww" };
+    static const int fragmentCount = sizeof(fragments) / sizeof(fragments[0]);
+
+    qsrand(1);
+
+    for (int i = 0 ; i < 20000 ; i++)
+    {
+        QString text;
+        const int length = qrand() % 15;
+        for (int j = 0 ; j < length ; j++)
+            text += fragments[qrand() % fragmentCount];
+
+        const QString found = toString(scannerLinks(text));
+        const QString expected = toString(regExpLinks(text));
+        if (found != expected)
+        {
+            QFAIL(qPrintable(QString("\"%1\": found %2, expected %3").arg(text)
+                                                                    .arg(found)
+                                                                    .arg(expected)));
+        }
+    }
+}
+
+void HotSpotScannerTest::benchmarkScanner()
+{
+    const QString text = logText();
+    HotSpotScanner scanner;
+    QVector<Match> matches;
+
+    QBENCHMARK
+    {
+        matches.clear();
+        scanner.scan(text.constData(),text.length(),matches);
+    }
+
+    QCOMPARE(matches.count(),2000);
+}
+
+void HotSpotScannerTest::benchmarkScannerWithPatterns()
+{
+    const QString text = logText();
+    HotSpotScanner scanner;
+    QVERIFY(scanner.addPattern("[\\w./-]+:\\d+") != -1);
+    QVERIFY(scanner.addPattern("[A-Z]+-\\d+") != -1);
+    QVector<Match> matches;
+
+    QBENCHMARK
+    {
+        matches.clear();
+        scanner.scan(text.constData(),text.length(),matches);
+    }
+
+    QVERIFY(matches.count() > 2000);
+}
+
+void HotSpotScannerTest::benchmarkCompleteUrlRegExp()
+{
+    const QString text = logText();
+    QVector<Match> matches;
+
+    QBENCHMARK
+    {
+        matches = regExpLinks(text);
+    }
+
+    QCOMPARE(matches.count(),2000);
+}
+
+QTEST_MAIN(HotSpotScannerTest)
+
+#include "HotSpotScannerTest.moc"
@@ -0,0 +1,16 @@
+TEMPLATE	= app
+TARGET		= hotspotscannertest
+
+CONFIG		+= qt qtestlib warn_on console
+CONFIG		-= app_bundle
+
+QT		= core
+
+# The scanner only needs QtCore, so it is compiled in directly rather than
+# linking against libkonsole.
+
+INCLUDEPATH	= ../../lib
+
+HEADERS		= ../../lib/HotSpotScanner.h
+SOURCES		= ../../lib/HotSpotScanner.cpp \
+		HotSpotScannerTest.cpp
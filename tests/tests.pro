@@ -0,0 +1,10 @@
+TEMPLATE	= subdirs
+
+# The tests are only built when asked for, with
+#   qmake CONFIG+=tests
+# in the top level directory.  Each test is an executable which runs its
+# QtTest cases and benchmarks, for example
+#   tests/hotspotscanner/hotspotscannertest
+# Add -iterations or -callgrind to get steadier benchmark results.
+
+SUBDIRS		= hotspotscanner history emulation